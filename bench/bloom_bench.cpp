@@ -0,0 +1,49 @@
+#include "../src/bloom.h"
+
+#include <benchmark/benchmark.h>
+#include <string>
+#include <vector>
+
+/*
+ * Bloom filter lookups on a 10M item filter at 1%, which is far larger
+ * than the caches, so the cost is dominated by the one block read.
+ */
+
+static Bloom *filled(){
+    static Bloom *bf = NULL;
+    if(!bf){
+        bf = bloom_new(10000000, 0.01);
+        for(size_t i = 0; i < 10000000; ++i){
+            std::string item = "id:" + std::to_string(i);
+            bloom_add(bf, item.data(), item.size());
+        }
+    }
+    return bf;
+}
+
+// state.range(0) selects items that were added (1) or not (0)
+static void BM_Exists(benchmark::State &state){
+    Bloom *bf = filled();
+    std::vector<std::string> items;
+    for(size_t i = 0; i < 4096; ++i){
+        items.push_back((state.range(0) ? "id:" : "no:") + std::to_string(i * 2441));
+    }
+    size_t i = 0;
+    for(auto _ : state){
+        const std::string &item = items[i++ & 4095];
+        benchmark::DoNotOptimize(bloom_exists(bf, item.data(), item.size()));
+    }
+    state.SetLabel(std::to_string(bloom_bytes(bf) >> 20) + "MB");
+}
+BENCHMARK(BM_Exists)->Arg(0)->Arg(1);
+
+static void BM_Add(benchmark::State &state){
+    Bloom *bf = bloom_new(10000000, 0.01);
+    size_t i = 0;
+    for(auto _ : state){
+        std::string item = "id:" + std::to_string(i++);
+        benchmark::DoNotOptimize(bloom_add(bf, item.data(), item.size()));
+    }
+    bloom_free(bf);
+}
+BENCHMARK(BM_Add);
@@ -0,0 +1,105 @@
+#include "../src/btree.h"
+
+#include <benchmark/benchmark.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Ordered key index benchmarks against 1M keys "user:<i>:<field>", next to
+ * the std::map the keyspace is today, for seeks and prefix scans.
+ */
+
+const size_t k_users = 100000;
+const size_t k_fields = 10;
+
+static std::string key(size_t user, size_t field){
+    char buf[48];
+    int n = snprintf(buf, sizeof(buf), "user:%zu:f%zu", user, field);
+    return std::string(buf, n);
+}
+
+static BTree *big_tree(){
+    static BTree *bt = NULL;
+    if(!bt){
+        bt = bt_new();
+        for(size_t u = 0; u < k_users; ++u){
+            for(size_t f = 0; f < k_fields; ++f){
+                bt_insert(bt, key(u, f));
+            }
+        }
+    }
+    return bt;
+}
+
+static std::map<std::string, int> &big_map(){
+    static std::map<std::string, int> map;
+    if(map.empty()){
+        for(size_t u = 0; u < k_users; ++u){
+            for(size_t f = 0; f < k_fields; ++f){
+                map[key(u, f)] = 0;
+            }
+        }
+    }
+    return map;
+}
+
+static std::vector<std::string> random_prefixes(){
+    std::vector<std::string> out;
+    for(size_t i = 0; i < 4096; ++i){
+        out.push_back("user:" + std::to_string((size_t)rand() % k_users) + ":");
+    }
+    return out;
+}
+
+static void BM_BTreeInsert(benchmark::State &state){
+    std::vector<std::string> keys;
+    for(size_t i = 0; i < 100000; ++i){
+        keys.push_back(key((size_t)rand() % k_users, i % k_fields));
+    }
+    for(auto _ : state){
+        BTree *bt = bt_new();
+        for(const std::string &k : keys){
+            bt_insert(bt, k);
+        }
+        state.PauseTiming();
+        bt_free(bt);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_BTreeInsert)->Unit(benchmark::kMillisecond);
+
+// all fields of one user, as PREFIXSCAN user:<i>: does
+static void BM_BTreePrefixScan(benchmark::State &state){
+    BTree *bt = big_tree();
+    std::vector<std::string> prefixes = random_prefixes();
+    size_t i = 0;
+    size_t n = 0;
+    for(auto _ : state){
+        const std::string &p = prefixes[i++ & 4095];
+        for(BtIter it = bt_seek(bt, p.data(), p.size());
+            bt_valid(it) && bt_key(it).compare(0, p.size(), p) == 0; bt_next(it)){
+            n++;
+        }
+    }
+    benchmark::DoNotOptimize(n);
+}
+BENCHMARK(BM_BTreePrefixScan);
+
+static void BM_MapPrefixScan(benchmark::State &state){
+    std::map<std::string, int> &map = big_map();
+    std::vector<std::string> prefixes = random_prefixes();
+    size_t i = 0;
+    size_t n = 0;
+    for(auto _ : state){
+        const std::string &p = prefixes[i++ & 4095];
+        for(auto it = map.lower_bound(p); it != map.end() && it->first.compare(0, p.size(), p) == 0; ++it){
+            n++;
+        }
+    }
+    benchmark::DoNotOptimize(n);
+}
+BENCHMARK(BM_MapPrefixScan);
@@ -0,0 +1,43 @@
+#include "../src/hotkeys.h"
+
+#include <benchmark/benchmark.h>
+
+/*
+ * Cost of hk_touch(), which runs on every keyspace access: a uniform
+ * stream over many keys (almost never entering the top-K) and a skewed one
+ * where a few keys take most accesses.
+ */
+
+static std::vector<std::string> keys(size_t n){
+    std::vector<std::string> out;
+    for(size_t i = 0; i < n; ++i){
+        out.push_back("key:" + std::to_string(i));
+    }
+    return out;
+}
+
+static void BM_TouchUniform(benchmark::State &state){
+    std::vector<std::string> ks = keys(1 << 16);
+    HotKeys *hk = hk_new();
+    size_t i = 0;
+    for(auto _ : state){
+        const std::string &k = ks[(i++ * 7919) & (ks.size() - 1)];
+        hk_touch(hk, k.data(), k.size());
+    }
+    hk_free(hk);
+}
+BENCHMARK(BM_TouchUniform);
+
+// every other access goes to one of 8 hot keys
+static void BM_TouchSkewed(benchmark::State &state){
+    std::vector<std::string> ks = keys(1 << 16);
+    HotKeys *hk = hk_new();
+    size_t i = 0;
+    for(auto _ : state){
+        ++i;
+        const std::string &k = (i & 1) ? ks[i & 7] : ks[(i * 7919) & (ks.size() - 1)];
+        hk_touch(hk, k.data(), k.size());
+    }
+    hk_free(hk);
+}
+BENCHMARK(BM_TouchSkewed);
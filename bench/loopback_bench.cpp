@@ -0,0 +1,94 @@
+#include "../src/server_client.h"
+#include "../src/parser.h"
+
+#include <benchmark/benchmark.h>
+#include <mutex>
+#include <thread>
+
+/*
+ * End-to-end round trips to a server on the same host: a server runs its
+ * event loop in a background thread of this process, listening on loopback
+ * TCP and on a Unix domain socket, and the benchmark is the client.
+ *
+ * BENCH_IO_THREADS=n runs the server with n I/O threads (set_io_threads()),
+ * to compare GET throughput from several clients against one thread.
+ */
+
+static std::string unix_path(){
+    return "/tmp/loopback_bench_" + std::to_string(getpid()) + ".sock";
+}
+
+// starts the server once, on an ephemeral port and a Unix socket
+static uint16_t server_port(){
+    static uint16_t port = 0;
+    if(!port){
+        const char *io_threads = getenv("BENCH_IO_THREADS");
+        set_io_threads(io_threads ? atoi(io_threads) : 0);
+        int server_sock = create_server_socket();
+        bind_socket(server_sock, 0);
+        struct sockaddr_in addr = {};
+        socklen_t len = sizeof(addr);
+        getsockname(server_sock, (struct sockaddr *)&addr, &len);
+        port = ntohs(addr.sin_port);
+        listen_socket(server_sock);
+        int unix_sock = create_unix_server_socket(unix_path().c_str());
+        listen_socket(unix_sock);
+        std::thread(accept_connections, std::vector<int>{server_sock, unix_sock}).detach();
+    }
+    return port;
+}
+
+// `local` picks the Unix socket over TCP
+static int connect_client(bool local){
+    uint16_t port = server_port();
+    if(local){
+        int fd = create_unix_client_socket();
+        connect_unix(fd, unix_path().c_str());
+        return fd;
+    }
+    int fd = create_client_socket();
+    connect(fd, INADDR_LOOPBACK, port);
+    return fd;
+}
+
+static bool read_reply(int fd, char *buf){
+    uint32_t len = 0;
+    if(read_full(fd, (char *)&len, 4) || len > k_max_msg){
+        return false;
+    }
+    return read_full(fd, buf, len) == 0;
+}
+
+// state.range(0) is 0 for TCP, 1 for the Unix socket, and state.range(1)
+// is the number of requests in flight per round trip
+static void BM_RoundTripGet(benchmark::State &state){
+    static std::mutex start;
+    int fd;
+    {
+        // the server starts with the first client
+        std::lock_guard<std::mutex> lock(start);
+        fd = connect_client(state.range(0) == 1);
+    }
+    state.SetLabel(state.range(0) ? "unix" : "tcp");
+    std::vector<std::string> set = {"set", "k", "value-value-value"};
+    std::vector<std::string> get = {"get", "k"};
+    char buf[4 + k_max_msg];
+    send_req(fd, set);
+    read_reply(fd, buf);
+
+    int64_t depth = state.range(1);
+    for(auto _ : state){
+        for(int64_t i = 0; i < depth; ++i){
+            send_req(fd, get);
+        }
+        for(int64_t i = 0; i < depth; ++i){
+            if(!read_reply(fd, buf)){
+                state.SkipWithError("connection lost");
+                break;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * depth);
+    close(fd);
+}
+BENCHMARK(BM_RoundTripGet)->ArgsProduct({{0, 1}, {1, 16}})->ThreadRange(1, 4)->UseRealTime();
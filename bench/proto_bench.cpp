@@ -0,0 +1,93 @@
+#include "../src/server_client.h"
+#include "../src/parser.h"
+#include "../src/resp.h"
+
+#include <benchmark/benchmark.h>
+
+/*
+ * Parse cost of the two wire protocols on the same pipelined workload:
+ * state.range(0) "SET key:<i> <value>" commands back to back in one buffer.
+ */
+
+static std::vector<std::string> set_cmd(size_t i, size_t vlen){
+    return {"SET", "key:" + std::to_string(i), std::string(vlen, 'x')};
+}
+
+static std::string native_frames(size_t n, size_t vlen){
+    std::string buf;
+    for(size_t i = 0; i < n; ++i){
+        std::vector<std::string> cmd = set_cmd(i, vlen);
+        uint32_t len = 4;
+        for(const std::string &s : cmd){
+            len += 4 + s.size();
+        }
+        uint32_t argc = cmd.size();
+        buf.append((char *)&len, 4);
+        buf.append((char *)&argc, 4);
+        for(const std::string &s : cmd){
+            uint32_t sz = s.size();
+            buf.append((char *)&sz, 4);
+            buf.append(s);
+        }
+    }
+    return buf;
+}
+
+static std::string resp_frames(size_t n, size_t vlen){
+    std::string buf;
+    for(size_t i = 0; i < n; ++i){
+        std::vector<std::string> cmd = set_cmd(i, vlen);
+        buf += "*" + std::to_string(cmd.size()) + "\r\n";
+        for(const std::string &s : cmd){
+            buf += "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+        }
+    }
+    return buf;
+}
+
+// the framing loop of try_one_request() plus parse_req() per frame
+static void BM_ParseNative(benchmark::State &state){
+    std::string buf = native_frames((size_t)state.range(0), (size_t)state.range(1));
+    const uint8_t *data = (const uint8_t *)buf.data();
+    for(auto _ : state){
+        size_t pos = 0;
+        while(pos + 4 <= buf.size()){
+            uint32_t len = 0;
+            memcpy(&len, &data[pos], 4);
+            std::vector<std::string> cmd;
+            parse_req(&data[pos + 4], len, cmd);
+            benchmark::DoNotOptimize(cmd.data());
+            pos += 4 + len;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_ParseNative)->Args({64, 16})->Args({64, 1024});
+
+static void BM_ParseResp(benchmark::State &state){
+    std::string buf = resp_frames((size_t)state.range(0), (size_t)state.range(1));
+    for(auto _ : state){
+        std::deque<std::vector<std::string>> cmds;
+        size_t consumed = 0;
+        RespParse st;
+        resp_parse_batch((const uint8_t *)buf.data(), buf.size(), k_max_msg, cmds, &consumed, st);
+        benchmark::DoNotOptimize(consumed);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_ParseResp)->Args({64, 16})->Args({64, 1024});
+
+// the CRLF scan alone, which is the vectorized part of the RESP parser
+static void BM_ScanCrlf(benchmark::State &state){
+    std::string buf = resp_frames((size_t)state.range(0), (size_t)state.range(1));
+    std::vector<uint32_t> pos;
+    for(auto _ : state){
+        pos.clear();
+        resp_scan_crlf((const uint8_t *)buf.data(), buf.size(), pos);
+        benchmark::DoNotOptimize(pos.data());
+    }
+    state.SetBytesProcessed(state.iterations() * buf.size());
+}
+BENCHMARK(BM_ScanCrlf)->Args({64, 16})->Args({64, 1024});
@@ -0,0 +1,192 @@
+#include "../src/server_client.h"
+
+#include <benchmark/benchmark.h>
+
+/*
+ * Request path benchmarks, run in process against the server's keyspace:
+ *
+ * - command dispatch through do_request()
+ * - framing plus execution through try_one_request(), in both protocols
+ * - GET of values from 64 bytes to 64KB, sent by reference from 1KB up
+ * - GET/SET/DEL on tables from 1K to 50M keys
+ *
+ * Tables above BENCH_MAX_KEYS keys (default 1M) are skipped, as the big
+ * ones need tens of GB of RAM; raise it to run them.
+ */
+
+static size_t max_keys(){
+    const char *env = getenv("BENCH_MAX_KEYS");
+    return env ? (size_t)atoll(env) : (size_t)1 << 20;
+}
+
+static std::string key(size_t i){
+    return "key:" + std::to_string(i);
+}
+
+// a connection whose responses go to /dev/null
+static Conn *bench_conn(){
+    Conn *conn = new Conn();
+    conn->fd = open("/dev/null", O_WRONLY);
+    conn->state = STATE_REQ;
+    return conn;
+}
+
+// grows the keyspace to at least `n` keys named key:0 .. key:n-1
+static void ensure_keys(size_t n){
+    static size_t loaded = 0;
+    static Conn *conn = bench_conn();
+    for(; loaded < n; ++loaded){
+        std::vector<std::string> cmd = {"set", key(loaded), "value-value-value"};
+        std::string out;
+        do_request(conn, cmd, out);
+    }
+}
+
+static bool skip_big(benchmark::State &state, size_t n){
+    if(n > max_keys()){
+        state.SkipWithError("table larger than BENCH_MAX_KEYS");
+        return true;
+    }
+    return false;
+}
+
+// dispatch cost of commands at different depths of the do_request() chain
+static void BM_Dispatch(benchmark::State &state){
+    static const std::vector<std::vector<std::string>> cmds = {
+        {"get", "missing"},
+        {"zscore", "missing", "m"},
+        {"llen", "missing"},
+        {"ping"},
+        {"nosuchcommand"},
+    };
+    Conn *conn = bench_conn();
+    const std::vector<std::string> &proto = cmds[state.range(0)];
+    state.SetLabel(proto[0]);
+    for(auto _ : state){
+        std::vector<std::string> cmd = proto;
+        std::string out;
+        do_request(conn, cmd, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    conn_free(conn);
+}
+BENCHMARK(BM_Dispatch)->DenseRange(0, 4);
+
+static std::string native_frame(const std::vector<std::string> &cmd){
+    std::string body;
+    uint32_t n = (uint32_t)cmd.size();
+    body.append((char *)&n, 4);
+    for(const std::string &s : cmd){
+        uint32_t len = (uint32_t)s.size();
+        body.append((char *)&len, 4);
+        body.append(s);
+    }
+    uint32_t len = (uint32_t)body.size();
+    return std::string((char *)&len, 4) + body;
+}
+
+static std::string resp_frame(const std::vector<std::string> &cmd){
+    std::string buf = "*" + std::to_string(cmd.size()) + "\r\n";
+    for(const std::string &s : cmd){
+        buf += "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+    }
+    return buf;
+}
+
+// a whole GET through the connection state machine, response included
+static void BM_TryOneRequest(benchmark::State &state){
+    ensure_keys(1024);
+    std::vector<std::string> cmd = {"get", key(7)};
+    std::string frame = state.range(0) ? resp_frame(cmd) : native_frame(cmd);
+    state.SetLabel(state.range(0) ? "resp" : "native");
+
+    Conn *conn = bench_conn();
+    for(auto _ : state){
+        memcpy(conn->rbuf.data(), frame.data(), frame.size());
+        conn->rbuf_size = frame.size();
+        try_one_request(conn);
+    }
+    conn_free(conn);
+}
+BENCHMARK(BM_TryOneRequest)->Arg(0)->Arg(1);
+
+// GET of one value of state.range(0) bytes, written out to /dev/null
+static void BM_GetValueSize(benchmark::State &state){
+    Conn *conn = bench_conn();
+    std::vector<std::string> set = {"set", "big", std::string((size_t)state.range(0), 'v')};
+    std::string out;
+    do_request(conn, set, out);
+
+    std::string frame = native_frame({"get", "big"});
+    for(auto _ : state){
+        memcpy(conn->rbuf.data(), frame.data(), frame.size());
+        conn->rbuf_size = frame.size();
+        try_one_request(conn);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    conn_free(conn);
+}
+BENCHMARK(BM_GetValueSize)->Arg(64)->Arg(1 << 10)->Arg(16 << 10)->Arg(64 << 10);
+
+static void table_sizes(benchmark::internal::Benchmark *b){
+    for(int64_t n : {1 << 10, 1 << 16, 1 << 20, 10000000, 50000000}){
+        b->Arg(n);
+    }
+}
+
+static void BM_Get(benchmark::State &state){
+    size_t n = (size_t)state.range(0);
+    if(skip_big(state, n)){
+        return;
+    }
+    ensure_keys(n);
+    Conn *conn = bench_conn();
+    size_t i = 0;
+    for(auto _ : state){
+        std::vector<std::string> cmd = {"get", key((i++ * 7919) % n)};
+        std::string out;
+        do_request(conn, cmd, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    conn_free(conn);
+}
+BENCHMARK(BM_Get)->Apply(table_sizes);
+
+// overwrites existing keys, so the table size stays the same
+static void BM_Set(benchmark::State &state){
+    size_t n = (size_t)state.range(0);
+    if(skip_big(state, n)){
+        return;
+    }
+    ensure_keys(n);
+    Conn *conn = bench_conn();
+    size_t i = 0;
+    for(auto _ : state){
+        std::vector<std::string> cmd = {"set", key((i++ * 7919) % n), "value-value-value"};
+        std::string out;
+        do_request(conn, cmd, out);
+    }
+    conn_free(conn);
+}
+BENCHMARK(BM_Set)->Apply(table_sizes);
+
+// a DEL and the SET that puts the key back
+static void BM_DelSet(benchmark::State &state){
+    size_t n = (size_t)state.range(0);
+    if(skip_big(state, n)){
+        return;
+    }
+    ensure_keys(n);
+    Conn *conn = bench_conn();
+    size_t i = 0;
+    for(auto _ : state){
+        std::string k = key((i++ * 7919) % n);
+        std::vector<std::string> del = {"del", k};
+        std::vector<std::string> set = {"set", k, "value-value-value"};
+        std::string out;
+        do_request(conn, del, out);
+        do_request(conn, set, out);
+    }
+    conn_free(conn);
+}
+BENCHMARK(BM_DelSet)->Apply(table_sizes);
@@ -0,0 +1,151 @@
+#include "../src/zset.h"
+
+#include <benchmark/benchmark.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+/*
+ * Sorted set benchmarks against a 1M-member set.
+ *
+ * The big set is built once and shared by the read benchmarks; members are
+ * "m<i>" with score i, so rank and score of every member are known.
+ */
+
+const size_t k_big = 1000000;
+
+static std::string member(size_t i){
+    char buf[32];
+    int n = snprintf(buf, sizeof(buf), "m%zu", i);
+    return std::string(buf, n);
+}
+
+static ZSet *big_zset(){
+    static ZSet *zset = NULL;
+    if(!zset){
+        zset = zset_new();
+        for(size_t i = 0; i < k_big; ++i){
+            std::string m = member(i);
+            zset_add(zset, m.data(), m.size(), (double)i);
+        }
+    }
+    return zset;
+}
+
+static std::vector<std::string> random_members(size_t n, size_t range){
+    std::vector<std::string> out;
+    for(size_t i = 0; i < n; ++i){
+        out.push_back(member((size_t)rand() % range));
+    }
+    return out;
+}
+
+static void noop_visit(const char *name, size_t len, double score, void *arg){
+    (void)name;
+    (void)len;
+    (void)score;
+    ++*(size_t *)arg;
+}
+
+// inserting members into a set of state.range(0) members, one at a time
+static void BM_ZAdd(benchmark::State &state){
+    size_t n = (size_t)state.range(0);
+    std::vector<std::string> members;
+    for(size_t i = 0; i < n; ++i){
+        members.push_back(member(i));
+    }
+
+    for(auto _ : state){
+        ZSet *zset = zset_new();
+        for(size_t i = 0; i < n; ++i){
+            zset_add(zset, members[i].data(), members[i].size(), (double)rand());
+        }
+        state.PauseTiming();
+        zset_free(zset);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ZAdd)->Arg(64)->Arg(1000)->Arg(k_big)->Unit(benchmark::kMillisecond);
+
+// changing the score of existing members
+static void BM_ZAddUpdate(benchmark::State &state){
+    ZSet *zset = big_zset();
+    std::vector<std::string> keys = random_members(4096, k_big);
+    size_t i = 0;
+    for(auto _ : state){
+        const std::string &m = keys[i++ & 4095];
+        zset_add(zset, m.data(), m.size(), (double)(rand() % k_big));
+    }
+}
+BENCHMARK(BM_ZAddUpdate);
+
+static void BM_ZScore(benchmark::State &state){
+    ZSet *zset = big_zset();
+    std::vector<std::string> keys = random_members(4096, k_big);
+    size_t i = 0;
+    double score = 0;
+    for(auto _ : state){
+        const std::string &m = keys[i++ & 4095];
+        benchmark::DoNotOptimize(zset_score(zset, m.data(), m.size(), &score));
+    }
+}
+BENCHMARK(BM_ZScore);
+
+static void BM_ZRank(benchmark::State &state){
+    ZSet *zset = big_zset();
+    std::vector<std::string> keys = random_members(4096, k_big);
+    size_t i = 0;
+    for(auto _ : state){
+        const std::string &m = keys[i++ & 4095];
+        benchmark::DoNotOptimize(zset_rank(zset, m.data(), m.size()));
+    }
+}
+BENCHMARK(BM_ZRank);
+
+// ZRANGE of state.range(0) members starting at a random rank
+static void BM_ZRangeByRank(benchmark::State &state){
+    ZSet *zset = big_zset();
+    size_t count = (size_t)state.range(0);
+    size_t visited = 0;
+    for(auto _ : state){
+        size_t start = (size_t)rand() % (k_big - count);
+        zset_range_by_rank(zset, start, start + count - 1, noop_visit, &visited);
+    }
+    benchmark::DoNotOptimize(visited);
+}
+BENCHMARK(BM_ZRangeByRank)->Arg(10)->Arg(100);
+
+// ZRANGEBYSCORE of state.range(0) members starting at a random score
+static void BM_ZRangeByScore(benchmark::State &state){
+    ZSet *zset = big_zset();
+    size_t count = (size_t)state.range(0);
+    size_t visited = 0;
+    for(auto _ : state){
+        ZRangeSpec range;
+        range.min = (double)((size_t)rand() % k_big);
+        range.max = range.min + count;
+        zset_range_by_score(zset, range, 0, count, noop_visit, &visited);
+    }
+    benchmark::DoNotOptimize(visited);
+}
+BENCHMARK(BM_ZRangeByScore)->Arg(10)->Arg(100);
+
+// the packed encoding on a set just under the conversion threshold
+static void BM_ZScorePacked(benchmark::State &state){
+    ZSet *zset = zset_new();
+    for(size_t i = 0; i < zset_max_packed_entries; ++i){
+        std::string m = member(i);
+        zset_add(zset, m.data(), m.size(), (double)i);
+    }
+    std::vector<std::string> keys = random_members(4096, zset_max_packed_entries);
+    size_t i = 0;
+    double score = 0;
+    for(auto _ : state){
+        const std::string &m = keys[i++ & 4095];
+        benchmark::DoNotOptimize(zset_score(zset, m.data(), m.size(), &score));
+    }
+    zset_free(zset);
+}
+BENCHMARK(BM_ZScorePacked);
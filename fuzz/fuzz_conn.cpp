@@ -0,0 +1,46 @@
+#include "../src/server_client.h"
+
+/*
+ * Fuzzes the connection state machine: the input is fed to a connection
+ * the way try_fill_buffer() does, in reads of varying size, and requests
+ * are run after every read. Both protocols are reachable, as the first
+ * bytes pick native framing or RESP. Responses are written to /dev/null.
+ *
+ * The first input byte sets the read size, to cover requests split at
+ * every position.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+    if(size == 0){
+        return 0;
+    }
+    size_t chunk = (data[0] % 64) + 1;
+    data++;
+    size--;
+
+    Conn *conn = new Conn();
+    conn->fd = open("/dev/null", O_WRONLY);
+    conn->state = STATE_REQ;
+
+    size_t pos = 0;
+    while(pos < size && conn->state == STATE_REQ){
+        // the buffer grows like try_fill_buffer() grows it
+        if(conn->rbuf_size == conn->rbuf.size()){
+            if(conn->rbuf.size() >= 4 + k_max_req){
+                break;
+            }
+            conn->rbuf.resize(std::min(2 * conn->rbuf.size(), 4 + k_max_req));
+        }
+        size_t cap = conn->rbuf.size() - conn->rbuf_size;
+        size_t n = std::min(std::min(chunk, size - pos), cap);
+        memcpy(&conn->rbuf[conn->rbuf_size], &data[pos], n);
+        conn->rbuf_size += n;
+        pos += n;
+
+        while(try_one_request(conn)){}
+        assert(conn->rbuf_size <= conn->rbuf.size());
+        assert(conn->wbuf_size <= sizeof(conn->wbuf));
+    }
+
+    conn_free(conn);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include "../src/server_client.h"
+#include "../src/parser.h"
+
+/*
+ * Fuzzes parse_req() with arbitrary request bodies (the bytes after the
+ * 4-byte length header). A body that parses must account for every byte,
+ * so re-encoding the parsed strings has to give back the input.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+    std::vector<std::string> out;
+    if(0 != parse_req(data, size, out)){
+        return 0;
+    }
+
+    std::string buf;
+    uint32_t n = (uint32_t)out.size();
+    buf.append((char *)&n, 4);
+    for(const std::string &s : out){
+        uint32_t len = (uint32_t)s.size();
+        buf.append((char *)&len, 4);
+        buf.append(s);
+    }
+    assert(buf.size() == size);
+    assert(0 == memcmp(buf.data(), data, size));
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+/*
+ * Driver for compilers without libFuzzer. It accepts the same arguments a
+ * libFuzzer binary gets from ctest: every file (or file inside a directory)
+ * is run as an input, then `-runs=N` inputs are made by mutating those
+ * seeds with a PRNG seeded by `-seed=S`. Other flags are ignored.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static void load_path(const std::string &path, std::vector<std::string> &seeds){
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0){
+        return;
+    }
+    if(S_ISDIR(st.st_mode)){
+        DIR *dir = opendir(path.c_str());
+        if(!dir){
+            return;
+        }
+        while(struct dirent *ent = readdir(dir)){
+            if(ent->d_name[0] != '.'){
+                load_path(path + "/" + ent->d_name, seeds);
+            }
+        }
+        closedir(dir);
+        return;
+    }
+    std::ifstream f(path, std::ios::binary);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    seeds.push_back(ss.str());
+}
+
+static std::string mutate(const std::vector<std::string> &seeds){
+    std::string in = seeds.empty() ? std::string() : seeds[rand() % seeds.size()];
+    int steps = 1 + rand() % 8;
+    for(int i = 0; i < steps; ++i){
+        size_t pos = in.empty() ? 0 : (size_t)rand() % in.size();
+        switch(rand() % 5){
+        case 0:     // flip a byte
+            if(!in.empty()){
+                in[pos] = (char)rand();
+            }
+            break;
+        case 1:     // insert random bytes
+            in.insert(pos, std::string(1 + rand() % 8, (char)rand()));
+            break;
+        case 2:     // truncate
+            in.resize(pos);
+            break;
+        case 3:     // splice in another seed
+            if(!seeds.empty()){
+                in.insert(pos, seeds[rand() % seeds.size()]);
+            }
+            break;
+        default:    // small integers are where length fields break
+            if(!in.empty()){
+                in[pos] = (char)(rand() % 3 - 1);
+            }
+            break;
+        }
+    }
+    return in;
+}
+
+int main(int argc, char **argv){
+    long runs = 0;
+    unsigned seed = 1;
+    std::vector<std::string> seeds;
+    for(int i = 1; i < argc; ++i){
+        if(0 == strncmp(argv[i], "-runs=", 6)){
+            runs = atol(argv[i] + 6);
+        }
+        else if(0 == strncmp(argv[i], "-seed=", 6)){
+            seed = (unsigned)atol(argv[i] + 6);
+        }
+        else if(argv[i][0] != '-'){
+            load_path(argv[i], seeds);
+        }
+    }
+
+    for(const std::string &s : seeds){
+        LLVMFuzzerTestOneInput((const uint8_t *)s.data(), s.size());
+    }
+
+    srand(seed);
+    for(long i = 0; i < runs; ++i){
+        std::string in = mutate(seeds);
+        LLVMFuzzerTestOneInput((const uint8_t *)in.data(), in.size());
+    }
+    printf("ran %zu seeds and %ld mutated inputs\n", seeds.size(), runs);
+    return 0;
+}
@@ -0,0 +1,251 @@
+#include "bloom.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const size_t k_block_bits = 512;
+const size_t k_block_words = k_block_bits / 64;
+const uint32_t k_max_probes = 16;
+
+// keeping all probes in one block costs a little accuracy; this many extra
+// bits make up for it at the usual error rates
+const double k_block_overhead = 1.2;
+
+struct BloomBlock {
+    alignas(64) uint64_t w[k_block_words];
+};
+
+struct BloomFilter {
+    BloomBlock *blocks = NULL;
+    uint64_t nblocks = 0;
+    uint32_t k = 0;             // bits set per item
+    uint64_t capacity = 0;
+    uint64_t count = 0;
+    uint64_t seed = 0;          // makes the filters' hashes independent
+};
+
+struct Bloom {
+    std::vector<BloomFilter> filters;   // the last one takes new items
+    uint64_t count = 0;
+    double error = 0;                   // of the last filter
+};
+
+static uint64_t mix64(uint64_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// returns false if the filter would be too large or can not be allocated
+static bool filter_init(BloomFilter &f, uint64_t capacity, double error, uint64_t seed){
+    double ln2 = log(2.0);
+    double bits = -(double)capacity * log(error) / (ln2 * ln2) * k_block_overhead;
+    double nblocks = ceil(bits / k_block_bits);
+    if(!(nblocks <= (double)(k_bloom_max_bytes / sizeof(BloomBlock)))){
+        return false;
+    }
+    f.nblocks = nblocks < 1 ? 1 : (uint64_t)nblocks;
+    double k = ceil(-log2(error));
+    f.k = k < 1 ? 1 : (k > k_max_probes ? k_max_probes : (uint32_t)k);
+    f.capacity = capacity;
+    f.count = 0;
+    f.seed = seed;
+    f.blocks = (BloomBlock *)aligned_alloc(64, f.nblocks * sizeof(BloomBlock));
+    if(!f.blocks){
+        return false;
+    }
+    memset(f.blocks, 0, f.nblocks * sizeof(BloomBlock));
+    return true;
+}
+
+/*
+ * Picks the block of an item and builds the mask of its bits. The high
+ * half of the hash picks the block; the low half gives h1 and h2, and h2
+ * is odd so the k positions are distinct.
+ */
+static BloomBlock *filter_probe(const BloomFilter &f, uint64_t hash, uint64_t *mask){
+    hash = mix64(hash ^ f.seed);
+    uint64_t idx = ((hash >> 32) * f.nblocks) >> 32;
+    uint32_t h1 = (uint32_t)hash & 0xffff;
+    uint32_t h2 = ((uint32_t)hash >> 16) | 1;
+    memset(mask, 0, k_block_words * 8);
+    for(uint32_t i = 0; i < f.k; ++i){
+        uint32_t bit = (h1 + i * h2) & (k_block_bits - 1);
+        mask[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+    return &f.blocks[idx];
+}
+
+// whether every bit of the mask is set in the block
+static bool block_test(const BloomBlock *b, const uint64_t *mask){
+#if defined(__SSE2__)
+    __m128i miss = _mm_setzero_si128();
+    for(size_t i = 0; i < k_block_words; i += 2){
+        __m128i m = _mm_loadu_si128((const __m128i *)&mask[i]);
+        __m128i v = _mm_load_si128((const __m128i *)&b->w[i]);
+        miss = _mm_or_si128(miss, _mm_andnot_si128(v, m));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(miss, _mm_setzero_si128())) == 0xffff;
+#else
+    uint64_t miss = 0;
+    for(size_t i = 0; i < k_block_words; ++i){
+        miss |= mask[i] & ~b->w[i];
+    }
+    return miss == 0;
+#endif
+}
+
+static void block_set(BloomBlock *b, const uint64_t *mask){
+    for(size_t i = 0; i < k_block_words; ++i){
+        b->w[i] |= mask[i];
+    }
+}
+
+static uint64_t item_hash(const char *item, size_t len){
+    return std::hash<std::string_view>()(std::string_view(item, len));
+}
+
+Bloom *bloom_new(uint64_t capacity, double error){
+    if(capacity == 0 || capacity > k_bloom_max_capacity
+        || !(error >= k_bloom_min_error && error < 1)){
+        return NULL;
+    }
+    BloomFilter f;
+    if(!filter_init(f, capacity, error, 0)){
+        return NULL;
+    }
+    Bloom *bf = new Bloom();
+    bf->error = error;
+    bf->filters.push_back(f);
+    return bf;
+}
+
+void bloom_free(Bloom *bf){
+    for(BloomFilter &f : bf->filters){
+        free(f.blocks);
+    }
+    delete bf;
+}
+
+static bool exists_hash(const Bloom *bf, uint64_t hash){
+    uint64_t mask[k_block_words];
+    // the newest filter is the largest and holds the most items
+    for(size_t i = bf->filters.size(); i-- > 0;){
+        const BloomBlock *b = filter_probe(bf->filters[i], hash, mask);
+        if(block_test(b, mask)){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool bloom_add(Bloom *bf, const char *item, size_t len){
+    uint64_t hash = item_hash(item, len);
+    if(exists_hash(bf, hash)){
+        return false;
+    }
+    const BloomFilter &last = bf->filters.back();
+    if(last.count >= last.capacity && last.capacity <= k_bloom_max_capacity / 2){
+        BloomFilter f;
+        double error = std::max(bf->error / 2, k_bloom_min_error);
+        if(filter_init(f, last.capacity * 2, error, mix64(bf->filters.size() + 1))){
+            bf->error = error;
+            bf->filters.push_back(f);
+        }
+    }
+    BloomFilter &f = bf->filters.back();
+    uint64_t mask[k_block_words];
+    block_set(filter_probe(f, hash, mask), mask);
+    f.count++;
+    bf->count++;
+    return true;
+}
+
+bool bloom_exists(const Bloom *bf, const char *item, size_t len){
+    return exists_hash(bf, item_hash(item, len));
+}
+
+uint64_t bloom_count(const Bloom *bf){
+    return bf->count;
+}
+
+size_t bloom_filters(const Bloom *bf){
+    return bf->filters.size();
+}
+
+size_t bloom_bytes(const Bloom *bf){
+    size_t bytes = 0;
+    for(const BloomFilter &f : bf->filters){
+        bytes += f.nblocks * sizeof(BloomBlock);
+    }
+    return bytes;
+}
+
+/*
+ * Dump: 8B count, 8B error, 4B filter count, then per filter 8B nblocks,
+ * 4B k, 8B capacity, 8B count, 8B seed and the blocks.
+ */
+static void put(std::string &out, const void *p, size_t n){
+    out.append((const char *)p, n);
+}
+
+static bool get(const char *&p, const char *end, void *v, size_t n){
+    if((size_t)(end - p) < n){
+        return false;
+    }
+    memcpy(v, p, n);
+    p += n;
+    return true;
+}
+
+void bloom_dump(const Bloom *bf, std::string &out){
+    uint32_t nfilters = (uint32_t)bf->filters.size();
+    put(out, &bf->count, 8);
+    put(out, &bf->error, 8);
+    put(out, &nfilters, 4);
+    for(const BloomFilter &f : bf->filters){
+        put(out, &f.nblocks, 8);
+        put(out, &f.k, 4);
+        put(out, &f.capacity, 8);
+        put(out, &f.count, 8);
+        put(out, &f.seed, 8);
+        put(out, f.blocks, f.nblocks * sizeof(BloomBlock));
+    }
+}
+
+Bloom *bloom_restore(const char *data, size_t len){
+    const char *p = data, *end = data + len;
+    Bloom *bf = new Bloom();
+    uint32_t nfilters = 0;
+    bool ok = get(p, end, &bf->count, 8) && get(p, end, &bf->error, 8)
+        && get(p, end, &nfilters, 4) && nfilters > 0;
+    for(uint32_t i = 0; ok && i < nfilters; ++i){
+        BloomFilter f;
+        ok = get(p, end, &f.nblocks, 8) && get(p, end, &f.k, 4)
+            && get(p, end, &f.capacity, 8) && get(p, end, &f.count, 8)
+            && get(p, end, &f.seed, 8)
+            && f.nblocks > 0 && f.k > 0 && f.k <= k_max_probes
+            && f.nblocks <= (uint64_t)(end - p) / sizeof(BloomBlock);
+        if(ok){
+            f.blocks = (BloomBlock *)aligned_alloc(64, f.nblocks * sizeof(BloomBlock));
+            ok = f.blocks && get(p, end, f.blocks, f.nblocks * sizeof(BloomBlock));
+            bf->filters.push_back(f);
+        }
+    }
+    if(!ok || p != end){
+        bloom_free(bf);
+        return NULL;
+    }
+    return bf;
+}
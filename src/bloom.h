@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/*
+ * Scalable Bloom filter: approximate set membership in about 10 bits per
+ * item at a 1% false positive rate, with no false negatives.
+ *
+ * Each filter is an array of 64 byte blocks, and an item sets all of its
+ * k bits inside a single block picked by its hash, so an add or a lookup
+ * touches one cache line. The k bit positions come from double hashing
+ * (h1 + i * h2) and are turned into a 512-bit mask that is tested against
+ * the block as a few wide ANDs.
+ *
+ * A filter is sized for `capacity` items at `error` false positives. When
+ * it is full, another filter twice as large with half the error rate is
+ * added, and lookups check every filter, so the total false positive rate
+ * stays below 2 * error however many items are added. Error rates stop
+ * halving at k_bloom_min_error, and a filter that would be larger than
+ * k_bloom_max_bytes is not added: the last one takes the items past its
+ * capacity instead, and its error rate goes up.
+ */
+
+const uint64_t k_bloom_default_capacity = 100;
+const double k_bloom_default_error = 0.01;
+const uint64_t k_bloom_max_capacity = (uint64_t)1 << 32;
+const double k_bloom_min_error = 1e-9;
+const size_t k_bloom_max_bytes = (size_t)1 << 30;     // of one filter
+
+struct Bloom;
+
+// `error` must be in [k_bloom_min_error, 1) and `capacity` in
+// (0, k_bloom_max_capacity]; NULL if the filter would be larger than
+// k_bloom_max_bytes or can not be allocated
+Bloom *bloom_new(uint64_t capacity, double error);
+void bloom_free(Bloom *bf);
+
+// returns false if the item may already have been added
+bool bloom_add(Bloom *bf, const char *item, size_t len);
+bool bloom_exists(const Bloom *bf, const char *item, size_t len);
+
+uint64_t bloom_count(const Bloom *bf);      // items added
+size_t bloom_filters(const Bloom *bf);
+size_t bloom_bytes(const Bloom *bf);
+
+// appends the whole filter to `out`, in the host's byte order
+void bloom_dump(const Bloom *bf, std::string &out);
+// the filter of a bloom_dump(); NULL if `len` bytes are not one
+Bloom *bloom_restore(const char *data, size_t len);
@@ -0,0 +1,332 @@
+#include "btree.h"
+
+#include <string.h>
+#include <utility>
+
+// nodes other than the root keep at least this many keys
+const size_t k_bt_min = k_bt_fanout / 2 - 1;
+
+// one slot over the fanout, so a node can overflow before it is split
+struct BtNode {
+    bool leaf = true;
+    size_t n = 0;
+    uint64_t heads[k_bt_fanout + 1];
+    std::string keys[k_bt_fanout + 1];
+    BtNode *kids[k_bt_fanout + 2];      // inner nodes, n + 1 of them
+    BtNode *next = NULL;                // leaves
+};
+
+struct BTree {
+    BtNode *root = NULL;
+    size_t size = 0;
+};
+
+// the first 8 bytes of a key, zero padded, as a big endian integer
+static uint64_t key_head(const char *key, size_t len){
+    unsigned char buf[8] = {0};
+    memcpy(buf, key, len < 8 ? len : 8);
+    uint64_t h = 0;
+    for(int i = 0; i < 8; ++i){
+        h = (h << 8) | buf[i];
+    }
+    return h;
+}
+
+static int key_cmp(const BtNode *x, size_t i, const char *key, size_t len, uint64_t head){
+    if(x->heads[i] != head){
+        return x->heads[i] < head ? -1 : 1;
+    }
+    return x->keys[i].compare(0, std::string::npos, key, len);
+}
+
+// the first slot whose key is not below `key`, or above it with `upper`
+static size_t node_search(const BtNode *x, const char *key, size_t len, uint64_t head, bool upper){
+    size_t lo = 0;
+    size_t hi = x->n;
+    while(lo < hi){
+        size_t mid = (lo + hi) / 2;
+        int c = key_cmp(x, mid, key, len, head);
+        if(c < 0 || (upper && c == 0)){
+            lo = mid + 1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void key_insert(BtNode *x, size_t i, std::string key, uint64_t head){
+    for(size_t j = x->n; j > i; --j){
+        x->keys[j] = std::move(x->keys[j - 1]);
+        x->heads[j] = x->heads[j - 1];
+    }
+    x->keys[i] = std::move(key);
+    x->heads[i] = head;
+    x->n++;
+}
+
+static void key_erase(BtNode *x, size_t i){
+    for(size_t j = i; j + 1 < x->n; ++j){
+        x->keys[j] = std::move(x->keys[j + 1]);
+        x->heads[j] = x->heads[j + 1];
+    }
+    x->keys[x->n - 1].clear();
+    x->n--;
+}
+
+static void key_set(BtNode *x, size_t i, const std::string &key){
+    x->keys[i] = key;
+    x->heads[i] = key_head(key.data(), key.size());
+}
+
+// `nkids` is the number of children before the change
+static void kid_insert(BtNode *x, size_t nkids, size_t i, BtNode *kid){
+    memmove(&x->kids[i + 1], &x->kids[i], (nkids - i) * sizeof(BtNode *));
+    x->kids[i] = kid;
+}
+
+static void kid_erase(BtNode *x, size_t nkids, size_t i){
+    memmove(&x->kids[i], &x->kids[i + 1], (nkids - i - 1) * sizeof(BtNode *));
+}
+
+BTree *bt_new(){
+    BTree *bt = new BTree();
+    bt->root = new BtNode();
+    return bt;
+}
+
+static void node_free(BtNode *x){
+    if(!x->leaf){
+        for(size_t i = 0; i <= x->n; ++i){
+            node_free(x->kids[i]);
+        }
+    }
+    delete x;
+}
+
+void bt_free(BTree *bt){
+    node_free(bt->root);
+    delete bt;
+}
+
+size_t bt_size(const BTree *bt){
+    return bt->size;
+}
+
+size_t bt_height(const BTree *bt){
+    size_t h = 1;
+    for(const BtNode *x = bt->root; !x->leaf; x = x->kids[0]){
+        h++;
+    }
+    return h;
+}
+
+/*
+ * Splits an overflowing node in two. Returns the new right half, and in
+ * `sep` the key that separates them in the parent.
+ */
+static BtNode *node_split(BtNode *x, std::string &sep, uint64_t *sep_head){
+    BtNode *right = new BtNode();
+    right->leaf = x->leaf;
+    size_t mid = x->n / 2;
+    if(x->leaf){
+        // leaves keep every key; the separator is a copy of the first one
+        for(size_t j = mid; j < x->n; ++j){
+            right->keys[j - mid] = std::move(x->keys[j]);
+            right->heads[j - mid] = x->heads[j];
+        }
+        right->n = x->n - mid;
+        x->n = mid;
+        right->next = x->next;
+        x->next = right;
+        sep = right->keys[0];
+        *sep_head = right->heads[0];
+        return right;
+    }
+    // inner nodes move the middle key up
+    sep = std::move(x->keys[mid]);
+    *sep_head = x->heads[mid];
+    for(size_t j = mid + 1; j < x->n; ++j){
+        right->keys[j - mid - 1] = std::move(x->keys[j]);
+        right->heads[j - mid - 1] = x->heads[j];
+    }
+    memcpy(&right->kids[0], &x->kids[mid + 1], (x->n - mid) * sizeof(BtNode *));
+    right->n = x->n - mid - 1;
+    x->n = mid;
+    return right;
+}
+
+// inserts under `x`; a split of `x` is returned for the caller to link
+static bool node_insert(BtNode *x, const std::string &key, uint64_t head,
+                        BtNode **split, std::string &sep, uint64_t *sep_head){
+    *split = NULL;
+    if(x->leaf){
+        size_t i = node_search(x, key.data(), key.size(), head, false);
+        if(i < x->n && x->keys[i] == key){
+            return false;
+        }
+        key_insert(x, i, key, head);
+    }
+    else{
+        size_t i = node_search(x, key.data(), key.size(), head, true);
+        BtNode *kid_split = NULL;
+        std::string kid_sep;
+        uint64_t kid_sep_head = 0;
+        if(!node_insert(x->kids[i], key, head, &kid_split, kid_sep, &kid_sep_head)){
+            return false;
+        }
+        if(kid_split){
+            kid_insert(x, x->n + 1, i + 1, kid_split);
+            key_insert(x, i, std::move(kid_sep), kid_sep_head);
+        }
+    }
+    if(x->n > k_bt_fanout){
+        *split = node_split(x, sep, sep_head);
+    }
+    return true;
+}
+
+bool bt_insert(BTree *bt, const std::string &key){
+    BtNode *split = NULL;
+    std::string sep;
+    uint64_t sep_head = 0;
+    if(!node_insert(bt->root, key, key_head(key.data(), key.size()), &split, sep, &sep_head)){
+        return false;
+    }
+    if(split){
+        BtNode *root = new BtNode();
+        root->leaf = false;
+        root->kids[0] = bt->root;
+        root->kids[1] = split;
+        key_insert(root, 0, std::move(sep), sep_head);
+        bt->root = root;
+    }
+    bt->size++;
+    return true;
+}
+
+// the child at `i` of `p` fell below k_bt_min keys
+static void node_rebalance(BtNode *p, size_t i){
+    BtNode *x = p->kids[i];
+    BtNode *left = (i > 0) ? p->kids[i - 1] : NULL;
+    BtNode *right = (i < p->n) ? p->kids[i + 1] : NULL;
+
+    if(left && left->n > k_bt_min){
+        // take the last key of the left sibling
+        if(x->leaf){
+            key_insert(x, 0, std::move(left->keys[left->n - 1]), left->heads[left->n - 1]);
+            key_erase(left, left->n - 1);
+            key_set(p, i - 1, x->keys[0]);
+        }
+        else{
+            kid_insert(x, x->n + 1, 0, left->kids[left->n]);
+            key_insert(x, 0, std::move(p->keys[i - 1]), p->heads[i - 1]);
+            p->keys[i - 1] = std::move(left->keys[left->n - 1]);
+            p->heads[i - 1] = left->heads[left->n - 1];
+            key_erase(left, left->n - 1);
+        }
+        return;
+    }
+    if(right && right->n > k_bt_min){
+        // take the first key of the right sibling
+        if(x->leaf){
+            key_insert(x, x->n, std::move(right->keys[0]), right->heads[0]);
+            key_erase(right, 0);
+            key_set(p, i, right->keys[0]);
+        }
+        else{
+            x->kids[x->n + 1] = right->kids[0];
+            key_insert(x, x->n, std::move(p->keys[i]), p->heads[i]);
+            p->keys[i] = std::move(right->keys[0]);
+            p->heads[i] = right->heads[0];
+            kid_erase(right, right->n + 1, 0);
+            key_erase(right, 0);
+        }
+        return;
+    }
+
+    // neither sibling can spare a key: merge with one, both are small
+    size_t l = left ? i - 1 : i;
+    BtNode *a = p->kids[l];
+    BtNode *b = p->kids[l + 1];
+    if(a->leaf){
+        a->next = b->next;
+    }
+    else{
+        key_insert(a, a->n, std::move(p->keys[l]), p->heads[l]);
+        memcpy(&a->kids[a->n], &b->kids[0], (b->n + 1) * sizeof(BtNode *));
+    }
+    for(size_t j = 0; j < b->n; ++j){
+        a->keys[a->n + j] = std::move(b->keys[j]);
+        a->heads[a->n + j] = b->heads[j];
+    }
+    a->n += b->n;
+    kid_erase(p, p->n + 1, l + 1);
+    key_erase(p, l);
+    delete b;
+}
+
+static bool node_erase(BtNode *x, const std::string &key, uint64_t head){
+    if(x->leaf){
+        size_t i = node_search(x, key.data(), key.size(), head, false);
+        if(i == x->n || x->keys[i] != key){
+            return false;
+        }
+        key_erase(x, i);
+        return true;
+    }
+    size_t i = node_search(x, key.data(), key.size(), head, true);
+    if(!node_erase(x->kids[i], key, head)){
+        return false;
+    }
+    if(x->kids[i]->n < k_bt_min){
+        node_rebalance(x, i);
+    }
+    return true;
+}
+
+bool bt_erase(BTree *bt, const std::string &key){
+    if(!node_erase(bt->root, key, key_head(key.data(), key.size()))){
+        return false;
+    }
+    BtNode *root = bt->root;
+    if(!root->leaf && root->n == 0){
+        bt->root = root->kids[0];
+        delete root;
+    }
+    bt->size--;
+    return true;
+}
+
+BtIter bt_seek(const BTree *bt, const char *key, size_t len){
+    uint64_t head = key_head(key, len);
+    const BtNode *x = bt->root;
+    while(!x->leaf){
+        x = x->kids[node_search(x, key, len, head, true)];
+    }
+    BtIter it;
+    it.leaf = x;
+    it.pos = node_search(x, key, len, head, false);
+    if(it.pos == x->n){
+        // past the last key of this leaf: the next one starts above `key`
+        it.leaf = x->next;
+        it.pos = 0;
+    }
+    return it;
+}
+
+bool bt_valid(const BtIter &it){
+    return it.leaf && it.pos < it.leaf->n;
+}
+
+const std::string &bt_key(const BtIter &it){
+    return it.leaf->keys[it.pos];
+}
+
+void bt_next(BtIter &it){
+    if(++it.pos == it.leaf->n){
+        it.leaf = it.leaf->next;
+        it.pos = 0;
+    }
+}
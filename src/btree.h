@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/*
+ * B+tree of keys, in byte order, for ordered scans of the keyspace.
+ *
+ * Keys are kept in the leaves only, and leaves are linked left to right,
+ * so a scan is one descent to its first key and then a walk along the
+ * leaves: O(log n + k) for k keys. Inner nodes hold separators; the child
+ * left of separator i has the keys below it.
+ *
+ * Every node keeps, next to its keys, an array of their first 8 bytes as
+ * big endian integers. Searching a node is a binary search over that small
+ * contiguous array, and a full key compare only when the 8 bytes are equal,
+ * so a descent touches few cache lines besides the nodes themselves.
+ */
+
+const size_t k_bt_fanout = 32;
+
+struct BtNode;
+struct BTree;
+
+// a position in the tree; invalidated by any insert or erase
+struct BtIter {
+    const BtNode *leaf = NULL;
+    size_t pos = 0;
+};
+
+BTree *bt_new();
+void bt_free(BTree *bt);
+
+// false if the key is already there
+bool bt_insert(BTree *bt, const std::string &key);
+// false if the key is not there
+bool bt_erase(BTree *bt, const std::string &key);
+size_t bt_size(const BTree *bt);
+// levels of the tree, 1 for a lone leaf
+size_t bt_height(const BTree *bt);
+
+// the first key not below `key`
+BtIter bt_seek(const BTree *bt, const char *key, size_t len);
+bool bt_valid(const BtIter &it);
+const std::string &bt_key(const BtIter &it);
+void bt_next(BtIter &it);
@@ -0,0 +1,172 @@
+#include "capture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+static const char k_magic[8] = {'C', 'A', 'P', 'T', '0', '0', '0', '1'};
+const size_t k_rec_header = 8 + 4 + 4;
+// how long the writer sleeps when the ring is empty
+const useconds_t k_writer_idle_us = 1000;
+
+struct Capture {
+    int fd = -1;
+    char *ring = NULL;
+    size_t size = 0;
+    // bytes ever put in the ring, moved by the producer only
+    alignas(64) std::atomic<uint64_t> head{0};
+    uint64_t tail_seen = 0;         // the producer's last look at `tail`
+    uint64_t records = 0;
+    uint64_t dropped = 0;
+    // bytes ever taken out, moved by the writer only
+    alignas(64) std::atomic<uint64_t> tail{0};
+    uint64_t bytes = 0;
+    std::atomic<bool> stop{false};
+    std::thread writer;
+};
+
+static bool write_all(int fd, const char *buf, size_t n){
+    while(n > 0){
+        ssize_t rv = write(fd, buf, n);
+        if(rv < 0 && errno == EINTR){
+            continue;
+        }
+        if(rv <= 0){
+            return false;
+        }
+        buf += rv;
+        n -= (size_t)rv;
+    }
+    return true;
+}
+
+static void writer_main(Capture *c){
+    bool ok = true;
+    while(true){
+        uint64_t tail = c->tail.load(std::memory_order_relaxed);
+        uint64_t head = c->head.load(std::memory_order_acquire);
+        if(head == tail){
+            // stopped, and nothing was put in since
+            if(c->stop.load(std::memory_order_acquire)
+                && c->head.load(std::memory_order_acquire) == tail){
+                return;
+            }
+            usleep(k_writer_idle_us);
+            continue;
+        }
+        // up to the end of the ring, the rest on the next round
+        size_t at = (size_t)(tail & (c->size - 1));
+        size_t n = (size_t)std::min<uint64_t>(head - tail, c->size - at);
+        ok = ok && write_all(c->fd, &c->ring[at], n);
+        if(ok){
+            c->bytes += n;
+        }
+        c->tail.store(tail + n, std::memory_order_release);
+    }
+}
+
+Capture *capture_start(const char *path, size_t ring_bytes){
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW, 0644);
+    if(fd < 0){
+        return NULL;
+    }
+    if(!write_all(fd, k_magic, sizeof(k_magic))){
+        close(fd);
+        return NULL;
+    }
+    Capture *c = new Capture();
+    c->fd = fd;
+    c->size = 4096;
+    while(c->size < ring_bytes){
+        c->size *= 2;
+    }
+    c->ring = new char[c->size];
+    c->bytes = sizeof(k_magic);
+    c->writer = std::thread(writer_main, c);
+    return c;
+}
+
+// copies to the ring from position `pos` on, wrapping around its end
+static void ring_put(Capture *c, uint64_t pos, const void *data, size_t n){
+    size_t at = (size_t)(pos & (c->size - 1));
+    size_t first = std::min(n, c->size - at);
+    memcpy(&c->ring[at], data, first);
+    memcpy(&c->ring[0], (const char *)data + first, n - first);
+}
+
+bool capture_record(Capture *c, uint64_t ts_us, uint32_t conn, const std::vector<std::string> &cmd){
+    size_t body = 4;
+    for(const std::string &arg : cmd){
+        body += 4 + arg.size();
+    }
+    size_t need = k_rec_header + body;
+    uint64_t head = c->head.load(std::memory_order_relaxed);
+    if(head + need - c->tail_seen > c->size){
+        c->tail_seen = c->tail.load(std::memory_order_acquire);
+        if(head + need - c->tail_seen > c->size){
+            c->dropped++;
+            return false;
+        }
+    }
+
+    uint32_t len = (uint32_t)body;
+    uint32_t nargs = (uint32_t)cmd.size();
+    uint64_t pos = head;
+    ring_put(c, pos, &ts_us, 8);
+    ring_put(c, pos + 8, &conn, 4);
+    ring_put(c, pos + 12, &len, 4);
+    ring_put(c, pos + 16, &nargs, 4);
+    pos += k_rec_header + 4;
+    for(const std::string &arg : cmd){
+        uint32_t alen = (uint32_t)arg.size();
+        ring_put(c, pos, &alen, 4);
+        ring_put(c, pos + 4, arg.data(), arg.size());
+        pos += 4 + arg.size();
+    }
+    c->head.store(head + need, std::memory_order_release);
+    c->records++;
+    return true;
+}
+
+CaptureStats capture_stop(Capture *c){
+    c->stop.store(true, std::memory_order_release);
+    c->writer.join();
+    CaptureStats stats;
+    stats.records = c->records;
+    stats.dropped = c->dropped;
+    stats.bytes = c->bytes;
+    close(c->fd);
+    delete[] c->ring;
+    delete c;
+    return stats;
+}
+
+FILE *capture_reader_open(const char *path){
+    FILE *f = fopen(path, "rb");
+    if(!f){
+        return NULL;
+    }
+    char magic[sizeof(k_magic)];
+    if(fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, k_magic, sizeof(magic)) != 0){
+        fclose(f);
+        return NULL;
+    }
+    return f;
+}
+
+bool capture_read(FILE *f, CaptureRec &rec){
+    char header[k_rec_header];
+    if(fread(header, 1, sizeof(header), f) != sizeof(header)){
+        return false;
+    }
+    uint32_t len = 0;
+    memcpy(&rec.ts_us, &header[0], 8);
+    memcpy(&rec.conn, &header[8], 4);
+    memcpy(&len, &header[12], 4);
+    rec.body.resize(len);
+    return len == 0 || fread(&rec.body[0], 1, len, f) == len;
+}
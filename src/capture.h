@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*
+ * Traffic capture: requests, with the time they came in and the connection
+ * they came on, written to a file by a thread of its own.
+ *
+ * The thread running commands copies each request into a ring of bytes,
+ * and the writer thread drains the ring to the file. There is no lock
+ * between them: each moves only its own index, and the other reads it.
+ * A request that finds the ring full is dropped and counted, so capturing
+ * never makes a command wait on the disk. There is one producer, so
+ * callers of capture_record() must not run at the same time.
+ *
+ *   [8B magic "CAPT0001"]
+ *   per request: [8B time, usec][4B connection][4B length][body]
+ *
+ * The body is a request as parse_req() reads it: [4B nargs], then
+ * [4B length][bytes] per argument.
+ */
+
+struct Capture;
+
+struct CaptureStats {
+    uint64_t records = 0;       // written
+    uint64_t dropped = 0;       // the ring was full
+    uint64_t bytes = 0;         // written to the file
+};
+
+// NULL if the file can not be created, or `path` is a symbolic link; the
+// ring is rounded up to a power of 2
+Capture *capture_start(const char *path, size_t ring_bytes);
+// false if dropped
+bool capture_record(Capture *c, uint64_t ts_us, uint32_t conn, const std::vector<std::string> &cmd);
+// writes what is left in the ring, closes the file and frees `c`
+CaptureStats capture_stop(Capture *c);
+
+struct CaptureRec {
+    uint64_t ts_us = 0;
+    uint32_t conn = 0;
+    std::string body;
+};
+
+// opens a capture file for capture_read(); NULL if it is not one
+FILE *capture_reader_open(const char *path);
+// the next request, false at the end of the file or on a cut off record
+bool capture_read(FILE *f, CaptureRec &rec);
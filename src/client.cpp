@@ -1,6 +1,8 @@
 #include "server_client.h"
 #include "parser.h"
 
+#include <ctype.h>
+
 static void die(const char *message){
     int err = errno;
     fprintf(stderr,"[%d] %s\n",err,message);
@@ -24,40 +26,169 @@ int create_client_socket(){
         die("socket()");
     }
 
+    // send each request right away instead of batching small writes
+    int val = 1;
+    (void)setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+
     return sock;
 }
 
-int32_t send_req(int fd, std::vector<std::string> &cmd) {
+/**
+ * Creates a client socket for a server on the same host, to be connected
+ * with connect_unix().
+ *
+ * @return the created socket
+ */
+int create_unix_client_socket(){
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sock < 0){
+        die("socket()");
+    }
+    return sock;
+}
+
+int32_t append_req(std::string &buf, const std::vector<std::string> &cmd) {
     uint32_t len = 4;
 
     for(const std::string &s : cmd){
         len += 4 + s.size();
     }
-    if(len > k_max_msg){
+    if(len > k_max_req){
         return -1;
     }
 
-    char wbuf[4 + k_max_msg];
-    memcpy(wbuf, &len, 4);  // assume little endian
+    size_t cur = buf.size();
+    buf.resize(cur + 4 + len);
+    memcpy(&buf[cur], &len, 4);  // assume little endian
     uint32_t n = cmd.size();
-    memcpy(&wbuf[4], &n, 4);
+    memcpy(&buf[cur+4], &n, 4);
 
-    size_t cur = 8;
+    cur += 8;
     for(const std::string &s : cmd){
         uint32_t p = (uint32_t)s.size();
-        memcpy(&wbuf[cur], &p, 4);
-        memcpy(&wbuf[cur+4], s.data(), s.size());
+        memcpy(&buf[cur], &p, 4);
+        memcpy(&buf[cur+4], s.data(), s.size());
         cur += 4 + s.size();
     }
+    return 0;
+}
+
+int32_t send_req(int fd, std::vector<std::string> &cmd) {
+    std::string wbuf;
+    if(append_req(wbuf, cmd)){
+        return -1;
+    }
+    return write_all(fd, wbuf.data(), wbuf.size());
+}
+
+/*
+ * Prints one serialized value from a response body and returns the number
+ * of bytes it occupies, or -1 if the body is malformed. Arrays recurse into
+ * their elements.
+ */
+static int32_t on_response(const uint8_t *data, size_t size){
+    if(size < 1){
+        msg("bad response");
+        return -1;
+    }
 
-    return write_all(fd, wbuf, 4 + len);
+    switch(data[0]){
+    case SER_NIL:
+        printf("(nil)\n");
+        return 1;
+    case SER_ERR:
+        if(size < 1 + 8){
+            msg("bad response");
+            return -1;
+        }
+        {
+            int32_t code = 0;
+            uint32_t len = 0;
+            memcpy(&code, &data[1], 4);
+            memcpy(&len, &data[1 + 4], 4);
+            if(size < 1 + 8 + len){
+                msg("bad response");
+                return -1;
+            }
+            printf("(err) %d %.*s\n", code, len, &data[1 + 8]);
+            return 1 + 8 + len;
+        }
+    case SER_STR:
+    case SER_STATUS:
+        if(size < 1 + 4){
+            msg("bad response");
+            return -1;
+        }
+        {
+            uint32_t len = 0;
+            memcpy(&len, &data[1], 4);
+            if(size < 1 + 4 + len){
+                msg("bad response");
+                return -1;
+            }
+            if(data[0] == SER_STATUS){
+                printf("%.*s\n", len, &data[1 + 4]);
+            }
+            else{
+                printf("(str) %.*s\n", len, &data[1 + 4]);
+            }
+            return 1 + 4 + len;
+        }
+    case SER_INT:
+        if(size < 1 + 8){
+            msg("bad response");
+            return -1;
+        }
+        {
+            int64_t val = 0;
+            memcpy(&val, &data[1], 8);
+            printf("(int) %ld\n", (long)val);
+            return 1 + 8;
+        }
+    case SER_DBL:
+        if(size < 1 + 8){
+            msg("bad response");
+            return -1;
+        }
+        {
+            double val = 0;
+            memcpy(&val, &data[1], 8);
+            printf("(dbl) %g\n", val);
+            return 1 + 8;
+        }
+    case SER_ARR:
+    case SER_PUSH:
+        if(size < 1 + 4){
+            msg("bad response");
+            return -1;
+        }
+        {
+            const char *tag = data[0] == SER_PUSH ? "push" : "arr";
+            uint32_t len = 0;
+            memcpy(&len, &data[1], 4);
+            printf("(%s) len=%u\n", tag, len);
+            size_t arr_bytes = 1 + 4;
+            for(uint32_t i = 0; i < len; ++i){
+                int32_t rv = on_response(&data[arr_bytes], size - arr_bytes);
+                if(rv < 0){
+                    return rv;
+                }
+                arr_bytes += (size_t)rv;
+            }
+            printf("(%s) end\n", tag);
+            return (int32_t)arr_bytes;
+        }
+    default:
+        msg("bad response");
+        return -1;
+    }
 }
 
 int32_t read_res(int fd) {
     // 4 bytes header
-    char rbuf[4 + k_max_msg + 1];
+    char hdr[4];
     errno = 0;
-    int32_t err = read_full(fd, rbuf, 4);
+    int32_t err = read_full(fd, hdr, 4);
     if (err) {
         if (errno == 0) {
             msg("EOF");
@@ -68,11 +199,13 @@ int32_t read_res(int fd) {
     }
 
     uint32_t len = 0;
-    memcpy(&len, rbuf, 4);  // assume little endian
-    if (len > k_max_msg) {
+    memcpy(&len, hdr, 4);  // assume little endian
+    // a GET reply can be as big as a request
+    if (len > 5 + k_max_req) {
         msg("too long");
         return -1;
     }
+    std::vector<char> rbuf(4 + len + 1);
 
     // reply body
     err = read_full(fd, &rbuf[4], len);
@@ -81,16 +214,14 @@ int32_t read_res(int fd) {
         return -1;
     }
 
-    uint32_t rescode = 0;
-    if(len < 4){
+    // print the result
+    int32_t rv = on_response((uint8_t *)&rbuf[4], len);
+    if(rv > 0 && (uint32_t)rv != len){
         msg("bad response");
-        return -1;
+        rv = -1;
     }
 
-    memcpy(&rescode, &rbuf[4], 4);
-    printf("server says: [%u] %.*s\n", rescode, len - 4, &rbuf[8]);
-
-    return 0;
+    return rv < 0 ? -1 : 0;
 }
 
 /**
@@ -100,9 +231,7 @@ int32_t read_res(int fd) {
  * @param ip the IP address to connect to
  * @param port the port number to connect to
  *
- * @return void
- *
- * @throws ErrorType if the connection attempt fails
+ * @return 0 on success, -1 if the connection attempt fails
  */
 int connect(int socket, uint32_t ip, uint16_t port){
     struct sockaddr_in addr = {};
@@ -111,6 +240,219 @@ int connect(int socket, uint32_t ip, uint16_t port){
     addr.sin_addr.s_addr = htonl(ip);
     if(connect(socket, (struct sockaddr*)&addr, sizeof(addr)) < 0){
         die("connect()");
+        return -1;
     }
+    return 0;
+}
 
+/**
+ * Connects a socket from create_unix_client_socket() to the Unix domain
+ * socket of a server at `path`.
+ *
+ * @return 0 on success, -1 on error
+ */
+int connect_unix(int socket, const char *path){
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)){
+        msg("unix socket path too long");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    if(connect(socket, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+        die("connect()");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Pipe mode: bulk loading from a stream of commands.
+ *
+ * Commands are read one per line, framed into a buffer, and written in
+ * chunks of about k_pipe_chunk bytes while replies are read as they come,
+ * so the connection is never waiting on a round trip. The server is put in
+ * bulk mode (CLIENT BULK) for the load: it only replies to commands that
+ * fail, and CLIENT BULK OFF at the end answers with the number of commands
+ * run and failed, which also tells that every command before it was run.
+ */
+const size_t k_pipe_chunk = 1 << 20;
+// failed commands printed, past that they are only counted
+const uint64_t k_pipe_errors_shown = 10;
+
+/*
+ * Splits a line into arguments at spaces and tabs. An argument can be in
+ * double quotes, inside which \" \\ \n \r \t and \xHH are escapes. Returns
+ * false for an unterminated quote.
+ */
+static bool split_args(const char *p, size_t len, std::vector<std::string> &args){
+    const char *end = p + len;
+    args.clear();
+    while(true){
+        while(p < end && (*p == ' ' || *p == '\t')){
+            p++;
+        }
+        if(p == end){
+            return true;
+        }
+        std::string arg;
+        if(*p != '"'){
+            while(p < end && *p != ' ' && *p != '\t'){
+                arg.push_back(*p++);
+            }
+            args.push_back(std::move(arg));
+            continue;
+        }
+        for(p++; ; p++){
+            if(p == end){
+                return false;
+            }
+            if(*p == '"'){
+                p++;
+                break;
+            }
+            if(*p != '\\' || p + 1 == end){
+                arg.push_back(*p);
+                continue;
+            }
+            char c = *++p;
+            if(c == 'n'){
+                arg.push_back('\n');
+            }
+            else if(c == 'r'){
+                arg.push_back('\r');
+            }
+            else if(c == 't'){
+                arg.push_back('\t');
+            }
+            else if(c == 'x' && end - p > 2 && isxdigit((unsigned char)p[1]) && isxdigit((unsigned char)p[2])){
+                char hex[3] = {p[1], p[2], 0};
+                arg.push_back((char)strtol(hex, NULL, 16));
+                p += 2;
+            }
+            else{
+                arg.push_back(c);
+            }
+        }
+        args.push_back(std::move(arg));
+    }
+}
+
+// counts the complete replies in `rbuf` and drops them; false on a bad one
+static bool pipe_replies(std::string &rbuf, PipeStats &stats, bool *done){
+    size_t at = 0;
+    while(rbuf.size() - at >= 4){
+        uint32_t len = 0;
+        memcpy(&len, &rbuf[at], 4);
+        if(rbuf.size() - at - 4 < len){
+            break;
+        }
+        const char *body = &rbuf[at + 4];
+        if(len >= 1 + 8 && body[0] == SER_ERR){
+            if(stats.errors++ < k_pipe_errors_shown){
+                uint32_t mlen = 0;
+                memcpy(&mlen, body + 5, 4);
+                fprintf(stderr, "(err) %.*s\n", (int)std::min(mlen, len - 9), body + 9);
+            }
+        }
+        else if(len >= 1 + 4 && body[0] == SER_ARR){
+            // CLIENT BULK OFF: [commands run, commands failed]
+            uint64_t run = 0;
+            if(len != 1 + 4 + 2 * 9){
+                return false;
+            }
+            memcpy(&run, body + 6, 8);
+            *done = true;
+            if(run != stats.sent){
+                fprintf(stderr, "sent %llu commands, the server ran %llu\n",
+                    (unsigned long long)stats.sent, (unsigned long long)run);
+                return false;
+            }
+        }
+        at += 4 + len;
+    }
+    rbuf.erase(0, at);
+    return true;
+}
+
+int32_t pipe_mode(int fd, FILE *in, PipeStats &stats){
+    int flags = fcntl(fd, F_GETFL, 0);
+    (void)fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    std::string wbuf;
+    size_t wsent = 0;
+    std::string rbuf;
+    std::vector<std::string> args;
+    (void)append_req(wbuf, {"client", "bulk", "on"});
+
+    char *line = NULL;
+    size_t cap = 0;
+    uint64_t lineno = 0;
+    bool eof = false;
+    bool done = false;
+    int32_t err = 0;
+    while(!done){
+        // frame commands while less than a chunk is waiting to be written
+        while(!eof && wbuf.size() - wsent < k_pipe_chunk){
+            ssize_t n = getline(&line, &cap, in);
+            if(n < 0){
+                eof = true;
+                (void)append_req(wbuf, {"client", "bulk", "off"});
+                break;
+            }
+            lineno++;
+            while(n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')){
+                n--;
+            }
+            if(!split_args(line, (size_t)n, args) || (!args.empty() && append_req(wbuf, args))){
+                fprintf(stderr, "line %llu: bad command\n", (unsigned long long)lineno);
+                stats.bad_lines++;
+            }
+            else if(!args.empty()){
+                stats.sent++;
+            }
+        }
+        if(wsent > k_pipe_chunk){
+            wbuf.erase(0, wsent);
+            wsent = 0;
+        }
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if(wsent < wbuf.size()){
+            pfd.events |= POLLOUT;
+        }
+        if(poll(&pfd, 1, -1) < 0 && errno != EINTR){
+            err = -1;
+            break;
+        }
+        if(pfd.revents & POLLOUT){
+            ssize_t rv = write(fd, &wbuf[wsent], wbuf.size() - wsent);
+            if(rv < 0 && errno != EAGAIN && errno != EINTR){
+                msg("write() error");
+                err = -1;
+                break;
+            }
+            wsent += rv > 0 ? (size_t)rv : 0;
+        }
+        if(pfd.revents & (POLLIN | POLLERR | POLLHUP)){
+            char buf[64 * 1024];
+            ssize_t rv = read(fd, buf, sizeof(buf));
+            if(rv == 0 || (rv < 0 && errno != EAGAIN && errno != EINTR)){
+                msg(rv == 0 ? "EOF" : "read() error");
+                err = -1;
+                break;
+            }
+            if(rv > 0){
+                rbuf.append(buf, (size_t)rv);
+                if(!pipe_replies(rbuf, stats, &done)){
+                    msg("bad response");
+                    err = -1;
+                    break;
+                }
+            }
+        }
+    }
+    free(line);
+    (void)fcntl(fd, F_SETFL, flags);
+    return err;
 }
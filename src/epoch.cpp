@@ -0,0 +1,87 @@
+#include "epoch.h"
+
+#include <atomic>
+#include <deque>
+
+// reclaim from epoch_retire() once this many objects wait
+const size_t k_reclaim_batch = 64;
+
+// the epoch a reader is in, 0 while it is outside; one cache line each
+struct alignas(64) ReaderSlot {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> used{false};
+};
+
+struct Retired {
+    uint64_t epoch;
+    void (*free_fn)(void *);
+    void *p;
+};
+
+static ReaderSlot g_slots[k_epoch_max_readers];
+static std::atomic<uint64_t> g_epoch{1};
+static thread_local ReaderSlot *t_slot = NULL;
+
+// written by the writer only, oldest first
+static std::deque<Retired> g_retired;
+
+bool epoch_register(){
+    for(ReaderSlot &slot : g_slots){
+        bool expect = false;
+        if(slot.used.compare_exchange_strong(expect, true)){
+            t_slot = &slot;
+            return true;
+        }
+    }
+    return false;
+}
+
+void epoch_unregister(){
+    if(t_slot){
+        t_slot->epoch.store(0, std::memory_order_release);
+        t_slot->used.store(false, std::memory_order_release);
+        t_slot = NULL;
+    }
+}
+
+void epoch_enter(){
+    t_slot->epoch.store(g_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    // pairs with the fence in epoch_reclaim(): either the writer sees this
+    // reader, or the reader sees everything unlinked before the writer looked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void epoch_exit(){
+    t_slot->epoch.store(0, std::memory_order_release);
+}
+
+void epoch_retire(void (*free_fn)(void *), void *p){
+    uint64_t e = g_epoch.load(std::memory_order_relaxed);
+    g_retired.push_back({e, free_fn, p});
+    // readers that see the new epoch also see the unlink that came before
+    g_epoch.store(e + 1, std::memory_order_release);
+    if(g_retired.size() >= k_reclaim_batch){
+        epoch_reclaim();
+    }
+}
+
+void epoch_reclaim(){
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = UINT64_MAX;
+    for(ReaderSlot &slot : g_slots){
+        uint64_t e = slot.epoch.load(std::memory_order_acquire);
+        if(e && e < oldest){
+            oldest = e;
+        }
+    }
+    // objects retired in an epoch before every reader's are unreachable
+    while(!g_retired.empty() && g_retired.front().epoch < oldest){
+        Retired r = g_retired.front();
+        g_retired.pop_front();
+        r.free_fn(r.p);
+    }
+}
+
+size_t epoch_pending(){
+    return g_retired.size();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Epoch based reclamation, for data that threads read without locks while
+ * one writer at a time changes it.
+ *
+ * A reader brackets every access with epoch_enter() and epoch_exit(), which
+ * publish the global epoch it started in. A writer that unlinks an object
+ * hands it to epoch_retire() instead of freeing it, which stamps it with
+ * the current epoch and moves the epoch on. epoch_reclaim() then frees
+ * every retired object that was unlinked before the oldest epoch a reader
+ * is still in, since no reader can reach those any more.
+ *
+ * Entering and leaving cost one store and one fence each, with no shared
+ * cache line written by more than one thread. Reader threads take one of
+ * k_epoch_max_readers slots with epoch_register(). Writers must be
+ * serialized by the caller.
+ */
+
+const size_t k_epoch_max_readers = 64;
+
+// takes a slot for the calling thread; returns false if none is left
+bool epoch_register();
+void epoch_unregister();
+
+void epoch_enter();
+void epoch_exit();
+
+// `free_fn(p)` runs once no reader can still see `p`
+void epoch_retire(void (*free_fn)(void *), void *p);
+void epoch_reclaim();
+// retired objects not freed yet
+size_t epoch_pending();
@@ -0,0 +1,60 @@
+#include "histogram.h"
+
+size_t hist_bucket(uint64_t v){
+    if(v < k_hist_sub){
+        return (size_t)v;
+    }
+    int shift = 63 - __builtin_clzll(v) - k_hist_sub_bits;
+    return ((size_t)(shift + 1) << k_hist_sub_bits) + (size_t)((v >> shift) & (k_hist_sub - 1));
+}
+
+uint64_t hist_bucket_low(size_t i){
+    if(i < k_hist_sub){
+        return i;
+    }
+    int shift = (int)(i >> k_hist_sub_bits) - 1;
+    return (uint64_t)(k_hist_sub + (i & (k_hist_sub - 1))) << shift;
+}
+
+void hist_add(Histogram *h, uint64_t v){
+    h->buckets[hist_bucket(v)]++;
+    h->count++;
+    h->sum += v;
+    if(v > h->max){
+        h->max = v;
+    }
+}
+
+void hist_merge(Histogram *dst, const Histogram *src){
+    for(size_t i = 0; i < k_hist_buckets; ++i){
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if(src->max > dst->max){
+        dst->max = src->max;
+    }
+}
+
+void hist_reset(Histogram *h){
+    *h = Histogram();
+}
+
+uint64_t hist_percentile(const Histogram *h, double p){
+    if(!h->count){
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(p / 100 * (double)h->count + 0.5);
+    if(rank < 1){
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for(size_t i = 0; i < k_hist_buckets; ++i){
+        seen += h->buckets[i];
+        if(seen >= rank){
+            uint64_t high = (i + 1 < k_hist_buckets) ? hist_bucket_low(i + 1) - 1 : UINT64_MAX;
+            return high < h->max ? high : h->max;
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Histogram of non-negative integers, such as latencies, with log-linear
+ * buckets: values are grouped by their highest set bit, and each group is
+ * cut into 2^k_hist_sub_bits equal sub-buckets. A value is known to within
+ * 1/32 of itself, adding one is a few instructions, and the whole range of
+ * uint64_t fits in a fixed array.
+ */
+
+const int k_hist_sub_bits = 5;
+const size_t k_hist_sub = (size_t)1 << k_hist_sub_bits;
+const size_t k_hist_buckets = (64 - k_hist_sub_bits + 1) * k_hist_sub;
+
+struct Histogram {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    uint64_t buckets[k_hist_buckets] = {};
+};
+
+void hist_add(Histogram *h, uint64_t v);
+void hist_merge(Histogram *dst, const Histogram *src);
+void hist_reset(Histogram *h);
+
+// the bucket of a value, and the smallest value in a bucket
+size_t hist_bucket(uint64_t v);
+uint64_t hist_bucket_low(size_t i);
+
+// the highest value of the bucket holding the p-th percentile, 0 < p <= 100;
+// 0 for an empty histogram
+uint64_t hist_percentile(const Histogram *h, double p);
@@ -0,0 +1,285 @@
+#include "hll.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// bits of the hash left after the index, and the largest register value
+const uint32_t k_hll_q = 64 - k_hll_p;
+const size_t k_hll_dense_bytes = k_hll_registers * 6 / 8;
+
+struct HLL {
+    uint32_t enc = HLL_SPARSE;
+    std::vector<uint32_t> sparse;   // index << 8 | value, sorted by index
+    std::vector<uint8_t> dense;     // 6-bit registers, plus one pad byte
+    bool cache_valid = true;
+    uint64_t cache = 0;
+};
+
+static uint64_t mix64(uint64_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint8_t dense_get(const uint8_t *regs, size_t i){
+    size_t bit = i * 6;
+    const uint8_t *p = &regs[bit / 8];
+    uint32_t v = p[0] | ((uint32_t)p[1] << 8);
+    return (v >> (bit % 8)) & 63;
+}
+
+static void dense_set(uint8_t *regs, size_t i, uint8_t val){
+    size_t bit = i * 6;
+    uint8_t *p = &regs[bit / 8];
+    uint32_t shift = bit % 8;
+    uint32_t v = p[0] | ((uint32_t)p[1] << 8);
+    v = (v & ~((uint32_t)63 << shift)) | ((uint32_t)val << shift);
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+HLL *hll_new(){
+    return new HLL();
+}
+
+void hll_free(HLL *hll){
+    delete hll;
+}
+
+uint32_t hll_encoding(const HLL *hll){
+    return hll->enc;
+}
+
+size_t hll_bytes(const HLL *hll){
+    return hll->enc == HLL_DENSE ? hll->dense.size() : hll->sparse.size() * 4;
+}
+
+// expands every register into one byte each
+static void hll_unpack(const HLL *hll, uint8_t *regs){
+    if(hll->enc == HLL_DENSE){
+        // 3 bytes hold 4 registers
+        const uint8_t *p = hll->dense.data();
+        for(size_t i = 0; i < k_hll_registers; i += 4, p += 3){
+            uint32_t v = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+            regs[i] = v & 63;
+            regs[i + 1] = (v >> 6) & 63;
+            regs[i + 2] = (v >> 12) & 63;
+            regs[i + 3] = (v >> 18) & 63;
+        }
+        return;
+    }
+    memset(regs, 0, k_hll_registers);
+    for(uint32_t pair : hll->sparse){
+        regs[pair >> 8] = pair & 0xff;
+    }
+}
+
+static void hll_pack(HLL *hll, const uint8_t *regs){
+    hll->enc = HLL_DENSE;
+    std::vector<uint32_t>().swap(hll->sparse);
+    hll->dense.assign(k_hll_dense_bytes + 1, 0);
+    uint8_t *p = hll->dense.data();
+    for(size_t i = 0; i < k_hll_registers; i += 4, p += 3){
+        uint32_t v = regs[i] | ((uint32_t)regs[i + 1] << 6)
+            | ((uint32_t)regs[i + 2] << 12) | ((uint32_t)regs[i + 3] << 18);
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+        p[2] = (uint8_t)(v >> 16);
+    }
+}
+
+// dst[i] = max(dst[i], src[i]) over all registers
+static void regs_max(uint8_t *dst, const uint8_t *src){
+    size_t i = 0;
+#if defined(__SSE2__)
+    for(; i + 16 <= k_hll_registers; i += 16){
+        __m128i a = _mm_loadu_si128((const __m128i *)&dst[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&src[i]);
+        _mm_storeu_si128((__m128i *)&dst[i], _mm_max_epu8(a, b));
+    }
+#endif
+    for(; i < k_hll_registers; ++i){
+        dst[i] = std::max(dst[i], src[i]);
+    }
+}
+
+bool hll_add(HLL *hll, const char *item, size_t len){
+    uint64_t hash = mix64(std::hash<std::string_view>()(std::string_view(item, len)));
+    uint32_t idx = (uint32_t)(hash & (k_hll_registers - 1));
+    // a sentinel bit caps the run at k_hll_q zeros
+    uint64_t rest = (hash >> k_hll_p) | ((uint64_t)1 << k_hll_q);
+    uint8_t val = (uint8_t)(__builtin_ctzll(rest) + 1);
+
+    if(hll->enc == HLL_DENSE){
+        if(dense_get(hll->dense.data(), idx) >= val){
+            return false;
+        }
+        dense_set(hll->dense.data(), idx, val);
+        hll->cache_valid = false;
+        return true;
+    }
+
+    std::vector<uint32_t> &sp = hll->sparse;
+    auto it = std::lower_bound(sp.begin(), sp.end(), idx << 8);
+    if(it != sp.end() && (*it >> 8) == idx){
+        if((*it & 0xff) >= val){
+            return false;
+        }
+        *it = (idx << 8) | val;
+    }
+    else{
+        sp.insert(it, (idx << 8) | val);
+    }
+    hll->cache_valid = false;
+
+    if(sp.size() > k_hll_sparse_max){
+        uint8_t regs[k_hll_registers];
+        hll_unpack(hll, regs);
+        hll_pack(hll, regs);
+    }
+    return true;
+}
+
+static double hll_sigma(double x){
+    if(x == 1.0){
+        return INFINITY;
+    }
+    double y = 1, z = x, prev;
+    do{
+        x *= x;
+        prev = z;
+        z += x * y;
+        y += y;
+    }while(z != prev);
+    return z;
+}
+
+static double hll_tau(double x){
+    if(x == 0.0 || x == 1.0){
+        return 0;
+    }
+    double y = 1, z = 1 - x, prev;
+    do{
+        x = sqrt(x);
+        prev = z;
+        y *= 0.5;
+        z -= (1 - x) * (1 - x) * y;
+    }while(z != prev);
+    return z / 3;
+}
+
+// Ertl, "New cardinality estimation algorithms for HyperLogLog sketches"
+static uint64_t hll_estimate(const uint8_t *regs){
+    uint32_t hist[k_hll_q + 2] = {};
+    for(size_t i = 0; i < k_hll_registers; ++i){
+        hist[regs[i]]++;
+    }
+    double m = (double)k_hll_registers;
+    double z = m * hll_tau((m - hist[k_hll_q + 1]) / m);
+    for(uint32_t k = k_hll_q; k >= 1; --k){
+        z += hist[k];
+        z *= 0.5;
+    }
+    z += m * hll_sigma(hist[0] / m);
+    return (uint64_t)llround(0.5 / log(2.0) * m * m / z);
+}
+
+uint64_t hll_count(HLL *hll){
+    if(!hll->cache_valid){
+        uint8_t regs[k_hll_registers];
+        hll_unpack(hll, regs);
+        hll->cache = hll_estimate(regs);
+        hll->cache_valid = true;
+    }
+    return hll->cache;
+}
+
+uint64_t hll_count_union(const HLL *const *hlls, size_t n){
+    uint8_t regs[k_hll_registers] = {};
+    uint8_t tmp[k_hll_registers];
+    for(size_t i = 0; i < n; ++i){
+        hll_unpack(hlls[i], tmp);
+        regs_max(regs, tmp);
+    }
+    return hll_estimate(regs);
+}
+
+void hll_merge(HLL *dst, const HLL *src){
+    uint8_t regs[k_hll_registers];
+    uint8_t tmp[k_hll_registers];
+    hll_unpack(dst, regs);
+    hll_unpack(src, tmp);
+    regs_max(regs, tmp);
+    hll_pack(dst, regs);
+    dst->cache_valid = false;
+}
+
+// dump: 1B encoding, then the sparse pairs or the dense registers
+void hll_dump(const HLL *hll, std::string &out){
+    out.push_back((char)hll->enc);
+    if(hll->enc == HLL_DENSE){
+        out.append((const char *)hll->dense.data(), hll->dense.size());
+    }
+    else{
+        out.append((const char *)hll->sparse.data(), hll->sparse.size() * 4);
+    }
+}
+
+// whether every register is at most k_hll_q + 1, and the sparse pairs
+// are in range and sorted by index, as a dump from elsewhere may not be
+static bool hll_valid(const HLL *hll){
+    if(hll->enc == HLL_DENSE){
+        uint8_t regs[k_hll_registers];
+        hll_unpack(hll, regs);
+        for(size_t i = 0; i < k_hll_registers; ++i){
+            if(regs[i] > k_hll_q + 1){
+                return false;
+            }
+        }
+        return true;
+    }
+    for(size_t i = 0; i < hll->sparse.size(); ++i){
+        uint32_t pair = hll->sparse[i];
+        if((pair >> 8) >= k_hll_registers || (pair & 0xff) > k_hll_q + 1
+            || (i > 0 && (hll->sparse[i - 1] >> 8) >= (pair >> 8))){
+            return false;
+        }
+    }
+    return true;
+}
+
+HLL *hll_restore(const char *data, size_t len){
+    if(len < 1){
+        return NULL;
+    }
+    HLL *hll = new HLL();
+    hll->enc = (uint8_t)data[0];
+    hll->cache_valid = false;
+    data++;
+    len--;
+    bool ok = false;
+    if(hll->enc == HLL_DENSE && len == k_hll_dense_bytes + 1){
+        hll->dense.assign((const uint8_t *)data, (const uint8_t *)data + len);
+        ok = hll_valid(hll);
+    }
+    else if(hll->enc == HLL_SPARSE && len % 4 == 0 && len / 4 <= k_hll_sparse_max){
+        hll->sparse.resize(len / 4);
+        memcpy(hll->sparse.data(), data, len);
+        ok = hll_valid(hll);
+    }
+    if(!ok){
+        delete hll;
+        return NULL;
+    }
+    return hll;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/*
+ * HyperLogLog: an estimate of the number of distinct items added, in at
+ * most 12 KB, with a standard error of about 0.8%.
+ *
+ * An item's 64-bit hash picks one of k_hll_registers registers with its
+ * low k_hll_p bits, and the register keeps the longest run of trailing
+ * zeros (plus one) seen in the remaining bits. Two encodings are used:
+ *
+ * - HLL_SPARSE: only the non-zero registers, as a sorted array of
+ *   (index, value) pairs. Small cardinalities cost a few bytes per item.
+ *
+ * - HLL_DENSE: all registers packed at 6 bits each, 12 KB. A set switches
+ *   to it once the sparse array would pass k_hll_sparse_max pairs.
+ *
+ * The count is computed with Ertl's improved estimator from a histogram of
+ * the register values, which needs no bias tables, and it is cached until
+ * a register changes. Merging takes the per-register max, 16 registers at
+ * a time with SSE2.
+ */
+
+enum {
+    HLL_SPARSE = 0,
+    HLL_DENSE = 1,
+};
+
+const uint32_t k_hll_p = 14;
+const size_t k_hll_registers = (size_t)1 << k_hll_p;
+const size_t k_hll_sparse_max = 750;
+
+struct HLL;
+
+HLL *hll_new();
+void hll_free(HLL *hll);
+
+uint32_t hll_encoding(const HLL *hll);
+size_t hll_bytes(const HLL *hll);
+
+// returns true if a register changed, i.e. the estimate may have moved
+bool hll_add(HLL *hll, const char *item, size_t len);
+uint64_t hll_count(HLL *hll);
+// the count of the union of several sets, none of which is changed
+uint64_t hll_count_union(const HLL *const *hlls, size_t n);
+// makes `dst` the union of itself and `src`; `dst` ends up dense
+void hll_merge(HLL *dst, const HLL *src);
+
+// appends the registers to `out`, in their current encoding
+void hll_dump(const HLL *hll, std::string &out);
+// the set of an hll_dump(); NULL if `len` bytes are not one, or hold a
+// register out of range or sparse pairs out of order
+HLL *hll_restore(const char *data, size_t len);
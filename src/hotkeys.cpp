@@ -0,0 +1,164 @@
+#include "hotkeys.h"
+
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
+struct HKEntry {
+    uint64_t hash = 0;
+    uint32_t count = 0;
+    std::string key;
+};
+
+// counters per 64 byte line of the sketch
+const size_t k_hk_line_ctrs = 16;
+
+struct HotKeys {
+    alignas(64) uint32_t sketch[k_hk_lines][k_hk_line_ctrs];
+    uint64_t accesses = 0;          // since the last decay
+    std::vector<HKEntry> heap;      // min-heap on count
+};
+
+static uint64_t hk_hash(const char *key, size_t len){
+    return std::hash<std::string_view>()(std::string_view(key, len));
+}
+
+/*
+ * The counters of a key: the low bits of the hash pick a line, and 4 bits
+ * of the high half per row pick a counter in it.
+ */
+static void hk_counters(HotKeys *hk, uint64_t hash, uint32_t **ctr){
+    uint32_t *line = hk->sketch[hash & (k_hk_lines - 1)];
+    for(size_t row = 0; row < k_hk_depth; ++row){
+        ctr[row] = &line[(hash >> (32 + 4 * row)) & (k_hk_line_ctrs - 1)];
+    }
+}
+
+HotKeys *hk_new(){
+    HotKeys *hk = new HotKeys();
+    hk_reset(hk);
+    return hk;
+}
+
+void hk_free(HotKeys *hk){
+    delete hk;
+}
+
+void hk_reset(HotKeys *hk){
+    memset(hk->sketch, 0, sizeof(hk->sketch));
+    hk->accesses = 0;
+    hk->heap.clear();
+}
+
+static void heap_sift_down(std::vector<HKEntry> &heap, size_t pos){
+    size_t n = heap.size();
+    while(true){
+        size_t l = 2 * pos + 1, r = l + 1, min = pos;
+        if(l < n && heap[l].count < heap[min].count){
+            min = l;
+        }
+        if(r < n && heap[r].count < heap[min].count){
+            min = r;
+        }
+        if(min == pos){
+            return;
+        }
+        std::swap(heap[pos], heap[min]);
+        pos = min;
+    }
+}
+
+static void heap_sift_up(std::vector<HKEntry> &heap, size_t pos){
+    while(pos > 0){
+        size_t parent = (pos - 1) / 2;
+        if(heap[parent].count <= heap[pos].count){
+            return;
+        }
+        std::swap(heap[pos], heap[parent]);
+        pos = parent;
+    }
+}
+
+// halves every count; the heap order is unchanged by it
+static void hk_decay(HotKeys *hk){
+    for(size_t line = 0; line < k_hk_lines; ++line){
+        for(size_t i = 0; i < k_hk_line_ctrs; ++i){
+            hk->sketch[line][i] >>= 1;
+        }
+    }
+    for(HKEntry &ent : hk->heap){
+        ent.count >>= 1;
+    }
+    hk->accesses = 0;
+}
+
+void hk_touch(HotKeys *hk, const char *key, size_t len){
+    if(++hk->accesses >= k_hk_decay_period){
+        hk_decay(hk);
+    }
+
+    uint64_t hash = hk_hash(key, len);
+    uint32_t *ctr[k_hk_depth];
+    hk_counters(hk, hash, ctr);
+    uint32_t est = UINT32_MAX;
+    for(size_t row = 0; row < k_hk_depth; ++row){
+        est = std::min(est, *ctr[row]);
+    }
+    // conservative update: only the counters at the minimum move; without
+    // a branch, as which ones do is unpredictable
+    for(size_t row = 0; row < k_hk_depth; ++row){
+        *ctr[row] += (*ctr[row] == est);
+    }
+    ++est;
+
+    std::vector<HKEntry> &heap = hk->heap;
+    if(heap.size() == k_hk_topk && est <= heap[0].count){
+        return;
+    }
+    for(size_t i = 0; i < heap.size(); ++i){
+        if(heap[i].hash == hash && heap[i].key.size() == len
+            && 0 == memcmp(heap[i].key.data(), key, len)){
+            heap[i].count = est;
+            heap_sift_down(heap, i);
+            return;
+        }
+    }
+    if(heap.size() < k_hk_topk){
+        heap.push_back(HKEntry());
+        heap.back().hash = hash;
+        heap.back().count = est;
+        heap.back().key.assign(key, len);
+        heap_sift_up(heap, heap.size() - 1);
+        return;
+    }
+    // replaces the coldest of the top keys
+    heap[0].hash = hash;
+    heap[0].count = est;
+    heap[0].key.assign(key, len);
+    heap_sift_down(heap, 0);
+}
+
+uint32_t hk_estimate(const HotKeys *hk, const char *key, size_t len){
+    uint32_t *ctr[k_hk_depth];
+    hk_counters((HotKeys *)hk, hk_hash(key, len), ctr);
+    uint32_t est = UINT32_MAX;
+    for(size_t row = 0; row < k_hk_depth; ++row){
+        est = std::min(est, *ctr[row]);
+    }
+    return est;
+}
+
+void hk_top(const HotKeys *hk, std::vector<HotKey> &out){
+    out.clear();
+    for(const HKEntry &ent : hk->heap){
+        if(ent.count){
+            out.push_back(HotKey());
+            out.back().key = ent.key;
+            out.back().count = ent.count;
+        }
+    }
+    std::sort(out.begin(), out.end(), [](const HotKey &a, const HotKey &b){
+        return a.count > b.count;
+    });
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/*
+ * Hot key tracking: approximate access counts for every key, in fixed
+ * memory, plus the K keys with the highest counts.
+ *
+ * Counts live in a count-min sketch: a key picks k_hk_depth counters and
+ * its estimate is the smallest of them, which can only overestimate. On an
+ * access only the counters holding that minimum are bumped (conservative
+ * update). The sketch is blocked: all counters of a key sit in the same
+ * 64 byte line, picked by the key hash, so an access touches one cache
+ * line instead of one per row. Every k_hk_decay_period accesses all
+ * counters are halved, so a count is an exponentially decayed access rate
+ * and keys that cool down drop out.
+ *
+ * The top keys are a min-heap of k_hk_topk entries ordered by estimate. A
+ * key whose estimate is not above the heap minimum returns right after the
+ * sketch update, which is the common case and costs one hash plus
+ * k_hk_depth counter updates.
+ */
+
+const size_t k_hk_depth = 4;
+const size_t k_hk_lines = 1024;        // a power of 2, 16 counters each
+const size_t k_hk_topk = 32;
+const uint64_t k_hk_decay_period = (uint64_t)1 << 20;
+
+struct HotKeys;
+
+struct HotKey {
+    std::string key;
+    uint32_t count = 0;
+};
+
+HotKeys *hk_new();
+void hk_free(HotKeys *hk);
+
+// records one access to a key
+void hk_touch(HotKeys *hk, const char *key, size_t len);
+// the current estimate for a key
+uint32_t hk_estimate(const HotKeys *hk, const char *key, size_t len);
+// the top keys, hottest first
+void hk_top(const HotKeys *hk, std::vector<HotKey> &out);
+void hk_reset(HotKeys *hk);
@@ -0,0 +1,297 @@
+#include "loopprof.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+const char *const k_lp_phase_names[LP_NPHASES] = {
+    "poll", "accept", "read", "parse", "exec", "write", "cron", "other",
+};
+
+static uint64_t lp_now_ns(){
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000000 + tv.tv_nsec;
+}
+
+// the TSC where there is one, which is not serializing and does not stop
+// for a system call; nanoseconds elsewhere
+static inline uint64_t lp_cycles(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return lp_now_ns();
+#endif
+}
+
+// the report of one loop thread; its lock is only contended while the
+// profile is reported or reset
+struct LoopSlot {
+    std::mutex lock;
+    LoopReport r;
+};
+
+struct LoopProfile {
+    uint64_t id = 0;
+    std::mutex lock;                    // guards `slots`
+    std::vector<LoopSlot *> slots;      // one per thread that ended an iteration
+    // the clocks when the profile was created, to convert cycles
+    uint64_t start_cycles = 0;
+    uint64_t start_ns = 0;
+    uint64_t reset_cycles = 0;
+};
+
+// tells profiles apart even when one is allocated where a freed one was
+static std::atomic<uint64_t> g_lp_id_seq{0};
+
+// the iteration running on this thread
+struct LoopThread {
+    LoopProfile *prof = NULL;
+    LoopIter it;
+    int phase = LP_OTHER;
+    uint64_t at = 0;        // cycles when `phase` started
+    uint64_t slot_prof = 0; // the id of the profile `slot` belongs to
+    LoopSlot *slot = NULL;
+};
+
+static thread_local LoopThread t_loop;
+
+uint64_t lp_busy(const LoopIter &it){
+    uint64_t busy = 0;
+    for(int i = 0; i < LP_NPHASES; ++i){
+        busy += (i == LP_POLL) ? 0 : it.cycles[i];
+    }
+    return busy;
+}
+
+LoopProfile *lp_new(){
+    LoopProfile *p = new LoopProfile();
+    p->id = ++g_lp_id_seq;
+    p->start_cycles = p->reset_cycles = lp_cycles();
+    p->start_ns = lp_now_ns();
+    return p;
+}
+
+void lp_free(LoopProfile *p){
+    for(LoopSlot *slot : p->slots){
+        delete slot;
+    }
+    delete p;
+}
+
+void lp_reset(LoopProfile *p){
+    std::lock_guard<std::mutex> lock(p->lock);
+    for(LoopSlot *slot : p->slots){
+        std::lock_guard<std::mutex> slot_lock(slot->lock);
+        slot->r = LoopReport();
+    }
+    p->reset_cycles = lp_cycles();
+}
+
+// the slot of `it` if it is longer than the shortest of the longest, which
+// it is moved into; NULL otherwise
+static LoopIter *lp_keep_longest(LoopReport &r, const LoopIter &it){
+    uint64_t busy = lp_busy(it);
+    size_t at = r.nlongest;
+    if(r.nlongest == k_lp_longest){
+        if(busy <= lp_busy(r.longest[at - 1])){
+            return NULL;
+        }
+        at--;
+    }
+    else{
+        r.nlongest++;
+    }
+    while(at > 0 && lp_busy(r.longest[at - 1]) < busy){
+        r.longest[at] = r.longest[at - 1];
+        at--;
+    }
+    r.longest[at] = it;
+    return &r.longest[at];
+}
+
+void lp_report(LoopProfile *p, LoopReport &out){
+    uint64_t cycles = lp_cycles();
+    uint64_t ns = lp_now_ns();
+    out = LoopReport();
+    std::lock_guard<std::mutex> lock(p->lock);
+    for(LoopSlot *slot : p->slots){
+        std::lock_guard<std::mutex> slot_lock(slot->lock);
+        const LoopReport &r = slot->r;
+        out.iterations += r.iterations;
+        for(int i = 0; i < LP_NPHASES; ++i){
+            hist_merge(&out.phases[i], &r.phases[i]);
+        }
+        hist_merge(&out.busy, &r.busy);
+        hist_merge(&out.events, &r.events);
+        hist_merge(&out.requests, &r.requests);
+        for(size_t i = 0; i < r.nlongest; ++i){
+            lp_keep_longest(out, r.longest[i]);
+        }
+    }
+    if(cycles > p->start_cycles){
+        out.ns_per_cycle = (double)(ns - p->start_ns) / (double)(cycles - p->start_cycles);
+    }
+    out.seconds = (double)(cycles - p->reset_cycles) * out.ns_per_cycle / 1e9;
+}
+
+void lp_begin(LoopProfile *p){
+    t_loop.prof = p;
+    if(p){
+        t_loop.it = LoopIter();
+        t_loop.phase = LP_OTHER;
+        t_loop.at = lp_cycles();
+    }
+}
+
+void lp_phase(int phase){
+    if(!t_loop.prof){
+        return;
+    }
+    uint64_t now = lp_cycles();
+    t_loop.it.cycles[t_loop.phase] += now - t_loop.at;
+    t_loop.at = now;
+    t_loop.phase = phase;
+}
+
+void lp_events(uint32_t n){
+    t_loop.it.events += n;
+}
+
+void lp_request(){
+    t_loop.it.requests++;
+}
+
+void lp_end(){
+    LoopProfile *p = t_loop.prof;
+    if(!p){
+        return;
+    }
+    lp_phase(LP_OTHER);
+    t_loop.prof = NULL;
+    lp_add(p, t_loop.it);
+}
+
+void lp_add(LoopProfile *p, const LoopIter &it){
+    // the first iteration of this thread in `p` gets it a slot
+    if(t_loop.slot_prof != p->id){
+        LoopSlot *slot = new LoopSlot();
+        std::lock_guard<std::mutex> lock(p->lock);
+        p->slots.push_back(slot);
+        t_loop.slot = slot;
+        t_loop.slot_prof = p->id;
+    }
+
+    LoopSlot *slot = t_loop.slot;
+    std::lock_guard<std::mutex> lock(slot->lock);
+    LoopReport &r = slot->r;
+    r.iterations++;
+    for(int i = 0; i < LP_NPHASES; ++i){
+        hist_add(&r.phases[i], it.cycles[i]);
+    }
+    hist_add(&r.busy, lp_busy(it));
+    hist_add(&r.events, it.events);
+    hist_add(&r.requests, it.requests);
+    LoopIter *kept = lp_keep_longest(r, it);
+    if(kept && !kept->unix_time){
+        kept->unix_time = (int64_t)time(NULL);
+    }
+}
+
+static void appendf(std::string &s, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendf(std::string &s, const char *fmt, ...){
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if(n > 0){
+        s.append(buf, std::min((size_t)n, sizeof(buf) - 1));
+    }
+}
+
+std::string lp_doctor(const LoopReport &r){
+    std::string s;
+    if(!r.iterations){
+        return "No event loop iterations were profiled, is loop-profiler on?\n";
+    }
+    double us = r.ns_per_cycle / 1e3;
+    appendf(s, "%llu event loop iterations in %.1f s.\n\n",
+        (unsigned long long)r.iterations, r.seconds);
+
+    // time per phase, and the share of busy time
+    uint64_t total_busy = r.busy.sum;
+    appendf(s, "%-8s %12s %7s %10s %10s %10s\n", "phase", "total ms", "busy", "p50 us", "p99 us", "max us");
+    for(int i = 0; i < LP_NPHASES; ++i){
+        const Histogram &h = r.phases[i];
+        char share[16] = "-";
+        if(i != LP_POLL && total_busy){
+            snprintf(share, sizeof(share), "%.1f%%", 100.0 * h.sum / total_busy);
+        }
+        appendf(s, "%-8s %12.1f %7s %10.1f %10.1f %10.1f\n", k_lp_phase_names[i],
+            h.sum * us / 1e3, share, hist_percentile(&h, 50) * us,
+            hist_percentile(&h, 99) * us, h.max * us);
+    }
+    appendf(s, "%-8s %12.1f %7s %10.1f %10.1f %10.1f\n\n", "busy", total_busy * us / 1e3, "100%",
+        hist_percentile(&r.busy, 50) * us, hist_percentile(&r.busy, 99) * us, r.busy.max * us);
+
+    appendf(s, "Per iteration: %.1f events (p50 %llu, p99 %llu, max %llu), "
+        "%.1f requests (p50 %llu, p99 %llu, max %llu).\n\n",
+        (double)r.events.sum / r.iterations, (unsigned long long)hist_percentile(&r.events, 50),
+        (unsigned long long)hist_percentile(&r.events, 99), (unsigned long long)r.events.max,
+        (double)r.requests.sum / r.iterations, (unsigned long long)hist_percentile(&r.requests, 50),
+        (unsigned long long)hist_percentile(&r.requests, 99), (unsigned long long)r.requests.max);
+
+    s += "Longest iterations, by busy time:\n";
+    for(size_t i = 0; i < r.nlongest; ++i){
+        const LoopIter &it = r.longest[i];
+        uint64_t busy = lp_busy(it);
+        char when[32] = "";
+        time_t t = (time_t)it.unix_time;
+        struct tm tm;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+        appendf(s, "  %s %10.1f us, %u events, %u requests:", when, busy * us, it.events, it.requests);
+        for(int p = 0; p < LP_NPHASES; ++p){
+            if(p != LP_POLL && it.cycles[p] * 20 >= busy && busy){
+                appendf(s, " %s %.0f%%", k_lp_phase_names[p], 100.0 * it.cycles[p] / busy);
+            }
+        }
+        s += "\n";
+    }
+
+    // where to look first
+    s += "\n";
+    double io = total_busy ? (double)(r.phases[LP_READ].sum + r.phases[LP_WRITE].sum
+        + r.phases[LP_ACCEPT].sum) / total_busy : 0;
+    double exec = total_busy ? (double)(r.phases[LP_PARSE].sum + r.phases[LP_EXEC].sum) / total_busy : 0;
+    double cron = total_busy ? (double)r.phases[LP_CRON].sum / total_busy : 0;
+    if(io > exec){
+        appendf(s, "- Socket system calls take %.0f%% of busy time against %.0f%% for parsing and "
+            "commands: batching I/O (pipelining, or I/O threads with main_server -r) would "
+            "save more than faster commands.\n", io * 100, exec * 100);
+    }
+    else{
+        appendf(s, "- Parsing and commands take %.0f%% of busy time against %.0f%% for socket "
+            "system calls: look at SLOWLOG and HOTKEYS before batching I/O.\n", exec * 100, io * 100);
+    }
+    if(hist_percentile(&r.requests, 50) <= 1 && r.requests.sum){
+        s += "- Most iterations run at most one request: clients are not pipelining, so each "
+            "request pays for a poll() and a read() of its own.\n";
+    }
+    if(cron > 0.2){
+        appendf(s, "- Timers, tiering and memory reclaim take %.0f%% of busy time.\n", cron * 100);
+    }
+    if(r.busy.max * us > 10000){
+        appendf(s, "- The longest iteration was busy for %.1f ms, which every client of its "
+            "loop waited for.\n", r.busy.max * us / 1e3);
+    }
+    return s;
+}
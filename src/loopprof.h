@@ -0,0 +1,84 @@
+#pragma once
+
+#include "histogram.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/*
+ * Event loop profiler: how the iterations of a poll loop split their time
+ * between waiting in poll(), accepting, reading, parsing, running commands,
+ * writing and timers.
+ *
+ * A loop thread marks each change of phase with lp_phase(), which reads the
+ * time stamp counter and charges the cycles since the last mark to the
+ * phase it leaves; that is a few dozen cycles and no allocation. lp_end()
+ * adds the iteration to the profile: a histogram per phase of the time the
+ * iteration spent in it, of its busy time (all but poll()), of the events
+ * and requests it handled, and the longest iterations by busy time.
+ * Several loop threads can share a profile: each adds its iterations to
+ * a report of its own, under a lock that only lp_report() and lp_reset()
+ * take too, and lp_report() merges them. Marks outside of lp_begin() and
+ * lp_end() are ignored, so code shared with threads that are not profiled
+ * can mark phases too.
+ */
+
+enum {
+    LP_POLL = 0,    // waiting in poll()
+    LP_ACCEPT = 1,
+    LP_READ = 2,    // read() from sockets
+    LP_PARSE = 3,   // framing and parsing requests
+    LP_EXEC = 4,    // running commands, with the lock, and building replies
+    LP_WRITE = 5,   // writev() to sockets
+    LP_CRON = 6,    // timers, tiering, reclaiming memory
+    LP_OTHER = 7,   // setting up poll(), closing connections
+    LP_NPHASES = 8,
+};
+
+extern const char *const k_lp_phase_names[LP_NPHASES];
+const size_t k_lp_longest = 8;
+
+struct LoopIter {
+    uint64_t cycles[LP_NPHASES] = {};
+    uint32_t events = 0;        // fds poll() returned
+    uint32_t requests = 0;
+    int64_t unix_time = 0;      // when it ended, kept for the longest only
+};
+
+// all phases but LP_POLL
+uint64_t lp_busy(const LoopIter &it);
+
+struct LoopReport {
+    uint64_t iterations = 0;
+    double seconds = 0;         // since the profile was created or reset
+    double ns_per_cycle = 1;
+    Histogram phases[LP_NPHASES];   // cycles per iteration
+    Histogram busy;
+    Histogram events;
+    Histogram requests;
+    LoopIter longest[k_lp_longest];     // longest first
+    size_t nlongest = 0;
+};
+
+struct LoopProfile;
+
+LoopProfile *lp_new();
+void lp_free(LoopProfile *p);
+void lp_reset(LoopProfile *p);
+// the reports of every thread, merged
+void lp_report(LoopProfile *p, LoopReport &out);
+// the report as text for people, with a hint of where time would be best
+// saved
+std::string lp_doctor(const LoopReport &r);
+
+// on the loop thread: an iteration starts in LP_OTHER; a NULL profile
+// leaves the iteration unprofiled
+void lp_begin(LoopProfile *p);
+void lp_phase(int phase);
+void lp_events(uint32_t n);
+void lp_request();
+void lp_end();
+// adds an iteration measured by other means, as lp_end() does, to the
+// report of the calling thread
+void lp_add(LoopProfile *p, const LoopIter &it);
@@ -1,10 +1,38 @@
 #include "server_client.h"
 #include "parser.h"
+#include <chrono>
+
+// main_client --pipe [file]: sends the commands in the file, or stdin, one
+// per line, as fast as the server takes them; see pipe_mode()
+static int pipe_main(int client_fd, const char *path){
+    FILE *in = path ? fopen(path, "r") : stdin;
+    if(!in){
+        perror(path);
+        return 1;
+    }
+    PipeStats stats;
+    auto start = std::chrono::steady_clock::now();
+    int32_t err = pipe_mode(client_fd, in, stats);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(path){
+        fclose(in);
+    }
+    fprintf(stderr, "%llu commands in %.2f s (%.0f/s), %llu failed, %llu bad lines%s\n",
+        (unsigned long long)stats.sent, secs, stats.sent / (secs > 0 ? secs : 1),
+        (unsigned long long)stats.errors, (unsigned long long)stats.bad_lines,
+        err ? ", connection lost" : "");
+    return (err || stats.errors || stats.bad_lines) ? 1 : 0;
+}
+
 int main(int argc, char **argv){
     int client_fd = create_client_socket();
 
     int rv = connect(client_fd, INADDR_LOOPBACK, 8080);
 
+    if(argc > 1 && 0 == strcmp(argv[1], "--pipe")){
+        return rv ? 1 : pipe_main(client_fd, argc > 2 ? argv[2] : NULL);
+    }
+
     std::vector<std::string> cmd;
 
     for(int i = 1; i < argc; ++i){
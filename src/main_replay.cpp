@@ -0,0 +1,227 @@
+#include "server_client.h"
+#include "capture.h"
+#include "histogram.h"
+
+/*
+ * main_replay [-p port] [-s speed] [-c conns] file
+ *
+ * Sends the requests of a capture file (see CAPTURE in server.cpp) to a
+ * server again, as far apart as they came in: at speed 2 twice as fast,
+ * at speed 0 as fast as the server replies. The connections of the capture
+ * are spread over `conns` connections, so the requests of each are still
+ * sent in order on one connection.
+ *
+ * A request's latency is counted from when it was due, not from when it
+ * was sent, so a server falling behind the capture shows up in the
+ * latencies instead of only slowing the replay down.
+ */
+
+// requests sent and not replied to, per connection; past this a
+// connection waits for replies, which is what paces a replay at speed 0
+const size_t k_replay_window = 1000;
+
+struct ReplayConn {
+    int fd = -1;
+    std::string wbuf;
+    size_t wsent = 0;
+    std::string rbuf;
+    std::deque<uint64_t> due_ns;    // of the requests not replied to yet
+};
+
+struct ReplayStats {
+    uint64_t sent = 0;
+    uint64_t replies = 0;
+    uint64_t errors = 0;
+    uint64_t pow2_us[65] = {};      // latencies by their highest set bit, in usec
+};
+
+static uint64_t now_ns(){
+    struct timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000000 + tv.tv_nsec;
+}
+
+// the replies in `c.rbuf`; notifications pushed by the server are skipped
+static void replay_replies(ReplayConn &c, uint64_t now, Histogram *h, ReplayStats &stats){
+    size_t at = 0;
+    while(c.rbuf.size() - at >= 4){
+        uint32_t len = 0;
+        memcpy(&len, &c.rbuf[at], 4);
+        if(c.rbuf.size() - at - 4 < len){
+            break;
+        }
+        uint8_t tag = len ? (uint8_t)c.rbuf[at + 4] : (uint8_t)SER_NIL;
+        at += 4 + len;
+        if(tag == SER_PUSH || c.due_ns.empty()){
+            continue;
+        }
+        uint64_t lat = now > c.due_ns.front() ? now - c.due_ns.front() : 0;
+        c.due_ns.pop_front();
+        hist_add(h, lat);
+        uint64_t us = lat / 1000;
+        stats.pow2_us[us ? 64 - __builtin_clzll(us) : 0]++;
+        stats.replies++;
+        stats.errors += (tag == SER_ERR);
+    }
+    c.rbuf.erase(0, at);
+}
+
+static void print_report(const Histogram *h, const ReplayStats &stats, double secs){
+    printf("%llu requests in %.2f s (%.0f/s), %llu errors\n",
+        (unsigned long long)stats.sent, secs, stats.sent / (secs > 0 ? secs : 1),
+        (unsigned long long)stats.errors);
+    if(!h->count){
+        return;
+    }
+    printf("latency (usec): p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f  mean %.1f\n",
+        hist_percentile(h, 50) / 1e3, hist_percentile(h, 90) / 1e3,
+        hist_percentile(h, 99) / 1e3, hist_percentile(h, 99.9) / 1e3,
+        h->max / 1e3, (double)h->sum / h->count / 1e3);
+    size_t first = 0, last = 64;
+    while(!stats.pow2_us[first]){
+        first++;
+    }
+    while(!stats.pow2_us[last]){
+        last--;
+    }
+    for(size_t b = first; b <= last; ++b){
+        double pct = 100.0 * stats.pow2_us[b] / h->count;
+        printf("  < %10llu us %10llu %6.2f%% ", 1ull << b, (unsigned long long)stats.pow2_us[b], pct);
+        for(int i = 0; i < (int)(pct / 2 + 0.5); ++i){
+            putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv){
+    uint16_t port = 8080;
+    double speed = 1;
+    size_t nconns = 1;
+    int opt;
+    while((opt = getopt(argc, argv, "p:s:c:")) != -1){
+        if(opt == 'p'){
+            port = (uint16_t)atoi(optarg);
+        }
+        else if(opt == 's'){
+            speed = atof(optarg);
+        }
+        else if(opt == 'c'){
+            nconns = (size_t)std::max(1, atoi(optarg));
+        }
+        else{
+            optind = argc + 1;
+            break;
+        }
+    }
+    if(optind != argc - 1 || speed < 0){
+        fprintf(stderr, "usage: %s [-p port] [-s speed, 0 for max] [-c conns] file\n", argv[0]);
+        return 1;
+    }
+    FILE *in = capture_reader_open(argv[optind]);
+    if(!in){
+        fprintf(stderr, "%s is not a capture file\n", argv[optind]);
+        return 1;
+    }
+
+    std::vector<ReplayConn> conns(nconns);
+    for(ReplayConn &c : conns){
+        c.fd = create_client_socket();
+        if(connect(c.fd, INADDR_LOOPBACK, port)){
+            fprintf(stderr, "can not connect to port %u\n", port);
+            return 1;
+        }
+        int flags = fcntl(c.fd, F_GETFL, 0);
+        (void)fcntl(c.fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    Histogram *h = new Histogram();
+    ReplayStats stats;
+    std::unordered_map<uint32_t, size_t> conn_of;
+    CaptureRec rec;
+    bool more = capture_read(in, rec);
+    uint64_t first_us = rec.ts_us;
+    uint64_t start = now_ns();
+    std::vector<struct pollfd> pfds(nconns);
+    bool lost = false;
+
+    while(!lost && (more || stats.replies < stats.sent)){
+        // queue the requests that are due
+        uint64_t now = now_ns();
+        uint64_t next_due = 0;
+        while(more){
+            uint64_t offset_us = rec.ts_us > first_us ? rec.ts_us - first_us : 0;
+            uint64_t due = speed > 0 ? start + (uint64_t)(offset_us * 1e3 / speed) : now;
+            auto it = conn_of.emplace(rec.conn, conn_of.size() % nconns).first;
+            ReplayConn &c = conns[it->second];
+            if(due > now || c.due_ns.size() >= k_replay_window){
+                next_due = due > now ? due : 0;
+                break;
+            }
+            uint32_t len = (uint32_t)rec.body.size();
+            c.wbuf.append((const char *)&len, 4);
+            c.wbuf.append(rec.body);
+            c.due_ns.push_back(due);
+            stats.sent++;
+            more = capture_read(in, rec);
+        }
+
+        for(size_t i = 0; i < nconns; ++i){
+            pfds[i].fd = conns[i].fd;
+            pfds[i].events = POLLIN | (conns[i].wsent < conns[i].wbuf.size() ? POLLOUT : 0);
+            pfds[i].revents = 0;
+        }
+        // wake up for the next request, or for replies
+        struct timespec timeout = {1, 0};
+        if(next_due){
+            uint64_t wait = next_due - now;
+            timeout = {(time_t)(wait / 1000000000), (long)(wait % 1000000000)};
+        }
+        if(ppoll(pfds.data(), nconns, &timeout, NULL) < 0 && errno != EINTR){
+            perror("ppoll");
+            return 1;
+        }
+
+        now = now_ns();
+        for(size_t i = 0; i < nconns && !lost; ++i){
+            ReplayConn &c = conns[i];
+            if(pfds[i].revents & POLLOUT){
+                ssize_t rv = write(c.fd, &c.wbuf[c.wsent], c.wbuf.size() - c.wsent);
+                if(rv > 0){
+                    c.wsent += (size_t)rv;
+                    if(c.wsent == c.wbuf.size()){
+                        c.wbuf.clear();
+                        c.wsent = 0;
+                    }
+                }
+                else if(errno != EAGAIN && errno != EINTR){
+                    lost = true;
+                }
+            }
+            if(pfds[i].revents & (POLLIN | POLLERR | POLLHUP)){
+                char buf[64 * 1024];
+                ssize_t rv = read(c.fd, buf, sizeof(buf));
+                if(rv > 0){
+                    c.rbuf.append(buf, (size_t)rv);
+                    replay_replies(c, now, h, stats);
+                }
+                else if(rv == 0 || (errno != EAGAIN && errno != EINTR)){
+                    lost = true;
+                }
+            }
+        }
+    }
+    double secs = (now_ns() - start) / 1e9;
+
+    print_report(h, stats, secs);
+    if(lost){
+        fprintf(stderr, "connection lost, %llu requests not replied to\n",
+            (unsigned long long)(stats.sent - stats.replies));
+    }
+    for(ReplayConn &c : conns){
+        close(c.fd);
+    }
+    fclose(in);
+    delete h;
+    return lost ? 1 : 0;
+}
@@ -1,10 +1,72 @@
 #include "server_client.h"
 
-int main(){
+#include <chrono>
+#include <thread>
+
+int main(int argc, char **argv){
+    // usage: main_server [-t tiering dir] [-r io threads] [-s snapshot file]
+    //                    [-j load threads] [-c capture dir] [port] [unix socket path]
+    const char *snapshot = NULL;
+    int load_threads = (int)std::thread::hardware_concurrency();
+    int opt;
+    while((opt = getopt(argc, argv, "t:r:s:j:c:")) != -1){
+        if(opt == 't'){
+            // values moved out of memory go to a log in this directory
+            tiering_set_dir(optarg);
+        }
+        else if(opt == 'r'){
+            // connections are served by this many threads, GETs in parallel
+            set_io_threads(atoi(optarg));
+        }
+        else if(opt == 's'){
+            // loaded at startup if it exists, and written by SAVE
+            snapshot = optarg;
+            set_snapshot_path(optarg);
+        }
+        else if(opt == 'j'){
+            // snapshot chunks are decoded on this many threads
+            load_threads = atoi(optarg);
+        }
+        else if(opt == 'c'){
+            // CAPTURE START only writes files in this directory
+            set_capture_dir(optarg);
+        }
+        else{
+            fprintf(stderr, "usage: %s [-t tiering dir] [-r io threads] [-s snapshot file] "
+                "[-j load threads] [-c capture dir] [port] [unix socket path]\n", argv[0]);
+            return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if(snapshot && access(snapshot, F_OK) == 0){
+        auto start = std::chrono::steady_clock::now();
+        if(!snapshot_load(snapshot, load_threads < 1 ? 1 : load_threads)){
+            fprintf(stderr, "can not load the snapshot %s\n", snapshot);
+            return 1;
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        fprintf(stderr, "loaded %s in %lld ms on %d threads\n", snapshot, (long long)ms, load_threads);
+    }
+
+    // the port can be given on the command line, e.g. 6379 for Redis tools
+    uint16_t port = (argc > 1) ? (uint16_t)atoi(argv[1]) : 8080;
+
     int server_fd = create_server_socket();
-    bind_socket(server_fd, 8080);
+    bind_socket(server_fd, port);
     listen_socket(server_fd);
-    accept_connection(server_fd);
+    std::vector<int> listeners = {server_fd};
+
+    // clients on this host can also connect through a Unix domain socket
+    if(argc > 2){
+        int unix_fd = create_unix_server_socket(argv[2]);
+        listen_socket(unix_fd);
+        listeners.push_back(unix_fd);
+    }
+
+    accept_connections(listeners);
     return 0;
 
 }
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include "nearcache.h"
+#include "server_client.h"
+#include "parser.h"
+
+struct NCValue {
+    bool found = false;
+    std::string val;
+};
+
+struct NearCache {
+    int fd = -1;
+    size_t max_keys = 0;
+    std::unordered_map<std::string, NCValue> cache;
+    uint64_t hits = 0;
+    uint64_t invalidations = 0;
+};
+
+// reads one message body; -1 on EOF, errors and bad framing
+static int32_t read_msg(int fd, std::string &body){
+    uint32_t len = 0;
+    if(read_full(fd, (char *)&len, 4) || len > 5 + k_max_req){
+        return -1;
+    }
+    body.resize(len);
+    if(len && read_full(fd, &body[0], len)){
+        return -1;
+    }
+    return 0;
+}
+
+// reads a SER_STR at `pos`, moving past it
+static bool read_str(const std::string &body, size_t &pos, std::string &out){
+    uint32_t len = 0;
+    if(pos + 5 > body.size() || body[pos] != SER_STR){
+        return false;
+    }
+    memcpy(&len, &body[pos + 1], 4);
+    if(pos + 5 + len > body.size()){
+        return false;
+    }
+    out.assign(body, pos + 5, len);
+    pos += 5 + len;
+    return true;
+}
+
+// applies ["invalidate", [key ...]], or ["invalidate", nil] for every key
+static int32_t on_push(NearCache *nc, const std::string &body){
+    size_t pos = 1 + 4;
+    std::string word;
+    if(!read_str(body, pos, word) || word != "invalidate" || pos >= body.size()){
+        return -1;
+    }
+    if(body[pos] == SER_NIL){
+        nc->invalidations += nc->cache.size();
+        nc->cache.clear();
+        return 0;
+    }
+    if(pos + 5 > body.size() || body[pos] != SER_ARR){
+        return -1;
+    }
+    uint32_t n = 0;
+    memcpy(&n, &body[pos + 1], 4);
+    pos += 5;
+    for(uint32_t i = 0; i < n; ++i){
+        std::string key;
+        if(!read_str(body, pos, key)){
+            return -1;
+        }
+        nc->cache.erase(key);
+        nc->invalidations++;
+    }
+    return 0;
+}
+
+// reads messages until a reply, applying the pushes in front of it
+static int32_t read_reply(NearCache *nc, std::string &res){
+    while(true){
+        if(read_msg(nc->fd, res)){
+            return -1;
+        }
+        if(res.empty() || res[0] != SER_PUSH){
+            return 0;
+        }
+        if(on_push(nc, res)){
+            return -1;
+        }
+    }
+}
+
+// applies the pushes that already arrived, without blocking
+static int32_t drain_pushes(NearCache *nc){
+    struct pollfd pfd = {nc->fd, POLLIN, 0};
+    while(poll(&pfd, 1, 0) > 0){
+        std::string body;
+        // a push is written whole, so the rest of it follows right away
+        if(read_msg(nc->fd, body) || body.empty() || body[0] != SER_PUSH){
+            return -1;
+        }
+        if(on_push(nc, body)){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+NearCache *nc_new(int fd, size_t max_keys){
+    NearCache *nc = new NearCache();
+    nc->fd = fd;
+    nc->max_keys = max_keys;
+    std::vector<std::string> cmd = {"client", "tracking", "on"};
+    std::string res;
+    if(nc_call(nc, cmd, res) || res.empty() || res[0] != SER_STATUS){
+        delete nc;
+        return NULL;
+    }
+    return nc;
+}
+
+void nc_free(NearCache *nc){
+    delete nc;
+}
+
+int32_t nc_call(NearCache *nc, std::vector<std::string> &cmd, std::string &res){
+    if(send_req(nc->fd, cmd)){
+        return -1;
+    }
+    return read_reply(nc, res);
+}
+
+int32_t nc_get(NearCache *nc, const std::string &key, std::string &val, bool *found){
+    if(drain_pushes(nc)){
+        return -1;
+    }
+    auto it = nc->cache.find(key);
+    if(it != nc->cache.end()){
+        nc->hits++;
+        *found = it->second.found;
+        val = it->second.val;
+        return 0;
+    }
+
+    std::vector<std::string> cmd = {"get", key};
+    std::string res;
+    if(nc_call(nc, cmd, res) || res.empty()){
+        return -1;
+    }
+    NCValue ent;
+    if(res[0] == SER_STR){
+        size_t pos = 0;
+        if(!read_str(res, pos, ent.val)){
+            return -1;
+        }
+        ent.found = true;
+    }
+    else if(res[0] != SER_NIL){
+        return -1;
+    }
+
+    // pushes read in front of the reply were about older values, and any
+    // later change will be pushed after it, so the reply can be cached
+    if(nc->cache.size() >= nc->max_keys && !nc->cache.empty()){
+        nc->cache.erase(nc->cache.begin());
+    }
+    if(nc->max_keys){
+        nc->cache[key] = ent;
+    }
+    *found = ent.found;
+    val.swap(ent.val);
+    return 0;
+}
+
+size_t nc_size(const NearCache *nc){
+    return nc->cache.size();
+}
+
+uint64_t nc_hits(const NearCache *nc){
+    return nc->hits;
+}
+
+uint64_t nc_invalidations(const NearCache *nc){
+    return nc->invalidations;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/*
+ * Near cache: GET results kept in the client process, for a connection
+ * with server side tracking on (CLIENT TRACKING ON).
+ *
+ * The server remembers the keys the connection reads and pushes an
+ * invalidation when one of them changes, so a cached value is served until
+ * its key is written by anyone. Pushes that arrived since the last call are
+ * applied before the cache is consulted, and pushes that come in while
+ * waiting for a reply are applied as they are read. Missing keys are cached
+ * too. Once `max_keys` keys are cached an arbitrary one is dropped to make
+ * room. An invalidation of every key, which the server sends for a key too
+ * long to push, empties the cache.
+ */
+
+struct NearCache;
+
+// turns tracking on for the native protocol connection `fd`; NULL on error
+NearCache *nc_new(int fd, size_t max_keys);
+void nc_free(NearCache *nc);
+
+/*
+ * GET through the cache. Returns 0 with `*found` telling whether the key
+ * exists, or -1 on a connection error or an error reply.
+ */
+int32_t nc_get(NearCache *nc, const std::string &key, std::string &val, bool *found);
+// runs any other command, with the serialized reply body in `res`
+int32_t nc_call(NearCache *nc, std::vector<std::string> &cmd, std::string &res);
+
+size_t nc_size(const NearCache *nc);
+uint64_t nc_hits(const NearCache *nc);
+uint64_t nc_invalidations(const NearCache *nc);
@@ -135,4 +135,113 @@ int32_t query(int fd, const char *text){
     rbuf[4 + len] = '\0';
     printf("server says: %s\n", &rbuf[4]);
     return 0;
-}
\ No newline at end of file
+}
+
+/*
+ * Function: parse_req
+ * 
+ * This function takes a pointer to a byte array, the length of the array, and a reference to a vector of strings.
+ * 
+ * The purpose of this function is to parse a request that follows a specific format. The format is:
+ * 
+ * | 4-byte little-endian integer representing the number of strings | sequence of strings 
+ * (each preceded by a 4-byte integer representing the length of the string)
+ * 
+ * The function will return 0 if the parsing is successful, and -1 if there is an error.
+ * 
+ * The function will also populate the vector of strings with the parsed strings.
+ */
+
+int32_t parse_req(const uint8_t *data, 
+                            size_t len,
+                            std::vector<std::string> &out){
+
+    // Check if the length of the data is at least 4 bytes. If not, return -1.
+    if(len < 4){
+        return -1;
+    }
+
+    // Get the number of strings from the first 4 bytes of the data
+    uint32_t n = 0;
+    memcpy(&n, &data[0], 4);
+
+    // Check if the number of strings is less than or equal to k_max_msg. If not, return -1.
+    if(n > k_max_msg){
+        return -1;
+    }
+
+    // Initialize the position to 4, since the first 4 bytes were used to get the number of strings
+    size_t pos = 4;
+
+    // Loop n times, parsing each string
+    while(n--){
+        // Check if there is enough data to read the length of the string
+        if(pos + 4 > len){
+            return -1;
+        }
+
+        // Get the length of the string
+        uint32_t sz = 0;
+        memcpy(&sz, &data[pos], 4);
+
+        // Check if there is enough data to read the string
+        if(pos + 4 + sz > len){
+            return -1;
+        }
+
+        // Copy the string into a new std::string object and add it to the vector of strings
+        out.push_back(std::string((char*)&data[pos+4], sz));
+
+        // Update the position to the start of the next string
+        pos += 4 + sz;
+    }
+
+    // Check if the parsing was successful and all data was used. If not, return -1.
+    if(pos != len){
+        return -1;
+    }
+
+    // Return 0 to indicate success
+    return 0;
+}
+
+/*
+ * Parses a string that is the canonical decimal form of an int64: no sign
+ * other than a leading '-', no leading zeros, no "-0". Only such strings are
+ * stored as ENC_INT, so GET returns exactly the bytes that were SET.
+ */
+bool str2canonical_int(const std::string &s, int64_t &out){
+    if(s.empty() || s.size() > 20){
+        return false;
+    }
+    size_t i = (s[0] == '-') ? 1 : 0;
+    if(i == s.size() || s[i] < '0' || s[i] > '9' || (s[i] == '0' && s.size() > 1)){
+        return false;
+    }
+
+    uint64_t v = 0;
+    for(; i < s.size(); ++i){
+        if(s[i] < '0' || s[i] > '9'){
+            return false;
+        }
+        uint64_t d = (uint64_t)(s[i] - '0');
+        if(v > (UINT64_MAX - d) / 10){
+            return false;
+        }
+        v = v * 10 + d;
+    }
+
+    if(s[0] == '-'){
+        if(v > (uint64_t)INT64_MAX + 1){
+            return false;
+        }
+        out = (int64_t)(0 - v);
+    }
+    else{
+        if(v > (uint64_t)INT64_MAX){
+            return false;
+        }
+        out = (int64_t)v;
+    }
+    return true;
+}
@@ -1,10 +1,14 @@
 #pragma once
 
 #include <iostream>
+#include <vector>
+#include <string>
 
 
 int32_t one_request(int connfd);
 int32_t write_all(int fd, const char *buf, size_t n);
 int32_t read_full(int fd, char *buf, size_t);
 int32_t query(int fd, const char *text);
-
+int32_t parse_req(const uint8_t *data, size_t len, std::vector<std::string> &out);
+// the canonical decimal form of an int64 only, see parser.cpp
+bool str2canonical_int(const std::string &s, int64_t &out);
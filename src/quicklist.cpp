@@ -0,0 +1,262 @@
+#include "quicklist.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+const size_t k_ql_min_cap = 64;
+
+struct QLNode {
+    QLNode *prev = NULL;
+    QLNode *next = NULL;
+    uint32_t count = 0;     // number of elements in this node
+    size_t head = 0;        // offset of the first used byte
+    size_t tail = 0;        // offset past the last used byte
+    size_t cap = 0;
+    uint8_t *buf = NULL;
+};
+
+struct QuickList {
+    QLNode *head = NULL;
+    QLNode *tail = NULL;
+    size_t count = 0;       // total number of elements
+    size_t nodes = 0;
+};
+
+// bytes taken by one length field
+static size_t len_size(size_t len){
+    return len < 128 ? 1 : 5;
+}
+
+static size_t entry_size(size_t len){
+    return 2 * len_size(len) + len;
+}
+
+/*
+ * Writes an element at `p`. The leading length is read front to back and
+ * the trailing one back to front, so the 0x80 marker is the outermost byte
+ * on both sides.
+ */
+static void entry_write(uint8_t *p, const char *data, size_t len){
+    uint32_t l = (uint32_t)len;
+    if(len < 128){
+        *p++ = (uint8_t)len;
+        memcpy(p, data, len);
+        p += len;
+        *p = (uint8_t)len;
+        return;
+    }
+    *p++ = 0x80;
+    memcpy(p, &l, 4);
+    p += 4;
+    memcpy(p, data, len);
+    p += len;
+    memcpy(p, &l, 4);
+    p[4] = 0x80;
+}
+
+// decodes the element starting at `p`
+static const uint8_t *entry_front(const uint8_t *p, size_t *len){
+    if(p[0] != 0x80){
+        *len = p[0];
+        return p + 1;
+    }
+    uint32_t l = 0;
+    memcpy(&l, p + 1, 4);
+    *len = l;
+    return p + 5;
+}
+
+// decodes the element ending just before `end`
+static const uint8_t *entry_back(const uint8_t *end, size_t *len){
+    if(end[-1] != 0x80){
+        *len = end[-1];
+        return end - 1 - *len;
+    }
+    uint32_t l = 0;
+    memcpy(&l, end - 5, 4);
+    *len = l;
+    return end - 5 - l;
+}
+
+static QLNode *node_new(){
+    return new QLNode();
+}
+
+static void node_free(QLNode *node){
+    free(node->buf);
+    delete node;
+}
+
+/*
+ * Makes room for `need` bytes at one end of the node buffer. All the free
+ * space of the new buffer goes to the side being pushed, as consecutive
+ * pushes tend to hit the same end.
+ */
+static void node_reserve(QLNode *node, uint32_t where, size_t need){
+    if(where == QL_HEAD && node->head >= need){
+        return;
+    }
+    if(where == QL_TAIL && node->cap - node->tail >= need){
+        return;
+    }
+
+    // sized from the live bytes, so space freed by pops at the other end
+    // is given back instead of growing the buffer forever
+    size_t used = node->tail - node->head;
+    size_t cap = k_ql_min_cap;
+    while(cap < 2 * (used + need)){
+        cap *= 2;
+    }
+
+    uint8_t *buf = (uint8_t *)malloc(cap);
+    assert(buf);
+    size_t head = (where == QL_HEAD) ? cap - used : 0;
+    if(used){
+        memcpy(&buf[head], &node->buf[node->head], used);
+    }
+    free(node->buf);
+    node->buf = buf;
+    node->cap = cap;
+    node->head = head;
+    node->tail = head + used;
+}
+
+static void ql_link(QuickList *ql, uint32_t where, QLNode *node){
+    if(!ql->head){
+        ql->head = ql->tail = node;
+    }
+    else if(where == QL_HEAD){
+        node->next = ql->head;
+        ql->head->prev = node;
+        ql->head = node;
+    }
+    else{
+        node->prev = ql->tail;
+        ql->tail->next = node;
+        ql->tail = node;
+    }
+    ql->nodes++;
+}
+
+static void ql_unlink(QuickList *ql, QLNode *node){
+    if(node->prev){
+        node->prev->next = node->next;
+    }
+    else{
+        ql->head = node->next;
+    }
+    if(node->next){
+        node->next->prev = node->prev;
+    }
+    else{
+        ql->tail = node->prev;
+    }
+    ql->nodes--;
+    node_free(node);
+}
+
+QuickList *ql_new(){
+    return new QuickList();
+}
+
+void ql_free(QuickList *ql){
+    if(!ql){
+        return;
+    }
+    QLNode *node = ql->head;
+    while(node){
+        QLNode *next = node->next;
+        node_free(node);
+        node = next;
+    }
+    delete ql;
+}
+
+size_t ql_len(const QuickList *ql){
+    return ql->count;
+}
+
+size_t ql_nodes(const QuickList *ql){
+    return ql->nodes;
+}
+
+void ql_push(QuickList *ql, uint32_t where, const char *data, size_t len){
+    size_t need = entry_size(len);
+    QLNode *node = (where == QL_HEAD) ? ql->head : ql->tail;
+
+    // start a new node once the end node is full
+    if(!node || (node->tail - node->head) + need > k_ql_node_bytes){
+        node = node_new();
+        ql_link(ql, where, node);
+    }
+
+    node_reserve(node, where, need);
+    if(where == QL_HEAD){
+        node->head -= need;
+        entry_write(&node->buf[node->head], data, len);
+    }
+    else{
+        entry_write(&node->buf[node->tail], data, len);
+        node->tail += need;
+    }
+    node->count++;
+    ql->count++;
+}
+
+bool ql_pop(QuickList *ql, uint32_t where, std::string &out){
+    QLNode *node = (where == QL_HEAD) ? ql->head : ql->tail;
+    if(!node){
+        return false;
+    }
+    assert(node->count > 0);
+
+    size_t len = 0;
+    if(where == QL_HEAD){
+        const uint8_t *data = entry_front(&node->buf[node->head], &len);
+        out.assign((const char *)data, len);
+        node->head += entry_size(len);
+    }
+    else{
+        const uint8_t *data = entry_back(&node->buf[node->tail], &len);
+        out.assign((const char *)data, len);
+        node->tail -= entry_size(len);
+    }
+    node->count--;
+    ql->count--;
+
+    if(node->count == 0){
+        ql_unlink(ql, node);
+    }
+    return true;
+}
+
+/*
+ * Visits elements with 0-based indexes in [start, stop], in order.
+ * Whole nodes before `start` are skipped by their element count.
+ */
+void ql_range(const QuickList *ql, size_t start, size_t stop,
+              ql_visit_fn fn, void *arg){
+    if(start > stop || start >= ql->count){
+        return;
+    }
+
+    size_t idx = 0;
+    QLNode *node = ql->head;
+    while(node && idx + node->count <= start){
+        idx += node->count;
+        node = node->next;
+    }
+
+    for(; node && idx <= stop; node = node->next){
+        const uint8_t *p = &node->buf[node->head];
+        for(uint32_t i = 0; i < node->count && idx <= stop; ++i, ++idx){
+            size_t len = 0;
+            const uint8_t *data = entry_front(p, &len);
+            if(idx >= start){
+                fn((const char *)data, len, arg);
+            }
+            p += entry_size(len);
+        }
+    }
+}
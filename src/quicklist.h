@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/*
+ * List: a doubly-linked list of packed nodes.
+ *
+ * Each node holds many elements in one byte buffer, so a list of small
+ * elements costs a few bytes of overhead per element instead of a heap
+ * allocation and two pointers each. Every element is stored with its length
+ * on both sides, so it can be read from either end of the node:
+ *
+ *   +-----+------+-----+-----+------+-----+-------
+ *   | len | data | len | len | data | len | more...
+ *   +-----+------+-----+-----+------+-----+-------
+ *
+ * A length below 128 takes one byte; longer lengths take 5 bytes, with a
+ * 0x80 marker byte on the outer side. The buffer keeps free space at both
+ * ends, so pushes and pops at either end of the list are O(1) amortized.
+ * A new node is started once the end node holds k_ql_node_bytes bytes.
+ */
+
+enum {
+    QL_HEAD = 0,
+    QL_TAIL = 1,
+};
+
+const size_t k_ql_node_bytes = 8192;
+
+struct QuickList;
+
+// called once per element visited by ql_range()
+typedef void (*ql_visit_fn)(const char *data, size_t len, void *arg);
+
+QuickList *ql_new();
+void ql_free(QuickList *ql);
+
+size_t ql_len(const QuickList *ql);
+size_t ql_nodes(const QuickList *ql);
+
+void ql_push(QuickList *ql, uint32_t where, const char *data, size_t len);
+bool ql_pop(QuickList *ql, uint32_t where, std::string &out);
+void ql_range(const QuickList *ql, size_t start, size_t stop,
+              ql_visit_fn fn, void *arg);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+/*
+ * An immutable, reference counted string value.
+ *
+ * The keyspace holds one reference and a connection sending the value holds
+ * another until the bytes are written, so a reply can point at the stored
+ * value instead of copying it, and overwriting or deleting the key while
+ * the reply is in flight only drops the keyspace's reference. The bytes
+ * are never changed after creation; a write makes a new RcStr.
+ *
+ * The count is atomic, as I/O threads take and drop references to values
+ * they send from the read index (readindex.h).
+ */
+struct RcStr {
+    std::atomic<uint32_t> refs{1};
+    std::string str;
+};
+
+// takes the bytes of `s` without copying them
+inline RcStr *rcstr_new(std::string &s){
+    RcStr *rc = new RcStr();
+    rc->str.swap(s);
+    return rc;
+}
+
+inline RcStr *rcstr_ref(RcStr *rc){
+    rc->refs.fetch_add(1, std::memory_order_relaxed);
+    return rc;
+}
+
+inline void rcstr_unref(RcStr *rc){
+    if(rc && rc->refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        delete rc;
+    }
+}
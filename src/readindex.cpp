@@ -0,0 +1,182 @@
+#include "readindex.h"
+#include "epoch.h"
+
+#include <string.h>
+#include <atomic>
+#include <string_view>
+
+const size_t k_initial_slots = 1024;
+
+struct RiNode {
+    std::atomic<RiNode *> next{NULL};
+    uint64_t hash = 0;
+    uint32_t kind = RI_OTHER;
+    int64_t ival = 0;
+    RcStr *val = NULL;
+    std::string key;
+};
+
+struct RiTable {
+    size_t mask = 0;
+    std::atomic<RiNode *> *slots = NULL;
+};
+
+struct ReadIndex {
+    std::atomic<RiTable *> table{NULL};
+    size_t size = 0;
+};
+
+static uint64_t key_hash(const char *key, size_t len){
+    return std::hash<std::string_view>()(std::string_view(key, len));
+}
+
+static RiTable *table_new(size_t nslots){
+    RiTable *t = new RiTable();
+    t->mask = nslots - 1;
+    t->slots = new std::atomic<RiNode *>[nslots];
+    for(size_t i = 0; i < nslots; ++i){
+        t->slots[i].store(NULL, std::memory_order_relaxed);
+    }
+    return t;
+}
+
+static void node_free(void *p){
+    RiNode *n = (RiNode *)p;
+    rcstr_unref(n->val);
+    delete n;
+}
+
+// a table and every node in it
+static void table_free(void *p){
+    RiTable *t = (RiTable *)p;
+    for(size_t i = 0; i <= t->mask; ++i){
+        RiNode *n = t->slots[i].load(std::memory_order_relaxed);
+        while(n){
+            RiNode *next = n->next.load(std::memory_order_relaxed);
+            node_free(n);
+            n = next;
+        }
+    }
+    delete[] t->slots;
+    delete t;
+}
+
+ReadIndex *ri_new(){
+    ReadIndex *ri = new ReadIndex();
+    ri->table.store(table_new(k_initial_slots), std::memory_order_release);
+    return ri;
+}
+
+void ri_free(ReadIndex *ri){
+    table_free(ri->table.load(std::memory_order_relaxed));
+    delete ri;
+}
+
+static RiNode *node_new(uint64_t hash, const std::string &key, uint32_t kind, int64_t ival, RcStr *val){
+    RiNode *n = new RiNode();
+    n->hash = hash;
+    n->kind = kind;
+    n->ival = ival;
+    n->val = val ? rcstr_ref(val) : NULL;
+    n->key = key;
+    return n;
+}
+
+// the link that points at the node of `key`, or the one at the end of its chain
+static std::atomic<RiNode *> *find_link(RiTable *t, uint64_t hash, const std::string &key){
+    std::atomic<RiNode *> *link = &t->slots[hash & t->mask];
+    RiNode *n;
+    while((n = link->load(std::memory_order_relaxed))){
+        if(n->hash == hash && n->key == key){
+            break;
+        }
+        link = &n->next;
+    }
+    return link;
+}
+
+/*
+ * Doubles the table. Nodes are linked into one chain only, so the new
+ * table gets copies of them, and the old one is retired whole; readers
+ * still on it see the same values.
+ */
+static void grow(ReadIndex *ri){
+    RiTable *old = ri->table.load(std::memory_order_relaxed);
+    RiTable *t = table_new(2 * (old->mask + 1));
+    for(size_t i = 0; i <= old->mask; ++i){
+        for(RiNode *n = old->slots[i].load(std::memory_order_relaxed); n;
+            n = n->next.load(std::memory_order_relaxed)){
+            RiNode *copy = node_new(n->hash, n->key, n->kind, n->ival, n->val);
+            std::atomic<RiNode *> &slot = t->slots[n->hash & t->mask];
+            copy->next.store(slot.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            slot.store(copy, std::memory_order_relaxed);
+        }
+    }
+    ri->table.store(t, std::memory_order_release);
+    epoch_retire(table_free, old);
+}
+
+static void ri_set(ReadIndex *ri, const std::string &key, uint32_t kind, int64_t ival, RcStr *val){
+    RiTable *t = ri->table.load(std::memory_order_relaxed);
+    uint64_t hash = key_hash(key.data(), key.size());
+    std::atomic<RiNode *> *link = find_link(t, hash, key);
+    RiNode *old = link->load(std::memory_order_relaxed);
+    if(old && kind == RI_OTHER && old->kind == RI_OTHER){
+        return;
+    }
+
+    // the new node takes the old one's place in the chain
+    RiNode *n = node_new(hash, key, kind, ival, val);
+    n->next.store(old ? old->next.load(std::memory_order_relaxed) : NULL, std::memory_order_relaxed);
+    link->store(n, std::memory_order_release);
+    if(old){
+        epoch_retire(node_free, old);
+        return;
+    }
+    if(++ri->size > t->mask + 1){
+        grow(ri);
+    }
+}
+
+void ri_set_str(ReadIndex *ri, const std::string &key, RcStr *val){
+    ri_set(ri, key, RI_STR, 0, val);
+}
+
+void ri_set_int(ReadIndex *ri, const std::string &key, int64_t ival){
+    ri_set(ri, key, RI_INT, ival, NULL);
+}
+
+void ri_set_other(ReadIndex *ri, const std::string &key){
+    ri_set(ri, key, RI_OTHER, 0, NULL);
+}
+
+void ri_del(ReadIndex *ri, const std::string &key){
+    RiTable *t = ri->table.load(std::memory_order_relaxed);
+    std::atomic<RiNode *> *link = find_link(t, key_hash(key.data(), key.size()), key);
+    RiNode *old = link->load(std::memory_order_relaxed);
+    if(!old){
+        return;
+    }
+    link->store(old->next.load(std::memory_order_relaxed), std::memory_order_release);
+    epoch_retire(node_free, old);
+    ri->size--;
+}
+
+size_t ri_size(const ReadIndex *ri){
+    return ri->size;
+}
+
+bool ri_get(const ReadIndex *ri, const char *key, size_t len, RiValue *out){
+    uint64_t hash = key_hash(key, len);
+    RiTable *t = ri->table.load(std::memory_order_acquire);
+    RiNode *n = t->slots[hash & t->mask].load(std::memory_order_acquire);
+    for(; n; n = n->next.load(std::memory_order_acquire)){
+        if(n->hash == hash && n->key.size() == len && 0 == memcmp(n->key.data(), key, len)){
+            out->kind = n->kind;
+            out->ival = n->ival;
+            out->val = n->val;
+            return true;
+        }
+    }
+    return false;
+}
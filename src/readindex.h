@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+#include "rcstr.h"
+
+/*
+ * Read index: a hash table from key to string value that any number of
+ * threads read with no lock, while one writer at a time keeps it in step
+ * with the keyspace.
+ *
+ * Buckets are singly linked chains of immutable nodes. The writer never
+ * changes a node a reader may be on: a new value is a new node, linked in
+ * place of the old one with a single atomic pointer store, and an unlinked
+ * node (or a whole table, when it grows) is freed through epoch_retire()
+ * once no reader can still be on it. Readers call ri_get() between
+ * epoch_enter() and epoch_exit().
+ *
+ * Every key of the keyspace is in the index, so a key that is not found
+ * does not exist. Keys whose GET can not be answered from here, such as
+ * other types, are there as RI_OTHER.
+ */
+
+enum {
+    RI_STR = 0,     // `val`
+    RI_INT = 1,     // `ival`
+    RI_OTHER = 2,   // ask the keyspace
+};
+
+struct RiValue {
+    uint32_t kind = RI_OTHER;
+    int64_t ival = 0;
+    RcStr *val = NULL;      // valid until epoch_exit(), unless ref'd
+};
+
+struct ReadIndex;
+
+ReadIndex *ri_new();
+// only once no reader is left
+void ri_free(ReadIndex *ri);
+
+// writer side, serialized by the caller; ri_set_str() takes a reference
+void ri_set_str(ReadIndex *ri, const std::string &key, RcStr *val);
+void ri_set_int(ReadIndex *ri, const std::string &key, int64_t ival);
+void ri_set_other(ReadIndex *ri, const std::string &key);
+void ri_del(ReadIndex *ri, const std::string &key);
+size_t ri_size(const ReadIndex *ri);
+
+// reader side; returns false if the key does not exist
+bool ri_get(const ReadIndex *ri, const char *key, size_t len, RiValue *out);
@@ -0,0 +1,298 @@
+#include "resp.h"
+#include "server_client.h"
+
+#include <ctype.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int32_t resp_detect(const uint8_t *data, size_t len, size_t max_len){
+    if(len < 4){
+        return -1;
+    }
+    uint32_t n = 0;
+    memcpy(&n, data, 4);
+    if(n <= max_len){
+        return 0;
+    }
+    return (data[0] == '*' || isalpha(data[0])) ? 1 : 0;
+}
+
+size_t resp_find_crlf(const uint8_t *data, size_t from, size_t len){
+    size_t i = from;
+
+#if defined(__SSE2__)
+    // compare 16 bytes against '\r' and the same 16 bytes shifted by one
+    // against '\n'; both masks set means a CRLF starts at that lane
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    for(; i + 17 <= len; i += 16){
+        __m128i a = _mm_loadu_si128((const __m128i *)&data[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&data[i + 1]);
+        __m128i hit = _mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(hit);
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    for(; i + 1 < len; ++i){
+        if(data[i] == '\r' && data[i + 1] == '\n'){
+            return i;
+        }
+    }
+    return len;
+}
+
+void resp_scan_crlf(const uint8_t *data, size_t len, std::vector<uint32_t> &out){
+    for(size_t i = resp_find_crlf(data, 0, len); i < len; i = resp_find_crlf(data, i + 2, len)){
+        out.push_back((uint32_t)i);
+    }
+}
+
+// parses the decimal number in data[pos, end)
+static bool parse_len(const uint8_t *data, size_t pos, size_t end, int64_t &out){
+    if(pos >= end || end - pos > 18){
+        return false;
+    }
+    bool neg = data[pos] == '-';
+    if(neg && ++pos == end){
+        return false;
+    }
+    int64_t v = 0;
+    for(; pos < end; ++pos){
+        if(data[pos] < '0' || data[pos] > '9'){
+            return false;
+        }
+        v = v * 10 + (data[pos] - '0');
+    }
+    out = neg ? -v : v;
+    return true;
+}
+
+int32_t resp_parse_batch(const uint8_t *data, size_t len, size_t max_arg,
+                         std::deque<std::vector<std::string>> &out,
+                         size_t *consumed, RespParse &st){
+    size_t pos = 0;         // start of the command being parsed
+    *consumed = 0;
+
+    // the end of the line starting at `p`, or `len` if it is not complete;
+    // the bytes of a partial line are only looked at once
+    auto line_end = [&](size_t p) -> size_t {
+        size_t eol = resp_find_crlf(data, std::max(p, st.scanned), len);
+        st.scanned = (eol == len) ? (len ? len - 1 : 0) : p;
+        return eol;
+    };
+
+    while(pos < len){
+        // resume a multibulk command whose header was parsed already
+        size_t p = pos;
+        if(st.argc < 0){
+            size_t eol = line_end(p);
+            if(eol == len){
+                break;
+            }
+
+            if(data[p] != '*'){
+                // inline command: space separated words on one line
+                std::vector<std::string> cmd;
+                size_t i = p;
+                while(i < eol){
+                    while(i < eol && data[i] == ' '){
+                        i++;
+                    }
+                    size_t start = i;
+                    while(i < eol && data[i] != ' '){
+                        i++;
+                    }
+                    if(i > start){
+                        cmd.push_back(std::string((const char *)&data[start], i - start));
+                    }
+                }
+                pos = eol + 2;
+                *consumed = pos;
+                if(!cmd.empty()){
+                    out.push_back(std::move(cmd));
+                }
+                continue;
+            }
+
+            if(!parse_len(data, p + 1, eol, st.argc) || st.argc < 0 || (size_t)st.argc > max_arg){
+                return -1;
+            }
+            st.at = eol + 2;
+        }
+        p = st.at;
+
+        while((int64_t)st.cmd.size() < st.argc){
+            size_t eol = line_end(p);
+            if(eol == len){
+                break;
+            }
+            int64_t sz = 0;
+            if(data[p] != '$' || !parse_len(data, p + 1, eol, sz)
+                || sz < 0 || (size_t)sz > max_arg){
+                return -1;
+            }
+
+            // the bulk payload may itself contain CRLFs, so it is skipped by
+            // length, never scanned
+            if(eol + 2 + (size_t)sz + 2 > len){
+                break;
+            }
+            p = eol + 2;
+            if(data[p + sz] != '\r' || data[p + sz + 1] != '\n'){
+                return -1;
+            }
+            st.cmd.push_back(std::string((const char *)&data[p], (size_t)sz));
+            p += (size_t)sz + 2;
+            st.at = p;
+        }
+        if((int64_t)st.cmd.size() < st.argc){
+            break;
+        }
+
+        pos = p;
+        *consumed = pos;
+        st.argc = -1;
+        if(!st.cmd.empty()){
+            out.push_back(std::move(st.cmd));
+        }
+        st.cmd.clear();
+    }
+
+    // the caller drops the consumed bytes, the partial command moves with
+    // the rest
+    st.at = (st.argc < 0) ? 0 : st.at - *consumed;
+    st.scanned = (st.scanned > *consumed) ? st.scanned - *consumed : 0;
+    return 0;
+}
+
+static void resp_line(std::string &out, char type, const char *s, size_t len){
+    out.push_back(type);
+    out.append(s, len);
+    out.append("\r\n", 2);
+}
+
+static void resp_bulk(std::string &out, const char *s, size_t len){
+    char hdr[24];
+    int n = snprintf(hdr, sizeof(hdr), "$%zu\r\n", len);
+    out.append(hdr, n);
+    out.append(s, len);
+    out.append("\r\n", 2);
+}
+
+int32_t resp_from_ser(const uint8_t *data, size_t size, uint32_t ver, std::string &out){
+    if(size < 1){
+        return -1;
+    }
+
+    char buf[48];
+    switch(data[0]){
+    case SER_NIL:
+        if(ver >= 3){
+            out.append("_\r\n");
+        }
+        else{
+            out.append("$-1\r\n");
+        }
+        return 1;
+    case SER_ERR:
+        {
+            if(size < 1 + 8){
+                return -1;
+            }
+            uint32_t len = 0;
+            memcpy(&len, &data[1 + 4], 4);
+            if(size < 1 + 8 + len){
+                return -1;
+            }
+            // an error is a single line, so line breaks in the message go
+            std::string msg = "ERR ";
+            for(uint32_t i = 0; i < len; ++i){
+                char c = (char)data[1 + 8 + i];
+                msg.push_back((c == '\r' || c == '\n') ? ' ' : c);
+            }
+            resp_line(out, '-', msg.data(), msg.size());
+            return 1 + 8 + len;
+        }
+    case SER_STR:
+        {
+            if(size < 1 + 4){
+                return -1;
+            }
+            uint32_t len = 0;
+            memcpy(&len, &data[1], 4);
+            if(size < 1 + 4 + len){
+                return -1;
+            }
+            resp_bulk(out, (const char *)&data[1 + 4], len);
+            return 1 + 4 + len;
+        }
+    case SER_STATUS:
+        {
+            if(size < 1 + 4){
+                return -1;
+            }
+            uint32_t len = 0;
+            memcpy(&len, &data[1], 4);
+            if(size < 1 + 4 + len){
+                return -1;
+            }
+            resp_line(out, '+', (const char *)&data[1 + 4], len);
+            return 1 + 4 + len;
+        }
+    case SER_INT:
+        {
+            if(size < 1 + 8){
+                return -1;
+            }
+            int64_t val = 0;
+            memcpy(&val, &data[1], 8);
+            int n = snprintf(buf, sizeof(buf), "%lld", (long long)val);
+            resp_line(out, ':', buf, n);
+            return 1 + 8;
+        }
+    case SER_DBL:
+        {
+            if(size < 1 + 8){
+                return -1;
+            }
+            double val = 0;
+            memcpy(&val, &data[1], 8);
+            int n = snprintf(buf, sizeof(buf), "%.17g", val);
+            if(ver >= 3){
+                resp_line(out, ',', buf, n);
+            }
+            else{
+                resp_bulk(out, buf, n);
+            }
+            return 1 + 8;
+        }
+    case SER_ARR:
+    case SER_PUSH:
+        {
+            if(size < 1 + 4){
+                return -1;
+            }
+            uint32_t len = 0;
+            memcpy(&len, &data[1], 4);
+            int n = snprintf(buf, sizeof(buf), "%u", len);
+            // pushes only have their own type in RESP3
+            resp_line(out, (data[0] == SER_PUSH && ver >= 3) ? '>' : '*', buf, n);
+            size_t used = 1 + 4;
+            for(uint32_t i = 0; i < len; ++i){
+                int32_t rv = resp_from_ser(&data[used], size - used, ver, out);
+                if(rv < 0){
+                    return -1;
+                }
+                used += (size_t)rv;
+            }
+            return (int32_t)used;
+        }
+    default:
+        return -1;
+    }
+}
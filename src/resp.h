@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+/*
+ * RESP front-end, so standard Redis tooling (redis-cli, redis-benchmark,
+ * memtier, client libraries) can talk to the server.
+ *
+ * Requests are either multibulk arrays
+ *
+ *   *<argc>\r\n$<len>\r\n<arg>\r\n$<len>\r\n<arg>\r\n...
+ *
+ * or inline commands, a single line of space separated words.
+ *
+ * Replies are translated from the native serialization (SER_* tags) to
+ * RESP2, or RESP3 once the client switched with HELLO 3.
+ */
+
+/*
+ * Tells a RESP client from a native one by its first 4 bytes. A native
+ * request starts with a length of at most `max_len`, while RESP starts
+ * with '*' or a command name, which reads as a much bigger number.
+ * Returns 1 for RESP, 0 for native, -1 if more bytes are needed.
+ */
+int32_t resp_detect(const uint8_t *data, size_t len, size_t max_len);
+
+/*
+ * The offset of the '\r' of the first "\r\n" in data[from, len), or `len`
+ * if there is none, using SSE2 to test 16 bytes per step where available.
+ */
+size_t resp_find_crlf(const uint8_t *data, size_t from, size_t len);
+
+// appends the offset of the '\r' of every "\r\n" in data[0, len) to `out`
+void resp_scan_crlf(const uint8_t *data, size_t len, std::vector<uint32_t> &out);
+
+// where resp_parse_batch() stopped in a partial command, so the next call
+// resumes there instead of parsing and scanning it again
+struct RespParse {
+    int64_t argc = -1;              // of the partial multibulk, -1 if none
+    std::vector<std::string> cmd;   // its arguments so far
+    size_t at = 0;                  // the next argument header
+    size_t scanned = 0;             // a partial line has no CRLF before this
+};
+
+/*
+ * Parses every complete command in a pipelined buffer. Only header and
+ * inline lines are searched for their CRLF; bulk payloads are skipped by
+ * their length. `*consumed` is set to the number of bytes used by the
+ * parsed commands; a trailing partial command is left in the buffer, and
+ * `st` remembers how far it was parsed, with offsets past the consumed
+ * bytes, so a big command arriving over many reads is parsed once.
+ * Returns 0 on success and -1 on a protocol error.
+ */
+int32_t resp_parse_batch(const uint8_t *data, size_t len, size_t max_arg,
+                         std::deque<std::vector<std::string>> &out,
+                         size_t *consumed, RespParse &st);
+
+/*
+ * Translates one SER_* serialized value into RESP `ver` (2 or 3).
+ * Returns the number of serialized bytes used, or -1 if malformed.
+ */
+int32_t resp_from_ser(const uint8_t *data, size_t size, uint32_t ver, std::string &out);
@@ -1,8 +1,28 @@
 #include "server_client.h"
 #include "parser.h"
+#include "zset.h"
+#include "quicklist.h"
+#include "resp.h"
+#include "slowlog.h"
+#include "hotkeys.h"
+#include "bloom.h"
+#include "hll.h"
+#include "rcstr.h"
+#include "vlog.h"
+#include "epoch.h"
+#include "readindex.h"
+#include "snapfile.h"
+#include "btree.h"
+#include "capture.h"
+#include "loopprof.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 static void state_req(Conn *conn);
 static void state_res(Conn *conn);
+static void conn_flush_pushes(Conn *conn);
 
 /**
  * A function that prints an error message along with the corresponding error number to the standard error stream.
@@ -82,6 +102,38 @@ void bind_socket(int server_sock, uint16_t port){
     }
 }
 
+/**
+ * Generate a server socket for Unix domain stream connections, bound to
+ * `path`. A file left at `path` by an earlier run is removed first.
+ *
+ * Clients on the same host skip the TCP/IP stack this way; the socket is
+ * served by the same event loop as the TCP one (see accept_connections()).
+ *
+ * @param path the filesystem path of the socket
+ * @return the created and bound server socket
+ */
+int create_unix_server_socket(const char *path){
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sock < 0){
+        die("socket()");
+    }
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)){
+        die("unix socket path too long");
+        close(sock);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    (void)unlink(path);
+    if(bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+        perror("bind");
+        die("bind()");
+    }
+    return sock;
+}
+
 /**
  * Function to listen on a socket.
  *
@@ -98,173 +150,2567 @@ void listen_socket(int server_sock){
 }
 
 /*
- * Function: parse_req
- * 
- * This function takes a pointer to a byte array, the length of the array, and a reference to a vector of strings.
- * 
- * The purpose of this function is to parse a request that follows a specific format. The format is:
- * 
- * | 4-byte little-endian integer representing the number of strings | sequence of strings 
- * (each preceded by a 4-byte integer representing the length of the string)
- * 
- * The function will return 0 if the parsing is successful, and -1 if there is an error.
- * 
- * The function will also populate the vector of strings with the parsed strings.
+ * Response serialization.
+ *
+ * Every response body is a single tagged value. The first byte is one of the
+ * SER_* tags, followed by a tag-specific payload:
+ *
+ *   SER_NIL: nothing
+ *   SER_ERR: 4-byte error code, 4-byte length, message bytes
+ *   SER_STR: 4-byte length, bytes
+ *   SER_STATUS: like SER_STR, a short reply such as OK that is not data
+ *   SER_INT: 8-byte signed integer
+ *   SER_DBL: 8-byte double
+ *   SER_ARR: 4-byte element count, followed by that many tagged values
+ */
+static void out_nil(std::string &out){
+    out.push_back(SER_NIL);
+}
+
+static void out_str(std::string &out, const char *s, size_t size){
+    out.push_back(SER_STR);
+    uint32_t len = (uint32_t)size;
+    out.append((char *)&len, 4);
+    out.append(s, len);
+}
+
+static void out_str(std::string &out, const std::string &val){
+    out_str(out, val.data(), val.size());
+}
+
+static void out_status(std::string &out, const char *s){
+    out.push_back(SER_STATUS);
+    uint32_t len = (uint32_t)strlen(s);
+    out.append((char *)&len, 4);
+    out.append(s, len);
+}
+
+static void out_ok(std::string &out){
+    out_status(out, "OK");
+}
+
+static void out_int(std::string &out, int64_t val){
+    out.push_back(SER_INT);
+    out.append((char *)&val, 8);
+}
+
+static void out_dbl(std::string &out, double val){
+    out.push_back(SER_DBL);
+    out.append((char *)&val, 8);
+}
+
+static void out_err(std::string &out, int32_t code, const std::string &msg){
+    out.push_back(SER_ERR);
+    out.append((char *)&code, 4);
+    uint32_t len = (uint32_t)msg.size();
+    out.append((char *)&len, 4);
+    out.append(msg);
+}
+
+static void out_arr(std::string &out, uint32_t n){
+    out.push_back(SER_ARR);
+    out.append((char *)&n, 4);
+}
+
+// starts an array whose length is not known yet, see out_end_arr()
+static size_t out_begin_arr(std::string &out){
+    out.push_back(SER_ARR);
+    out.append("\0\0\0\0", 4);
+    return out.size() - 4;
+}
+
+static void out_end_arr(std::string &out, size_t ctx, uint32_t n){
+    assert(out[ctx - 1] == SER_ARR);
+    memcpy(&out[ctx], &n, 4);
+}
+
+// string values at least this big are sent by reference
+const size_t k_zero_copy_min = 1024;
+
+/*
+ * Serializes a stored string without copying it: `out` gets the SER_STR
+ * header only, and the connection keeps a reference to the value, which
+ * conn_write_response() sends right after the header. It can only be the
+ * whole reply, not part of an array.
+ */
+static void out_str_ref(Conn *conn, std::string &out, RcStr *val){
+    out.push_back(SER_STR);
+    uint32_t len = (uint32_t)val->str.size();
+    out.append((char *)&len, 4);
+    rcstr_unref(conn->reply_ref);
+    conn->reply_ref = rcstr_ref(val);
+}
+
+/*
+ * Puts a serialized response into the write buffer of a connection, in the
+ * connection's protocol: a 4 byte length header and the value for native
+ * clients, or the value translated to RESP. A value serialized with
+ * out_str_ref() is not copied; only its header and trailer go in the
+ * buffer, around the point where the value is sent from.
+ */
+static void conn_write_response(Conn *conn, std::string &out){
+    if(conn->reply_ref){
+        // the value follows the header in place, see out_str_ref()
+        RcStr *val = conn->reply_ref;
+        conn->reply_ref = NULL;
+        size_t len = val->str.size();
+        if(conn->proto == PROTO_RESP){
+            int n = snprintf((char *)conn->wbuf, sizeof(conn->wbuf), "$%zu\r\n", len);
+            conn->wref_at = (size_t)n;
+            memcpy(&conn->wbuf[n], "\r\n", 2);
+            conn->wbuf_size = (size_t)n + 2;
+        }
+        else{
+            uint32_t wlen = (uint32_t)(out.size() + len);
+            memcpy(&conn->wbuf[0], &wlen, 4);
+            memcpy(&conn->wbuf[4], out.data(), out.size());
+            conn->wref_at = 4 + out.size();
+            conn->wbuf_size = conn->wref_at;
+        }
+        conn->wref = val;
+        conn_flush_pushes(conn);
+        return;
+    }
+
+    std::string frame;
+    if(conn->proto == PROTO_RESP){
+        resp_from_ser((const uint8_t *)out.data(), out.size(), conn->resp_ver, frame);
+    }
+    else{
+        // the 4 byte length header has to hold the size
+        if(out.size() > UINT32_MAX - 4){
+            out.clear();
+            out_err(out, ERR_2BIG, "response is too big");
+        }
+        uint32_t wlen = (uint32_t)out.size();
+        if(4 + out.size() <= sizeof(conn->wbuf)){
+            memcpy(&conn->wbuf[0], &wlen, 4);
+            memcpy(&conn->wbuf[4], out.data(), out.size());
+            conn->wbuf_size = 4 + wlen;
+            conn_flush_pushes(conn);
+            return;
+        }
+        frame.reserve(4 + out.size());
+        frame.append((char *)&wlen, 4);
+        frame.append(out);
+    }
+
+    if(frame.size() <= sizeof(conn->wbuf)){
+        memcpy(&conn->wbuf[0], frame.data(), frame.size());
+        conn->wbuf_size = frame.size();
+    }
+    else{
+        // a reply too big for the write buffer is sent like a referenced
+        // value, from a string of its own, with an empty header before it
+        conn->wref = rcstr_new(frame);
+        conn->wref_at = 0;
+        conn->wbuf_size = 0;
+    }
+    conn_flush_pushes(conn);
+}
+
+// value types stored in the keyspace
+enum {
+    T_STR = 0,
+    T_ZSET = 1,
+    T_LIST = 2,
+    T_BLOOM = 3,
+    T_HLL = 4,
+};
+
+// encodings of a T_STR value
+enum {
+    ENC_RAW = 0,    // bytes in `val`
+    ENC_INT = 1,    // a canonical 64-bit integer in `ival`, in place of `val`
+    ENC_DISK = 2,   // bytes in the value log at the VLoc in `ival`, see tiering
+};
+
+// the value is one word, picked by `type` (and `enc` for strings)
+struct Entry {
+    uint8_t type = T_STR;
+    uint8_t enc = ENC_RAW;
+    uint8_t clock = 1;      // recent accesses, for the tiering clock hand
+    union {
+        RcStr *val = NULL;  // T_STR, ENC_RAW
+        int64_t ival;       // T_STR, ENC_INT or ENC_DISK
+        ZSet *zset;         // T_ZSET
+        QuickList *list;    // T_LIST
+        Bloom *bloom;       // T_BLOOM
+        HLL *hll;           // T_HLL
+    };
+    uint64_t version = 0;   // bumped on every write, for WATCH
+};
+
+static_assert(sizeof(Entry) <= 24, "an entry is a header, its value and a version");
+
+static std::map<std::string, Entry *> g_map;
+
+/*
+ * Tiered storage.
+ *
+ * With tiered-max-memory set, string values are kept in memory up to about
+ * that many bytes, and colder ones are moved to the value log (vlog.h). The
+ * key and its entry stay in g_map, with the ENC_DISK encoding. Cold values
+ * are found by a clock hand that walks the keyspace in key order: every
+ * lookup raises the entry's `clock` (up to k_tier_clock_max), and the hand
+ * lowers it on every pass and moves the value out once it is at 0. A value
+ * on disk is read back with one pread(), and comes back into memory when it
+ * is read again before the hand returns.
+ *
+ * The hand, and compaction of log segments that are mostly dead, run
+ * between polls of the event loop, a bounded amount at a time (tier_cron()).
+ */
+const uint8_t k_tier_clock_max = 3;
+const uint8_t k_tier_promote_clock = 2;
+const size_t k_tier_hand_step = 1000;           // entries per tier_cron()
+const size_t k_tier_compact_step = 1 << 20;     // bytes per tier_cron()
+const double k_tier_compact_live = 0.5;
+const uint64_t k_tier_retry_us = 1000000;       // after a failed spill
+
+static int64_t g_tier_max_memory = 0;           // 0 turns tiering off
+static int64_t g_tier_min_value = 64;           // smaller values stay in memory
+static int64_t g_tier_segment_bytes = 64 << 20;
+static std::string g_tier_dir = ".";
+static VLog *g_vlog = NULL;                     // made on first use
+static uint64_t g_tier_mem = 0;                 // bytes of ENC_RAW values
+static uint64_t g_tier_disk_keys = 0;
+static std::string g_tier_hand;                 // the next key the hand visits
+static int g_tier_compact_seg = -1;             // the segment being compacted
+static uint64_t g_tier_compact_pos = 0;
+static uint64_t g_tier_spill_retry_us = 0;      // the hand waits until then
+
+void tiering_set_dir(const char *dir){
+    g_tier_dir = dir;
+}
+
+// drops the string value of `ent`, wherever it is kept
+static void entry_clear_str(Entry *ent){
+    if(ent->type != T_STR){
+        return;
+    }
+    if(ent->enc == ENC_RAW && ent->val){
+        g_tier_mem -= ent->val->str.size();
+    }
+    else if(ent->enc == ENC_DISK){
+        vlog_release(g_vlog, (VLoc)ent->ival);
+        g_tier_disk_keys--;
+    }
+    if(ent->enc == ENC_RAW){
+        rcstr_unref(ent->val);
+    }
+    ent->enc = ENC_RAW;
+    ent->val = NULL;
+}
+
+// makes `ent` a string held in memory, taking the bytes of `val`
+static void entry_set_raw(Entry *ent, std::string &val){
+    entry_clear_str(ent);
+    ent->enc = ENC_RAW;
+    ent->val = rcstr_new(val);
+    g_tier_mem += ent->val->str.size();
+}
+
+static void entry_del(Entry *ent){
+    entry_clear_str(ent);
+    if(ent->type == T_ZSET){
+        zset_free(ent->zset);
+    }
+    else if(ent->type == T_LIST){
+        ql_free(ent->list);
+    }
+    else if(ent->type == T_BLOOM){
+        bloom_free(ent->bloom);
+    }
+    else if(ent->type == T_HLL){
+        hll_free(ent->hll);
+    }
+    delete ent;
+}
+
+// access counts per key, for HOTKEYS
+static HotKeys *g_hotkeys = hk_new();
+
+static Entry *entry_find(const std::string &key){
+    auto it = g_map.find(key);
+    return (it == g_map.end()) ? NULL : it->second;
+}
+
+/*
+ * Looks a key up on behalf of a command, which counts as one access to it.
+ * Bookkeeping that only needs the entry back uses entry_find().
+ */
+static Entry *entry_lookup(const std::string &key){
+    hk_touch(g_hotkeys, key.data(), key.size());
+    Entry *ent = entry_find(key);
+    if(ent && ent->clock < k_tier_clock_max){
+        ent->clock++;
+    }
+    return ent;
+}
+
+/*
+ * Output buffer limits.
+ *
+ * A connection holds one reply at a time, and is not read from while any
+ * of it is left to send, so a client that stops reading stops its own
+ * requests too. What can still pile up is output others cause, such as
+ * invalidation pushes. A connection whose pending output passes the hard
+ * limit is closed, and so is one that stays over the soft limit for the
+ * soft limit's seconds. 0 turns a limit off.
+ */
+static int64_t g_out_hard_limit = 64 << 20;
+static int64_t g_out_soft_limit = 16 << 20;
+static int64_t g_out_soft_seconds = 60;
+
+// bytes written for a connection and not sent yet
+static uint64_t conn_out_pending(const Conn *conn){
+    size_t ref_len = conn->wref ? conn->wref->str.size() : 0;
+    return conn->wbuf_size + ref_len - conn->wbuf_sent + conn->push_bytes;
+}
+
+// false if the connection went over its output limits and is to be closed
+static bool conn_out_ok(Conn *conn, uint64_t now_us){
+    uint64_t pending = conn_out_pending(conn);
+    if(conn->out_over_hard || (g_out_hard_limit && pending > (uint64_t)g_out_hard_limit)){
+        return false;
+    }
+    if(!g_out_soft_limit || pending <= (uint64_t)g_out_soft_limit){
+        conn->out_soft_since_us = 0;
+        return true;
+    }
+    if(!conn->out_soft_since_us){
+        conn->out_soft_since_us = now_us;
+    }
+    return now_us - conn->out_soft_since_us <= (uint64_t)g_out_soft_seconds * 1000000;
+}
+
+/*
+ * Client side caching.
+ *
+ * A connection with tracking on is told when a key it may have cached
+ * changes, with a push message ["invalidate", [key]] sent between its
+ * replies. In the default mode the server remembers, per key, which
+ * tracking connections read it since its last change, and forgets them
+ * once they are told. In broadcast mode (BCAST) nothing is remembered;
+ * the connection is told about every change to keys under its prefixes.
+ *
+ * Connections are remembered by id rather than pointer, so a closed
+ * connection only leaves stale ids behind, which are skipped. The table
+ * holds at most CONFIG tracking-table-max-keys keys (0 for no limit): a new
+ * key past that evicts another one, whose readers are told it changed, so
+ * stale ids do not pile up either. A key too long for a push is reported
+ * as ["invalidate", nil], which tells the client to drop its whole cache.
+ */
+static int64_t g_tracking_max_keys = 1000000;
+static uint64_t g_conn_id_seq = 0;
+static std::unordered_map<uint64_t, Conn *> g_tracking_conns;
+static std::unordered_map<std::string, std::unordered_set<uint64_t>> g_tracked_keys;
+static std::map<std::string, std::set<uint64_t>> g_bcast_prefixes;
+
+// false if the push can never fit in the write buffer, and is not sent
+static bool conn_push(Conn *conn, const std::string &ser){
+    std::string frame;
+    if(conn->proto == PROTO_RESP){
+        resp_from_ser((const uint8_t *)ser.data(), ser.size(), conn->resp_ver, frame);
+    }
+    else{
+        uint32_t len = (uint32_t)ser.size();
+        frame.append((char *)&len, 4);
+        frame.append(ser);
+    }
+    if(frame.size() > sizeof(conn->wbuf)){
+        return false;
+    }
+    // one past the hard limit is dropped, and the connection is closed
+    if(g_out_hard_limit && conn_out_pending(conn) + frame.size() > (uint64_t)g_out_hard_limit){
+        conn->out_over_hard = true;
+        return true;
+    }
+    conn->push_bytes += frame.size();
+    conn->pushes.push_back(std::move(frame));
+    return true;
+}
+
+// moves as many queued pushes as fit behind the data in the write buffer
+static void conn_flush_pushes(Conn *conn){
+    while(!conn->pushes.empty()){
+        std::string &frame = conn->pushes.front();
+        if(conn->wbuf_size + frame.size() > sizeof(conn->wbuf)){
+            return;
+        }
+        memcpy(&conn->wbuf[conn->wbuf_size], frame.data(), frame.size());
+        conn->wbuf_size += frame.size();
+        conn->push_bytes -= frame.size();
+        conn->pushes.pop_front();
+    }
+}
+
+// ["invalidate", [key]], or ["invalidate", nil] for every key
+static void out_invalidate(std::string &out, const std::string *key){
+    out.push_back(SER_PUSH);
+    uint32_t n = 2;
+    out.append((char *)&n, 4);
+    out_str(out, "invalidate", 10);
+    if(key){
+        out_arr(out, 1);
+        out_str(out, *key);
+    }
+    else{
+        out_nil(out);
+    }
+}
+
+static void push_invalidate(uint64_t id, const std::string &key){
+    auto it = g_tracking_conns.find(id);
+    if(it == g_tracking_conns.end() || !it->second->tracking){
+        return;
+    }
+    std::string ser;
+    out_invalidate(ser, &key);
+    if(!conn_push(it->second, ser)){
+        ser.clear();
+        out_invalidate(ser, NULL);
+        conn_push(it->second, ser);
+    }
+}
+
+static void tracking_invalidate(const std::string &key){
+    if(!g_tracked_keys.empty()){
+        auto it = g_tracked_keys.find(key);
+        if(it != g_tracked_keys.end()){
+            for(uint64_t id : it->second){
+                push_invalidate(id, key);
+            }
+            g_tracked_keys.erase(it);
+        }
+    }
+    for(auto &prefix : g_bcast_prefixes){
+        if(0 == key.compare(0, prefix.first.size(), prefix.first)){
+            for(uint64_t id : prefix.second){
+                push_invalidate(id, key);
+            }
+        }
+    }
+}
+
+// called with every key a tracking connection reads
+static void tracking_remember(Conn *conn, const std::string &key){
+    auto it = g_tracked_keys.find(key);
+    if(it == g_tracked_keys.end()){
+        while(g_tracking_max_keys && !g_tracked_keys.empty()
+            && g_tracked_keys.size() >= (uint64_t)g_tracking_max_keys){
+            auto victim = g_tracked_keys.begin();
+            for(uint64_t id : victim->second){
+                push_invalidate(id, victim->first);
+            }
+            g_tracked_keys.erase(victim);
+        }
+        it = g_tracked_keys.emplace(key, std::unordered_set<uint64_t>()).first;
+    }
+    it->second.insert(conn->id);
+}
+
+static void tracking_off(Conn *conn){
+    for(const std::string &prefix : conn->tracking_prefixes){
+        auto it = g_bcast_prefixes.find(prefix);
+        if(it != g_bcast_prefixes.end()){
+            it->second.erase(conn->id);
+            if(it->second.empty()){
+                g_bcast_prefixes.erase(it);
+            }
+        }
+    }
+    conn->tracking_prefixes.clear();
+    conn->tracking = false;
+    conn->tracking_bcast = false;
+    g_tracking_conns.erase(conn->id);
+    // with no tracking connection left, every id in the table is stale
+    if(g_tracking_conns.empty()){
+        g_tracked_keys.clear();
+    }
+}
+
+/*
+ * With I/O threads (see set_io_threads()), GET is answered from a copy of
+ * the keyspace in a read index, which every change to a key is mirrored
+ * to here. It does not exist otherwise.
+ */
+static int g_io_threads = 0;
+static ReadIndex *g_rindex = NULL;
+
+static void rindex_sync(const std::string &key, Entry *ent){
+    if(!g_rindex){
+        return;
+    }
+    if(!ent){
+        ri_del(g_rindex, key);
+    }
+    else if(ent->type == T_STR && ent->enc == ENC_RAW){
+        ri_set_str(g_rindex, key, ent->val);
+    }
+    else if(ent->type == T_STR && ent->enc == ENC_INT){
+        ri_set_int(g_rindex, key, ent->ival);
+    }
+    else{
+        ri_set_other(g_rindex, key);
+    }
+}
+
+// source of entry versions
+static uint64_t g_version_seq = 0;
+// the version of the last delete, which every missing key reads as: a key
+// created and deleted again after a WATCH still changes its version, at
+// the price of WATCH on a missing key also failing on unrelated deletes
+static uint64_t g_delete_version = 0;
+
+/*
+ * Called after every write to a key, with `ent` being NULL if the write
+ * deleted it. Gives the entry a new version, so WATCH can tell it changed,
+ * tells tracking connections that may have cached the key, and updates the
+ * read index.
+ */
+static void touch_key(const std::string &key, Entry *ent){
+    if(ent){
+        ent->version = ++g_version_seq;
+    }
+    else{
+        g_delete_version = ++g_version_seq;
+    }
+    tracking_invalidate(key);
+    rindex_sync(key, ent);
+}
+
+static uint64_t key_version(const std::string &key){
+    Entry *ent = entry_find(key);
+    return ent ? ent->version : g_delete_version;
+}
+
+/*
+ * Ordered key index, kept while CONFIG ordered-index is 1, for RANGE and
+ * PREFIXSCAN. It holds the keys only, in a B+tree (btree.h), so scans do
+ * not depend on the keyspace itself being ordered.
+ */
+static int64_t g_ordered_index = 0;
+static BTree *g_oindex = NULL;
+
+// adds a key that does not exist yet
+static void key_add(const std::string &key, Entry *ent){
+    g_map[key] = ent;
+    if(g_oindex){
+        bt_insert(g_oindex, key);
+    }
+}
+
+// builds the ordered index from the keyspace, or drops it when turned off
+static void oindex_rebuild(){
+    if(g_oindex){
+        bt_free(g_oindex);
+        g_oindex = NULL;
+    }
+    if(g_ordered_index){
+        g_oindex = bt_new();
+        for(auto &it : g_map){
+            bt_insert(g_oindex, it.first);
+        }
+    }
+}
+
+// removes a key and frees its value
+static void key_delete(const std::string &key){
+    auto it = g_map.find(key);
+    if(it == g_map.end()){
+        return;
+    }
+    entry_del(it->second);
+    g_map.erase(it);
+    if(g_oindex){
+        bt_erase(g_oindex, key);
+    }
+    touch_key(key, NULL);
+}
+
+// brings a value in the value log back into memory
+static bool tier_load(const std::string &key, Entry *ent){
+    std::string val;
+    if(!vlog_read(g_vlog, (VLoc)ent->ival, val)){
+        return false;
+    }
+    entry_set_raw(ent, val);
+    rindex_sync(key, ent);
+    return true;
+}
+
+// moves the value of `ent` to the value log
+static bool tier_spill(const std::string &key, Entry *ent){
+    if(!g_vlog){
+        g_vlog = vlog_new(g_tier_dir.c_str(), (size_t)g_tier_segment_bytes);
+        if(!g_vlog){
+            return false;
+        }
+    }
+    const std::string &val = ent->val->str;
+    VLoc loc = vlog_append(g_vlog, key.data(), key.size(), val.data(), val.size());
+    if(loc == k_vloc_none){
+        return false;
+    }
+    entry_clear_str(ent);
+    ent->enc = ENC_DISK;
+    ent->ival = (int64_t)loc;
+    g_tier_disk_keys++;
+    rindex_sync(key, ent);
+    return true;
+}
+
+static uint64_t get_monotonic_usec(){
+    timespec tv = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return uint64_t(tv.tv_sec) * 1000000 + tv.tv_nsec / 1000;
+}
+
+// advances the clock hand by up to `budget` entries; returns how many
+// values it looked at
+static size_t tier_hand(size_t budget){
+    size_t work = 0;
+    auto it = g_map.lower_bound(g_tier_hand);
+    for(; budget > 0 && g_tier_mem > (uint64_t)g_tier_max_memory; --budget){
+        if(it == g_map.end()){
+            it = g_map.begin();
+            if(it == g_map.end()){
+                break;
+            }
+        }
+        Entry *ent = it->second;
+        if(ent->type == T_STR && ent->enc == ENC_RAW
+            && ent->val->str.size() >= (size_t)g_tier_min_value){
+            if(ent->clock > 0){
+                ent->clock--;
+            }
+            else if(!tier_spill(it->first, ent)){
+                // the log is full or failing, which will not change soon
+                g_tier_spill_retry_us = get_monotonic_usec() + k_tier_retry_us;
+                break;
+            }
+            work++;
+        }
+        ++it;
+    }
+    g_tier_hand = (it == g_map.end()) ? std::string() : it->first;
+    return work;
+}
+
+/*
+ * Copies the live values of a mostly dead segment to the end of the log,
+ * up to about `budget` bytes per call, and drops the segment once they are
+ * all moved. A record is live if its key's entry still points at it.
+ * Returns how many bytes it read.
+ */
+static size_t tier_compact(size_t budget){
+    if(!g_vlog){
+        return 0;
+    }
+    if(g_tier_compact_seg < 0){
+        g_tier_compact_seg = vlog_pick(g_vlog, k_tier_compact_live);
+        g_tier_compact_pos = 0;
+        if(g_tier_compact_seg < 0){
+            return 0;
+        }
+    }
+
+    uint32_t seg = (uint32_t)g_tier_compact_seg;
+    std::string key, val;
+    VLoc loc = 0;
+    size_t done = 0;
+    while(done < budget){
+        if(!vlog_scan(g_vlog, seg, &g_tier_compact_pos, key, val, &loc)){
+            // a segment that could not be read to the end is kept, and not
+            // picked again while it holds live values
+            if(!vlog_drop(g_vlog, seg)){
+                vlog_skip(g_vlog, seg);
+            }
+            g_tier_compact_seg = -1;
+            return done + 1;
+        }
+        done += key.size() + val.size();
+        Entry *ent = entry_find(key);
+        if(!ent || ent->type != T_STR || ent->enc != ENC_DISK || (VLoc)ent->ival != loc){
+            continue;
+        }
+        VLoc moved = vlog_append(g_vlog, key.data(), key.size(), val.data(), val.size());
+        if(moved == k_vloc_none){
+            // no room in the log, the value goes back to memory
+            entry_set_raw(ent, val);
+            rindex_sync(key, ent);
+            continue;
+        }
+        vlog_release(g_vlog, loc);
+        ent->ival = (int64_t)moved;
+    }
+    return done;
+}
+
+/*
+ * One bounded step of tiering work, run by the event loop between polls.
+ * Returns true if there is more to do right away.
+ */
+static bool tier_cron(){
+    size_t work = 0;
+    if(g_tier_max_memory > 0 && g_tier_mem > (uint64_t)g_tier_max_memory
+        && get_monotonic_usec() >= g_tier_spill_retry_us){
+        work += tier_hand(k_tier_hand_step);
+    }
+    work += tier_compact(k_tier_compact_step);
+    return work > 0;
+}
+
+// TIERING: memory and value log usage, as name/value pairs
+static void do_tiering(std::string &out){
+    out_arr(out, 10);
+    out_str(out, "memory-bytes", 12);
+    out_int(out, (int64_t)g_tier_mem);
+    out_str(out, "disk-keys", 9);
+    out_int(out, (int64_t)g_tier_disk_keys);
+    out_str(out, "disk-live-bytes", 15);
+    out_int(out, g_vlog ? (int64_t)vlog_live_bytes(g_vlog) : 0);
+    out_str(out, "disk-file-bytes", 15);
+    out_int(out, g_vlog ? (int64_t)vlog_file_bytes(g_vlog) : 0);
+    out_str(out, "disk-segments", 13);
+    out_int(out, g_vlog ? (int64_t)vlog_segments(g_vlog) : 0);
+}
+
+/*
+ * Decimal strings of the integers in [0, k_shared_ints), so GET on a
+ * typical counter serializes a prebuilt string instead of formatting. The
+ * table is built by the first caller, which the compiler makes thread
+ * safe, and only read after that, by I/O threads too (try_read_fast()).
+ */
+const int64_t k_shared_ints = 10000;
+
+static const std::vector<std::string> &shared_ints(){
+    static const std::vector<std::string> table = []{
+        std::vector<std::string> t;
+        t.reserve(k_shared_ints);
+        for(int64_t i = 0; i < k_shared_ints; ++i){
+            t.push_back(std::to_string(i));
+        }
+        return t;
+    }();
+    return table;
+}
+
+static void out_int_as_str(std::string &out, int64_t val){
+    if(val >= 0 && val < k_shared_ints){
+        return out_str(out, shared_ints()[val]);
+    }
+    char buf[24];
+    int n = snprintf(buf, sizeof(buf), "%lld", (long long)val);
+    return out_str(out, buf, (size_t)n);
+}
+
+static bool str2dbl(const std::string &s, double &out){
+    char *endp = NULL;
+    out = strtod(s.c_str(), &endp);
+    return endp == s.c_str() + s.size() && !s.empty() && !isnan(out);
+}
+
+static bool str2int(const std::string &s, int64_t &out){
+    char *endp = NULL;
+    errno = 0;
+    out = strtoll(s.c_str(), &endp, 10);
+    return endp == s.c_str() + s.size() && !s.empty() && errno == 0;
+}
+
+/*
+ * Resolves negative indexes of an inclusive [start, stop] range over
+ * `len` items and clamps it. Returns false if the range is empty.
+ */
+static bool normalize_range(int64_t &start, int64_t &stop, int64_t len){
+    if(start < 0){
+        start = (start + len < 0) ? 0 : start + len;
+    }
+    if(stop < 0){
+        stop += len;
+    }
+    if(stop >= len){
+        stop = len - 1;
+    }
+    return start <= stop && stop >= 0;
+}
+
+/*
+ * Function: do_get
+ *
+ * This function is called when the server receives a "GET" command.
+ * It retrieves the value associated with the given key from a global map.
+ * If the key is not found in the map, it replies with a nil. Otherwise,
+ * it serializes the value as a string into `out`.
+ *
+ * Parameters:
+ * - `cmd`: a vector of strings, where the first element is the command ("GET")
+ *          and the second element is the key to retrieve.
+ * - `out`: the response being built.
+ */
+static void do_get(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+        // Check if the key exists in the map
+        Entry *ent = entry_lookup(cmd[1]);
+        if(!ent){
+            // If the key is not found, reply with a nil
+            return out_nil(out);
+        }
+
+        // Only plain strings can be read with GET
+        if(ent->type != T_STR){
+            return out_err(out, ERR_TYPE, "expect string type");
+        }
+
+        // Integers are kept binary and only turned into text for the reply
+        if(ent->enc == ENC_INT){
+            return out_int_as_str(out, ent->ival);
+        }
+
+        // A value on disk is served from a copy until it is read again
+        if(ent->enc == ENC_DISK){
+            if(ent->clock < k_tier_promote_clock){
+                std::string val;
+                if(!vlog_read(g_vlog, (VLoc)ent->ival, val)){
+                    return out_err(out, ERR_UNKNOWN, "can not read the value log");
+                }
+                if(val.size() >= k_zero_copy_min && !conn->in_exec){
+                    RcStr *rc = rcstr_new(val);
+                    out_str_ref(conn, out, rc);
+                    rcstr_unref(rc);
+                    return;
+                }
+                return out_str(out, val);
+            }
+            if(!tier_load(cmd[1], ent)){
+                return out_err(out, ERR_UNKNOWN, "can not read the value log");
+            }
+        }
+
+        // Big values are sent from the stored copy, others are copied
+        const std::string &val = ent->val->str;
+        if(val.size() >= k_zero_copy_min && !conn->in_exec){
+            return out_str_ref(conn, out, ent->val);
+        }
+        return out_str(out, val);
+}
+
+/*
+ * This function is called when the server receives a "SET" command.
+ * It sets the value associated with the given key in a global map.
+ * The parameters are as follows:
+ * - `cmd`: a vector of strings, where the first element is the command ("SET")
+ *          and the second element is the key, and the third element is the value.
+ * - `out`: the response being built, which is always OK.
+ *
+ * The function updates the global map by associating the value of `cmd[2]`
+ * (the third element of `cmd`) with the key `cmd[1]` (the second element of `cmd`).
+ * A key holding another type is overwritten. Values that are canonical
+ * integers are stored as ENC_INT.
+ */
+static void do_set(std::vector<std::string> &cmd, std::string &out){
+        Entry *ent = entry_lookup(cmd[1]);
+        if(ent && ent->type != T_STR){
+            // Overwriting a key of another type drops the old value
+            key_delete(cmd[1]);
+            ent = NULL;
+        }
+        if(!ent){
+            ent = new Entry();
+            key_add(cmd[1], ent);
+        }
+
+        // Associate the value of `cmd[2]` with the key `cmd[1]` in the global map.
+        int64_t ival = 0;
+        if(str2canonical_int(cmd[2], ival)){
+            entry_clear_str(ent);
+            ent->enc = ENC_INT;
+            ent->ival = ival;
+        }
+        else{
+            // takes the buffer of `cmd[2]`; a reply still sending the old
+            // value keeps its own reference
+            entry_set_raw(ent, cmd[2]);
+        }
+        touch_key(cmd[1], ent);
+        return out_ok(out);
+}
+
+/*
+ * INCR/DECR/INCRBY/DECRBY: adds `delta` to the integer at `cmd[1]`.
+ *
+ * A missing key counts as 0. A raw string that parses as an integer is
+ * converted to ENC_INT on first use, after which every update happens in
+ * place on the entry, with no allocation and no parsing. The reply is the
+ * new value.
+ */
+static void do_incr(std::vector<std::string> &cmd, int64_t delta, std::string &out){
+        Entry *ent = entry_lookup(cmd[1]);
+        if(ent && ent->type != T_STR){
+            return out_err(out, ERR_TYPE, "expect string type");
+        }
+        if(ent && ent->enc == ENC_DISK && !tier_load(cmd[1], ent)){
+            return out_err(out, ERR_UNKNOWN, "can not read the value log");
+        }
+        if(!ent){
+            ent = new Entry();
+            ent->enc = ENC_INT;
+            key_add(cmd[1], ent);
+        }
+        else if(ent->enc == ENC_RAW){
+            int64_t ival = 0;
+            if(!str2canonical_int(ent->val->str, ival)){
+                return out_err(out, ERR_ARG, "value is not an integer or out of range");
+            }
+            entry_clear_str(ent);
+            ent->enc = ENC_INT;
+            ent->ival = ival;
+        }
+
+        int64_t res = 0;
+        if(__builtin_add_overflow(ent->ival, delta, &res)){
+            return out_err(out, ERR_ARG, "increment or decrement would overflow");
+        }
+        ent->ival = res;
+        touch_key(cmd[1], ent);
+        return out_int(out, res);
+}
+
+// INCRBY/DECRBY key delta
+static void do_incrby(std::vector<std::string> &cmd, bool negate, std::string &out){
+        int64_t delta = 0;
+        if(!str2int(cmd[2], delta)){
+            return out_err(out, ERR_ARG, "value is not an integer or out of range");
+        }
+        if(negate){
+            if(delta == INT64_MIN){
+                return out_err(out, ERR_ARG, "decrement would overflow");
+            }
+            delta = -delta;
+        }
+        return do_incr(cmd, delta, out);
+}
+
+
+/*
+ * This function is called when the server receives a "DEL" command.
+ * It deletes the key-value pair associated with the given key from the global map.
+ * The parameters are as follows:
+ * - `cmd`: a vector of strings, where the first element is the command ("DEL")
+ *          and the second element is the key.
+ * - `out`: the response being built, an integer with the number of deleted keys.
+ *
+ * The function updates the global map by erasing the key-value pair from the map,
+ * where the key is the second element of the `cmd` vector.
+ */
+static void do_del(std::vector<std::string> &cmd, std::string &out){
+        // Erase the key-value pair from the global map, where the key is the second element of `cmd`.
+        Entry *ent = entry_lookup(cmd[1]);
+        if(ent){
+            key_delete(cmd[1]);
+        }
+        return out_int(out, ent ? 1 : 0);
+}
+
+/*
+ * Looks up a sorted set for a command.
+ * Returns NULL if the key is missing. If the key holds another type,
+ * an error reply is written and `*bad` is set.
+ */
+static ZSet *expect_zset(const std::string &key, std::string &out, bool *bad){
+    *bad = false;
+    Entry *ent = entry_lookup(key);
+    if(!ent){
+        return NULL;
+    }
+    if(ent->type != T_ZSET){
+        out_err(out, ERR_TYPE, "expect zset");
+        *bad = true;
+        return NULL;
+    }
+    return ent->zset;
+}
+
+// ZADD key score member [score member ...]
+static void do_zadd(std::vector<std::string> &cmd, std::string &out){
+    std::vector<double> scores;
+    for(size_t i = 2; i < cmd.size(); i += 2){
+        double score = 0;
+        if(!str2dbl(cmd[i], score)){
+            return out_err(out, ERR_ARG, "expect fp number");
+        }
+        scores.push_back(score);
+    }
+
+    Entry *ent = entry_lookup(cmd[1]);
+    if(!ent){
+        ent = new Entry();
+        ent->type = T_ZSET;
+        ent->zset = zset_new();
+        key_add(cmd[1], ent);
+    }
+    else if(ent->type != T_ZSET){
+        return out_err(out, ERR_TYPE, "expect zset");
+    }
+
+    int64_t added = 0;
+    for(size_t i = 3, j = 0; i < cmd.size(); i += 2, ++j){
+        added += zset_add(ent->zset, cmd[i].data(), cmd[i].size(), scores[j]);
+    }
+    touch_key(cmd[1], ent);
+    return out_int(out, added);
+}
+
+// ZREM key member [member ...]
+static void do_zrem(std::vector<std::string> &cmd, std::string &out){
+    bool bad = false;
+    ZSet *zset = expect_zset(cmd[1], out, &bad);
+    if(bad){
+        return;
+    }
+    if(!zset){
+        return out_int(out, 0);
+    }
+
+    int64_t removed = 0;
+    for(size_t i = 2; i < cmd.size(); ++i){
+        removed += zset_rem(zset, cmd[i].data(), cmd[i].size());
+    }
+
+    // an empty sorted set is not kept around
+    if(zset_len(zset) == 0){
+        key_delete(cmd[1]);
+    }
+    else if(removed){
+        touch_key(cmd[1], entry_find(cmd[1]));
+    }
+    return out_int(out, removed);
+}
+
+// ZSCORE key member
+static void do_zscore(std::vector<std::string> &cmd, std::string &out){
+    bool bad = false;
+    ZSet *zset = expect_zset(cmd[1], out, &bad);
+    if(bad){
+        return;
+    }
+    if(!zset){
+        return out_nil(out);
+    }
+
+    double score = 0;
+    if(!zset_score(zset, cmd[2].data(), cmd[2].size(), &score)){
+        return out_nil(out);
+    }
+    return out_dbl(out, score);
+}
+
+// ZRANK key member
+static void do_zrank(std::vector<std::string> &cmd, std::string &out){
+    bool bad = false;
+    ZSet *zset = expect_zset(cmd[1], out, &bad);
+    if(bad){
+        return;
+    }
+    if(!zset){
+        return out_nil(out);
+    }
+
+    int64_t rank = zset_rank(zset, cmd[2].data(), cmd[2].size());
+    if(rank < 0){
+        return out_nil(out);
+    }
+    return out_int(out, rank);
+}
+
+struct ZRangeOut {
+    std::string *out;
+    bool withscores;
+    uint32_t n;
+};
+
+static void zrange_visit(const char *name, size_t len, double score, void *arg){
+    ZRangeOut *ctx = (ZRangeOut *)arg;
+    out_str(*ctx->out, name, len);
+    ctx->n++;
+    if(ctx->withscores){
+        out_dbl(*ctx->out, score);
+        ctx->n++;
+    }
+}
+
+// ZRANGE key start stop [WITHSCORES]
+static void do_zrange(std::vector<std::string> &cmd, std::string &out){
+    int64_t start = 0, stop = 0;
+    if(!str2int(cmd[2], start) || !str2int(cmd[3], stop)){
+        return out_err(out, ERR_ARG, "expect int");
+    }
+    bool withscores = false;
+    if(cmd.size() == 5){
+        if(0 != strcasecmp(cmd[4].c_str(), "withscores")){
+            return out_err(out, ERR_ARG, "syntax error");
+        }
+        withscores = true;
+    }
+
+    bool bad = false;
+    ZSet *zset = expect_zset(cmd[1], out, &bad);
+    if(bad){
+        return;
+    }
+    if(!zset){
+        return out_arr(out, 0);
+    }
+
+    // negative indexes count from the end
+    ZRangeOut ctx = {&out, withscores, 0};
+    size_t arr = out_begin_arr(out);
+    if(normalize_range(start, stop, (int64_t)zset_len(zset))){
+        zset_range_by_rank(zset, (size_t)start, (size_t)stop, zrange_visit, &ctx);
+    }
+    out_end_arr(out, arr, ctx.n);
+}
+
+// parses a ZRANGEBYSCORE bound: a number, "-inf"/"+inf", or "(" for exclusive
+static bool parse_score_bound(const std::string &s, double &val, bool &ex){
+    ex = !s.empty() && s[0] == '(';
+    return str2dbl(ex ? s.substr(1) : s, val);
+}
+
+// ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count]
+static void do_zrangebyscore(std::vector<std::string> &cmd, std::string &out){
+    ZRangeSpec range;
+    if(!parse_score_bound(cmd[2], range.min, range.minex)
+        || !parse_score_bound(cmd[3], range.max, range.maxex)){
+        return out_err(out, ERR_ARG, "min or max is not a float");
+    }
+
+    bool withscores = false;
+    int64_t offset = 0, limit = -1;
+    for(size_t i = 4; i < cmd.size(); ++i){
+        if(0 == strcasecmp(cmd[i].c_str(), "withscores")){
+            withscores = true;
+        }
+        else if(0 == strcasecmp(cmd[i].c_str(), "limit") && i + 2 < cmd.size()){
+            if(!str2int(cmd[i + 1], offset) || !str2int(cmd[i + 2], limit)){
+                return out_err(out, ERR_ARG, "expect int");
+            }
+            i += 2;
+        }
+        else{
+            return out_err(out, ERR_ARG, "syntax error");
+        }
+    }
+
+    bool bad = false;
+    ZSet *zset = expect_zset(cmd[1], out, &bad);
+    if(bad){
+        return;
+    }
+    if(!zset){
+        return out_arr(out, 0);
+    }
+
+    ZRangeOut ctx = {&out, withscores, 0};
+    size_t arr = out_begin_arr(out);
+    if(offset >= 0){
+        zset_range_by_score(zset, range, (size_t)offset,
+                            limit < 0 ? SIZE_MAX : (size_t)limit,
+                            zrange_visit, &ctx);
+    }
+    out_end_arr(out, arr, ctx.n);
+}
+
+/*
+ * Looks up a list for a command.
+ * Returns NULL if the key is missing. If the key holds another type,
+ * an error reply is written and `*bad` is set.
+ */
+static QuickList *expect_list(const std::string &key, std::string &out, bool *bad){
+    *bad = false;
+    Entry *ent = entry_lookup(key);
+    if(!ent){
+        return NULL;
+    }
+    if(ent->type != T_LIST){
+        out_err(out, ERR_TYPE, "expect list");
+        *bad = true;
+        return NULL;
+    }
+    return ent->list;
+}
+
+/*
+ * Connections parked in BLPOP, per key, in the order they blocked.
+ * A key lands in g_ready_keys when a push makes it non-empty while someone
+ * waits on it; the waiters are served once the current command is done.
+ */
+static std::map<std::string, std::deque<Conn *>> g_blocked;
+static std::vector<std::string> g_ready_keys;
+
+static void signal_list_ready(const std::string &key){
+    if(g_blocked.count(key)){
+        g_ready_keys.push_back(key);
+    }
+}
+
+// removes a connection from the wait queue of every key it blocks on
+static void unblock_conn(Conn *conn){
+    for(const std::string &key : conn->block_keys){
+        auto it = g_blocked.find(key);
+        if(it == g_blocked.end()){
+            continue;
+        }
+        std::deque<Conn *> &waiters = it->second;
+        for(auto w = waiters.begin(); w != waiters.end(); ++w){
+            if(*w == conn){
+                waiters.erase(w);
+                break;
+            }
+        }
+        if(waiters.empty()){
+            g_blocked.erase(it);
+        }
+    }
+    conn->block_keys.clear();
+    conn->block_deadline_us = 0;
+}
+
+/*
+ * Puts a response into the write buffer of a blocked connection and moves it
+ * to STATE_RES, so the event loop flushes it on the next POLLOUT.
+ */
+static void reply_blocked(Conn *conn, std::string &out){
+    unblock_conn(conn);
+    assert(conn->wbuf_size == 0);
+    conn_write_response(conn, out);
+    conn->state = STATE_RES;
+}
+
+static void list_pop_reply(const std::string &key, QuickList *list, std::string &out){
+    std::string val;
+    ql_pop(list, QL_HEAD, val);
+    out_arr(out, 2);
+    out_str(out, key);
+    out_str(out, val);
+    if(ql_len(list) == 0){
+        key_delete(key);
+    }
+    else{
+        touch_key(key, entry_find(key));
+    }
+}
+
+// true if the peer closed a connection, leaving the bytes it sent unread
+static bool conn_hung_up(Conn *conn){
+    char c = 0;
+    ssize_t rv = recv(conn->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return rv == 0 || (rv < 0 && errno != EAGAIN && errno != EINTR);
+}
+
+// hands elements of lists that became non-empty to the BLPOP waiters
+static void serve_ready_keys(){
+    while(!g_ready_keys.empty()){
+        std::vector<std::string> keys;
+        keys.swap(g_ready_keys);
+        for(const std::string &key : keys){
+            while(g_blocked.count(key)){
+                Entry *ent = entry_lookup(key);
+                if(!ent || ent->type != T_LIST){
+                    break;
+                }
+                Conn *conn = g_blocked[key].front();
+                if(conn_hung_up(conn)){
+                    // closed while it waited, its event loop frees it
+                    unblock_conn(conn);
+                    continue;
+                }
+                std::string out;
+                list_pop_reply(key, ent->list, out);
+                reply_blocked(conn, out);
+            }
+        }
+    }
+}
+
+// replies nil to BLPOP waiters whose timeout has passed
+static void expire_blocked(std::vector<Conn *> &fd2conn, uint64_t now_us){
+    for(Conn *conn : fd2conn){
+        if(conn && conn->state == STATE_BLOCK && conn->block_deadline_us
+            && conn->block_deadline_us <= now_us){
+            std::string out;
+            out_nil(out);
+            reply_blocked(conn, out);
+        }
+    }
+}
+
+// milliseconds until the earliest BLPOP timeout, capped at `cap_ms`
+static int next_block_timeout_ms(std::vector<Conn *> &fd2conn, uint64_t now_us, int cap_ms){
+    uint64_t timeout_ms = (uint64_t)cap_ms;
+    for(Conn *conn : fd2conn){
+        if(conn && conn->state == STATE_BLOCK && conn->block_deadline_us){
+            uint64_t left = 0;
+            if(conn->block_deadline_us > now_us){
+                left = (conn->block_deadline_us - now_us + 999) / 1000;
+            }
+            if(left < timeout_ms){
+                timeout_ms = left;
+            }
+        }
+    }
+    return (int)timeout_ms;
+}
+
+// LPUSH/RPUSH key element [element ...]
+static void do_push(std::vector<std::string> &cmd, uint32_t where, std::string &out){
+    Entry *ent = entry_lookup(cmd[1]);
+    if(!ent){
+        ent = new Entry();
+        ent->type = T_LIST;
+        ent->list = ql_new();
+        key_add(cmd[1], ent);
+    }
+    else if(ent->type != T_LIST){
+        return out_err(out, ERR_TYPE, "expect list");
+    }
+
+    for(size_t i = 2; i < cmd.size(); ++i){
+        ql_push(ent->list, where, cmd[i].data(), cmd[i].size());
+    }
+    out_int(out, (int64_t)ql_len(ent->list));
+    touch_key(cmd[1], ent);
+    signal_list_ready(cmd[1]);
+}
+
+// LPOP/RPOP key
+static void do_pop(std::vector<std::string> &cmd, uint32_t where, std::string &out){
+    bool bad = false;
+    QuickList *list = expect_list(cmd[1], out, &bad);
+    if(bad){
+        return;
+    }
+    if(!list){
+        return out_nil(out);
+    }
+
+    std::string val;
+    ql_pop(list, where, val);
+    if(ql_len(list) == 0){
+        key_delete(cmd[1]);
+    }
+    else{
+        touch_key(cmd[1], entry_find(cmd[1]));
+    }
+    return out_str(out, val);
+}
+
+// LLEN key
+static void do_llen(std::vector<std::string> &cmd, std::string &out){
+    bool bad = false;
+    QuickList *list = expect_list(cmd[1], out, &bad);
+    if(bad){
+        return;
+    }
+    return out_int(out, list ? (int64_t)ql_len(list) : 0);
+}
+
+static void lrange_visit(const char *data, size_t len, void *arg){
+    out_str(*(std::string *)arg, data, len);
+}
+
+// LRANGE key start stop
+static void do_lrange(std::vector<std::string> &cmd, std::string &out){
+    int64_t start = 0, stop = 0;
+    if(!str2int(cmd[2], start) || !str2int(cmd[3], stop)){
+        return out_err(out, ERR_ARG, "expect int");
+    }
+
+    bool bad = false;
+    QuickList *list = expect_list(cmd[1], out, &bad);
+    if(bad){
+        return;
+    }
+    if(!list){
+        return out_arr(out, 0);
+    }
+
+    if(!normalize_range(start, stop, (int64_t)ql_len(list))){
+        return out_arr(out, 0);
+    }
+    out_arr(out, (uint32_t)(stop - start + 1));
+    ql_range(list, (size_t)start, (size_t)stop, lrange_visit, &out);
+}
+
+/*
+ * BLPOP key [key ...] timeout
+ *
+ * Pops from the first non-empty list. If all of them are empty, the
+ * connection is parked in STATE_BLOCK on every key and gets no reply now;
+ * a later push wakes it through serve_ready_keys(), or the event loop
+ * replies nil once `timeout` seconds pass. A timeout of 0 waits forever.
+ * Inside EXEC it never blocks.
+ */
+// longer timeouts, up to infinity, block like 0: until data comes
+const double k_blpop_max_timeout = 1e9;
+
+static void do_blpop(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+    double timeout = 0;
+    if(!str2dbl(cmd.back(), timeout) || timeout < 0){
+        return out_err(out, ERR_ARG, "timeout is not a valid float");
+    }
+
+    for(size_t i = 1; i + 1 < cmd.size(); ++i){
+        bool bad = false;
+        QuickList *list = expect_list(cmd[i], out, &bad);
+        if(bad){
+            return;
+        }
+        if(list){
+            return list_pop_reply(cmd[i], list, out);
+        }
+    }
+
+    // a transaction must not block, it behaves like an instant timeout, and
+    // so does a connection on an I/O thread, which nothing else may wake,
+    // and one in bulk mode
+    if(conn->in_exec || conn->bulk || g_io_threads){
+        return out_nil(out);
+    }
+
+    // nothing to pop, park the connection
+    conn->state = STATE_BLOCK;
+    conn->block_deadline_us = 0;
+    if(timeout > 0 && timeout < k_blpop_max_timeout){
+        conn->block_deadline_us = get_monotonic_usec() + (uint64_t)(timeout * 1e6);
+    }
+    for(size_t i = 1; i + 1 < cmd.size(); ++i){
+        g_blocked[cmd[i]].push_back(conn);
+        conn->block_keys.push_back(cmd[i]);
+    }
+}
+
+
+/*
+ * Looks up a Bloom filter for a command, like expect_zset(). With `create`
+ * a missing key gets a filter with the default capacity and error rate.
+ */
+static Bloom *expect_bloom(const std::string &key, bool create, std::string &out, bool *bad){
+    *bad = false;
+    Entry *ent = entry_lookup(key);
+    if(!ent){
+        if(!create){
+            return NULL;
+        }
+        Bloom *bf = bloom_new(k_bloom_default_capacity, k_bloom_default_error);
+        if(!bf){
+            out_err(out, ERR_UNKNOWN, "out of memory");
+            *bad = true;
+            return NULL;
+        }
+        ent = new Entry();
+        ent->type = T_BLOOM;
+        ent->bloom = bf;
+        key_add(key, ent);
+        return ent->bloom;
+    }
+    if(ent->type != T_BLOOM){
+        out_err(out, ERR_TYPE, "expect bloom filter");
+        *bad = true;
+        return NULL;
+    }
+    return ent->bloom;
+}
+
+// BF.RESERVE key error_rate capacity
+static void do_bf_reserve(std::vector<std::string> &cmd, std::string &out){
+    double error = 0;
+    int64_t capacity = 0;
+    if(!str2dbl(cmd[2], error) || !(error >= k_bloom_min_error && error < 1)){
+        return out_err(out, ERR_ARG, "error rate must be in [1e-9, 1)");
+    }
+    if(!str2int(cmd[3], capacity) || capacity <= 0 || (uint64_t)capacity > k_bloom_max_capacity){
+        return out_err(out, ERR_ARG, "capacity must be a positive integer up to 2^32");
+    }
+    if(entry_lookup(cmd[1])){
+        return out_err(out, ERR_ARG, "key already exists");
+    }
+    Bloom *bf = bloom_new((uint64_t)capacity, error);
+    if(!bf){
+        return out_err(out, ERR_ARG, "filter would be larger than 1 GiB, or out of memory");
+    }
+    Entry *ent = new Entry();
+    ent->type = T_BLOOM;
+    ent->bloom = bf;
+    key_add(cmd[1], ent);
+    touch_key(cmd[1], ent);
+    return out_ok(out);
+}
+
+// BF.ADD key item, BF.MADD key item [item ...]
+static void do_bf_add(std::vector<std::string> &cmd, bool multi, std::string &out){
+    bool bad = false;
+    Bloom *bf = expect_bloom(cmd[1], true, out, &bad);
+    if(bad){
+        return;
+    }
+    if(multi){
+        out_arr(out, (uint32_t)(cmd.size() - 2));
+    }
+    bool added = false;
+    for(size_t i = 2; i < cmd.size(); ++i){
+        bool rv = bloom_add(bf, cmd[i].data(), cmd[i].size());
+        out_int(out, rv);
+        added |= rv;
+    }
+    if(added){
+        touch_key(cmd[1], entry_find(cmd[1]));
+    }
+}
+
+// BF.EXISTS key item, BF.MEXISTS key item [item ...]
+static void do_bf_exists(std::vector<std::string> &cmd, bool multi, std::string &out){
+    bool bad = false;
+    Bloom *bf = expect_bloom(cmd[1], false, out, &bad);
+    if(bad){
+        return;
+    }
+    if(multi){
+        out_arr(out, (uint32_t)(cmd.size() - 2));
+    }
+    for(size_t i = 2; i < cmd.size(); ++i){
+        out_int(out, bf && bloom_exists(bf, cmd[i].data(), cmd[i].size()));
+    }
+}
+
+// looks up a HyperLogLog for a command, like expect_bloom()
+static HLL *expect_hll(const std::string &key, bool create, std::string &out, bool *bad){
+    *bad = false;
+    Entry *ent = entry_lookup(key);
+    if(!ent){
+        if(!create){
+            return NULL;
+        }
+        ent = new Entry();
+        ent->type = T_HLL;
+        ent->hll = hll_new();
+        key_add(key, ent);
+        return ent->hll;
+    }
+    if(ent->type != T_HLL){
+        out_err(out, ERR_TYPE, "expect hyperloglog");
+        *bad = true;
+        return NULL;
+    }
+    return ent->hll;
+}
+
+/*
+ * PFADD key [element ...]
+ *
+ * Replies 1 if the estimate may have changed (the key was created or a
+ * register went up), 0 otherwise.
+ */
+static void do_pfadd(std::vector<std::string> &cmd, std::string &out){
+    bool created = !entry_find(cmd[1]);
+    bool bad = false;
+    HLL *hll = expect_hll(cmd[1], true, out, &bad);
+    if(bad){
+        return;
+    }
+    bool changed = created;
+    for(size_t i = 2; i < cmd.size(); ++i){
+        changed |= hll_add(hll, cmd[i].data(), cmd[i].size());
+    }
+    if(changed){
+        touch_key(cmd[1], entry_find(cmd[1]));
+    }
+    return out_int(out, changed);
+}
+
+/*
+ * PFCOUNT key [key ...]
+ *
+ * With one key the estimate comes from the set's cache; with several the
+ * union is estimated without changing any of them.
+ */
+static void do_pfcount(std::vector<std::string> &cmd, std::string &out){
+    std::vector<HLL *> hlls;
+    for(size_t i = 1; i < cmd.size(); ++i){
+        bool bad = false;
+        HLL *hll = expect_hll(cmd[i], false, out, &bad);
+        if(bad){
+            return;
+        }
+        if(hll){
+            hlls.push_back(hll);
+        }
+    }
+    if(hlls.empty()){
+        return out_int(out, 0);
+    }
+    if(hlls.size() == 1){
+        return out_int(out, (int64_t)hll_count(hlls[0]));
+    }
+    return out_int(out, (int64_t)hll_count_union(hlls.data(), hlls.size()));
+}
+
+// PFMERGE destkey [sourcekey ...]
+static void do_pfmerge(std::vector<std::string> &cmd, std::string &out){
+    std::vector<HLL *> srcs;
+    for(size_t i = 2; i < cmd.size(); ++i){
+        bool bad = false;
+        HLL *hll = expect_hll(cmd[i], false, out, &bad);
+        if(bad){
+            return;
+        }
+        if(hll){
+            srcs.push_back(hll);
+        }
+    }
+    bool bad = false;
+    HLL *dst = expect_hll(cmd[1], true, out, &bad);
+    if(bad){
+        return;
+    }
+    for(HLL *src : srcs){
+        if(src != dst){
+            hll_merge(dst, src);
+        }
+    }
+    touch_key(cmd[1], entry_find(cmd[1]));
+    return out_ok(out);
+}
+
+static void multi_reset(Conn *conn){
+    conn->in_multi = false;
+    conn->multi_queue.clear();
+    conn->watched.clear();
+}
+
+// MULTI
+static void do_multi(Conn *conn, std::string &out){
+    if(conn->in_multi){
+        return out_err(out, ERR_ARG, "MULTI calls can not be nested");
+    }
+    conn->in_multi = true;
+    return out_ok(out);
+}
+
+// WATCH key [key ...]
+static void do_watch(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+    if(conn->in_multi){
+        return out_err(out, ERR_ARG, "WATCH inside MULTI is not allowed");
+    }
+    for(size_t i = 1; i < cmd.size(); ++i){
+        conn->watched.push_back({cmd[i], key_version(cmd[i])});
+    }
+    return out_ok(out);
+}
+
+// UNWATCH
+static void do_unwatch(Conn *conn, std::string &out){
+    conn->watched.clear();
+    return out_ok(out);
+}
+
+// DISCARD
+static void do_discard(Conn *conn, std::string &out){
+    if(!conn->in_multi){
+        return out_err(out, ERR_ARG, "DISCARD without MULTI");
+    }
+    multi_reset(conn);
+    return out_ok(out);
+}
+
+/*
+ * EXEC
+ *
+ * Runs every command queued since MULTI back to back on the event loop, so
+ * no other client can run in between, and replies with a single array
+ * holding all their replies. If a WATCHed key was written since it was
+ * watched, its version no longer matches and the transaction is dropped
+ * with a nil reply.
+ */
+static void do_exec(Conn *conn, std::string &out){
+    if(!conn->in_multi){
+        return out_err(out, ERR_ARG, "EXEC without MULTI");
+    }
+
+    bool dirty = false;
+    for(const auto &w : conn->watched){
+        if(key_version(w.first) != w.second){
+            dirty = true;
+            break;
+        }
+    }
+
+    std::vector<std::vector<std::string>> queue;
+    queue.swap(conn->multi_queue);
+    multi_reset(conn);
+    if(dirty){
+        return out_nil(out);
+    }
+
+    out_arr(out, (uint32_t)queue.size());
+    conn->in_exec = true;
+    for(std::vector<std::string> &cmd : queue){
+        do_request(conn, cmd, out);
+    }
+    conn->in_exec = false;
+}
+
+/*
+ * HELLO [protover]
+ *
+ * Selects RESP2 or RESP3 for a RESP connection and replies with a short
+ * description of the server as name/value pairs.
+ */
+static void do_hello(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+    int64_t ver = conn->resp_ver;
+    if(cmd.size() == 2 && (!str2int(cmd[1], ver) || ver < 2 || ver > 3)){
+        return out_err(out, ERR_ARG, "unsupported protocol version");
+    }
+    if(conn->proto == PROTO_RESP){
+        conn->resp_ver = (uint32_t)ver;
+    }
+
+    out_arr(out, 6);
+    out_str(out, "server", 6);
+    out_str(out, "simpleredis", 11);
+    out_str(out, "proto", 5);
+    out_int(out, conn->proto == PROTO_RESP ? ver : 0);
+    out_str(out, "mode", 4);
+    out_str(out, "standalone", 10);
+}
+
+/*
+ * Key scans: RANGE and PREFIXSCAN.
+ *
+ * Both go through keys in byte order from a cursor and reply with
+ * [cursor, [key...]], where the cursor is the key to go on from, or ""
+ * when there are no more. A scan takes O(log n + count): one seek, then a
+ * walk. They use the ordered index when it is on, the keyspace otherwise.
+ */
+const int64_t k_scan_default_count = 10;
+
+// calls `fn` with each key from `from` on, in order, until it returns false
+template <typename Fn>
+static void keys_from(const std::string &from, Fn fn){
+    if(g_oindex){
+        for(BtIter it = bt_seek(g_oindex, from.data(), from.size()); bt_valid(it); bt_next(it)){
+            if(!fn(bt_key(it))){
+                return;
+            }
+        }
+        return;
+    }
+    for(auto it = g_map.lower_bound(from); it != g_map.end(); ++it){
+        if(!fn(it->first)){
+            return;
+        }
+    }
+}
+
+// up to `count` keys from `from` on that start with `prefix` and are below
+// `end`, unless that is ""
+static void scan_keys(const std::string &from, const std::string &end,
+                      const std::string &prefix, int64_t count, std::string &out){
+    std::vector<const std::string *> keys;
+    std::string cursor;
+    keys_from(from, [&](const std::string &key){
+        if(key.compare(0, prefix.size(), prefix) != 0 || (!end.empty() && key >= end)){
+            return false;
+        }
+        if((int64_t)keys.size() == count){
+            cursor = key;
+            return false;
+        }
+        keys.push_back(&key);
+        return true;
+    });
+    out_arr(out, 2);
+    out_str(out, cursor);
+    out_arr(out, (uint32_t)keys.size());
+    for(const std::string *key : keys){
+        out_str(out, *key);
+    }
+}
+
+// the optional COUNT n at cmd[i]
+static bool scan_count(std::vector<std::string> &cmd, size_t i, int64_t *count, std::string &out){
+    *count = k_scan_default_count;
+    if(cmd.size() == i){
+        return true;
+    }
+    if(cmd.size() != i + 2 || 0 != strcasecmp(cmd[i].c_str(), "count")){
+        out_err(out, ERR_ARG, "syntax error");
+        return false;
+    }
+    if(!str2int(cmd[i + 1], *count) || *count <= 0){
+        out_err(out, ERR_ARG, "count must be a positive integer");
+        return false;
+    }
+    return true;
+}
+
+// RANGE start end [COUNT n]: keys from start up to, not including, end;
+// "" for no end. The next page starts at the returned cursor.
+static void do_range(std::vector<std::string> &cmd, std::string &out){
+    int64_t count = 0;
+    if(scan_count(cmd, 3, &count, out)){
+        scan_keys(cmd[1], cmd[2], std::string(), count, out);
+    }
+}
+
+// PREFIXSCAN prefix cursor [COUNT n]: keys that start with prefix, from
+// cursor on; "" for the first page
+static void do_prefixscan(std::vector<std::string> &cmd, std::string &out){
+    int64_t count = 0;
+    if(scan_count(cmd, 3, &count, out)){
+        const std::string &from = (cmd[2] > cmd[1]) ? cmd[2] : cmd[1];
+        scan_keys(from, std::string(), cmd[1], count, out);
+    }
+}
+
+/*
+ * Snapshots: SAVE, and snapshot_load() at startup.
+ *
+ * SAVE writes one record per key, in key order, into the chunks of a
+ * snapshot file (snapfile.h):
+ *
+ *   [1B type][4B key length][key][value]
+ *
+ *   T_STR:   [1B ENC_RAW][4B length][bytes] or [1B ENC_INT][8B integer]
+ *   T_ZSET:  [4B count] then [8B score][4B length][member] per member
+ *   T_LIST:  [4B count] then [4B length][bytes] per element
+ *   T_BLOOM: [4B length][bloom_dump()]
+ *   T_HLL:   [4B length][hll_dump()]
+ *
+ * Loading decodes the chunks on a pool of threads, each chunk into its own
+ * run of (key, Entry) pairs. As the chunks are in key order, the runs are
+ * then appended to g_map in chunk order with end hints, which takes no
+ * search per key, so the single threaded part is one node insert per key.
+ * Values on disk (tiering) are written out, and come back in memory.
+ */
+const size_t k_snapshot_chunk_bytes = 1 << 20;
+
+static std::string g_snapshot_path;
+
+void set_snapshot_path(const char *path){
+    g_snapshot_path = path;
+}
+
+static void put_u32(std::string &rec, uint32_t v){
+    rec.append((char *)&v, 4);
+}
+
+static void put_bytes(std::string &rec, const char *data, size_t len){
+    put_u32(rec, (uint32_t)len);
+    rec.append(data, len);
+}
+
+static void snap_zset_visit(const char *name, size_t len, double score, void *arg){
+    std::string &rec = *(std::string *)arg;
+    rec.append((char *)&score, 8);
+    put_bytes(rec, name, len);
+}
+
+static void snap_list_visit(const char *data, size_t len, void *arg){
+    put_bytes(*(std::string *)arg, data, len);
+}
+
+// returns false if a value in the value log can not be read
+static bool entry_encode(const std::string &key, Entry *ent, std::string &rec){
+    rec.push_back((char)ent->type);
+    put_bytes(rec, key.data(), key.size());
+    if(ent->type == T_STR && ent->enc == ENC_INT){
+        rec.push_back((char)ENC_INT);
+        rec.append((char *)&ent->ival, 8);
+    }
+    else if(ent->type == T_STR){
+        std::string val;
+        if(ent->enc == ENC_DISK && !vlog_read(g_vlog, (VLoc)ent->ival, val)){
+            return false;
+        }
+        const std::string &bytes = (ent->enc == ENC_DISK) ? val : ent->val->str;
+        rec.push_back((char)ENC_RAW);
+        put_bytes(rec, bytes.data(), bytes.size());
+    }
+    else if(ent->type == T_ZSET){
+        size_t n = zset_len(ent->zset);
+        put_u32(rec, (uint32_t)n);
+        if(n){
+            zset_range_by_rank(ent->zset, 0, n - 1, snap_zset_visit, &rec);
+        }
+    }
+    else if(ent->type == T_LIST){
+        size_t n = ql_len(ent->list);
+        put_u32(rec, (uint32_t)n);
+        if(n){
+            ql_range(ent->list, 0, n - 1, snap_list_visit, &rec);
+        }
+    }
+    else if(ent->type == T_BLOOM || ent->type == T_HLL){
+        std::string dump;
+        if(ent->type == T_BLOOM){
+            bloom_dump(ent->bloom, dump);
+        }
+        else{
+            hll_dump(ent->hll, dump);
+        }
+        put_bytes(rec, dump.data(), dump.size());
+    }
+    return true;
+}
+
+// bounds checked reads from a chunk
+struct SnapIn {
+    const char *p;
+    const char *end;
+    bool ok;
+};
+
+static void get_raw(SnapIn &in, void *v, size_t n){
+    if(!in.ok || (size_t)(in.end - in.p) < n){
+        in.ok = false;
+        return;
+    }
+    memcpy(v, in.p, n);
+    in.p += n;
+}
+
+static uint32_t get_u32(SnapIn &in){
+    uint32_t v = 0;
+    get_raw(in, &v, 4);
+    return v;
+}
+
+// the next `len` bytes, or NULL if there are not as many
+static const char *get_bytes(SnapIn &in, uint32_t len){
+    if(!in.ok || (size_t)(in.end - in.p) < len){
+        in.ok = false;
+        return NULL;
+    }
+    const char *data = in.p;
+    in.p += len;
+    return data;
+}
+
+// frees an entry made by entry_decode(), which is not counted in g_tier_mem
+static void snap_entry_free(Entry *ent){
+    if(ent->type == T_STR && ent->enc == ENC_RAW){
+        rcstr_unref(ent->val);
+        ent->val = NULL;
+    }
+    entry_del(ent);
+}
+
+/*
+ * Decodes one record into a new entry; runs on the loader threads, so it
+ * touches nothing global. `*mem` gets the bytes of a string held in memory.
+ */
+static Entry *entry_decode(SnapIn &in, std::string &key, uint64_t *mem){
+    uint8_t type = 0;
+    get_raw(in, &type, 1);
+    uint32_t klen = get_u32(in);
+    const char *kdata = get_bytes(in, klen);
+    if(!in.ok){
+        return NULL;
+    }
+    key.assign(kdata, klen);
+
+    Entry *ent = new Entry();
+    ent->type = type;
+    if(type == T_STR){
+        uint8_t enc = 0;
+        get_raw(in, &enc, 1);
+        if(enc == ENC_INT){
+            ent->enc = ENC_INT;
+            get_raw(in, &ent->ival, 8);
+        }
+        else{
+            uint32_t len = get_u32(in);
+            const char *data = get_bytes(in, len);
+            in.ok = in.ok && enc == ENC_RAW;
+            std::string val = in.ok ? std::string(data, len) : std::string();
+            ent->val = rcstr_new(val);
+            *mem += len;
+        }
+    }
+    else if(type == T_ZSET){
+        ent->zset = zset_new();
+        uint32_t n = get_u32(in);
+        for(uint32_t i = 0; in.ok && i < n; ++i){
+            double score = 0;
+            get_raw(in, &score, 8);
+            uint32_t len = get_u32(in);
+            const char *name = get_bytes(in, len);
+            if(in.ok){
+                zset_add(ent->zset, name, len, score);
+            }
+        }
+    }
+    else if(type == T_LIST){
+        ent->list = ql_new();
+        uint32_t n = get_u32(in);
+        for(uint32_t i = 0; in.ok && i < n; ++i){
+            uint32_t len = get_u32(in);
+            const char *data = get_bytes(in, len);
+            if(in.ok){
+                ql_push(ent->list, QL_TAIL, data, len);
+            }
+        }
+    }
+    else if(type == T_BLOOM || type == T_HLL){
+        uint32_t len = get_u32(in);
+        const char *data = get_bytes(in, len);
+        if(in.ok && type == T_BLOOM){
+            ent->bloom = bloom_restore(data, len);
+            in.ok = ent->bloom != NULL;
+        }
+        else if(in.ok){
+            ent->hll = hll_restore(data, len);
+            in.ok = ent->hll != NULL;
+        }
+    }
+    else{
+        in.ok = false;
+    }
+
+    if(!in.ok){
+        snap_entry_free(ent);
+        return NULL;
+    }
+    return ent;
+}
+
+// SAVE: writes the keyspace to the snapshot file, replacing the last one
+static void do_save(std::string &out){
+    if(g_snapshot_path.empty()){
+        return out_err(out, ERR_ARG, "no snapshot file, see main_server -s");
+    }
+    SnapWriter *w = snap_create(g_snapshot_path.c_str(), k_snapshot_chunk_bytes);
+    if(!w){
+        return out_err(out, ERR_UNKNOWN, "can not create the snapshot file");
+    }
+    std::string rec;
+    for(auto &it : g_map){
+        rec.clear();
+        if(!entry_encode(it.first, it.second, rec) || !snap_append(w, rec.data(), rec.size())){
+            snap_abort(w);
+            return out_err(out, ERR_UNKNOWN, "writing the snapshot failed");
+        }
+    }
+    if(!snap_finish(w)){
+        return out_err(out, ERR_UNKNOWN, "writing the snapshot failed");
+    }
+    return out_ok(out);
+}
+
+// the entries decoded from one chunk, in key order
+struct SnapRun {
+    std::vector<std::pair<std::string, Entry *>> entries;
+    uint64_t mem = 0;
+};
+
+static bool chunk_decode(const std::string &buf, uint32_t records, SnapRun &run){
+    SnapIn in = {buf.data(), buf.data() + buf.size(), true};
+    run.entries.reserve(records);
+    for(uint32_t i = 0; i < records; ++i){
+        std::string key;
+        Entry *ent = entry_decode(in, key, &run.mem);
+        if(!ent){
+            return false;
+        }
+        run.entries.emplace_back(std::move(key), ent);
+    }
+    return in.p == in.end;
+}
+
+bool snapshot_load(const char *path, int nthreads){
+    std::vector<SnapChunk> chunks;
+    int fd = snap_open(path, chunks);
+    if(fd < 0){
+        return false;
+    }
+
+    // chunks are taken in order by whichever thread is free
+    std::vector<SnapRun> runs(chunks.size());
+    std::atomic<size_t> next{0};
+    std::atomic<bool> bad{false};
+    auto loader = [&](){
+        std::string buf;
+        size_t i;
+        while(!bad && (i = next++) < chunks.size()){
+            if(!snap_read_chunk(fd, chunks[i], buf) || !chunk_decode(buf, chunks[i].records, runs[i])){
+                bad = true;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for(int i = 1; i < nthreads; ++i){
+        threads.emplace_back(loader);
+    }
+    loader();
+    for(std::thread &t : threads){
+        t.join();
+    }
+    close(fd);
+
+    if(bad){
+        for(SnapRun &run : runs){
+            for(auto &kv : run.entries){
+                snap_entry_free(kv.second);
+            }
+        }
+        return false;
+    }
+
+    // the snapshot replaces the keyspace
+    for(auto &it : g_map){
+        entry_del(it.second);
+    }
+    g_map.clear();
+    g_delete_version = ++g_version_seq;
+    for(SnapRun &run : runs){
+        for(auto &kv : run.entries){
+            auto it = g_map.emplace_hint(g_map.end(), std::move(kv.first), kv.second);
+            if(it->second != kv.second){
+                // a key written twice, which SAVE never does
+                Entry *dup = kv.second;
+                run.mem -= (dup->type == T_STR && dup->enc == ENC_RAW && dup->val) ? dup->val->str.size() : 0;
+                snap_entry_free(dup);
+                continue;
+            }
+            kv.second->version = ++g_version_seq;
+        }
+        g_tier_mem += run.mem;
+        run.entries.clear();
+        run.entries.shrink_to_fit();
+    }
+    oindex_rebuild();
+    return true;
+}
+
+/*
+ * Runtime settings, read and changed with CONFIG GET/SET.
+ *
+ * Every setting is an integer with a valid range; `on_set` applies a new
+ * value to whatever depends on it.
+ */
+struct ConfigParam {
+    const char *name;
+    int64_t *val;
+    int64_t min;
+    int64_t max;
+    void (*on_set)();
+};
+
+// commands running at least this long are logged, -1 turns the log off
+static int64_t g_slowlog_slower_than = 10000;
+static int64_t g_slowlog_max_len = 128;
+static Slowlog *g_slowlog = slowlog_new((size_t)g_slowlog_max_len);
+
+// event loop iterations are timed by phase, see LATENCY; CONFIG sets
+// g_loop_profiler, and loop threads read the copy in g_loop_profiling
+static int64_t g_loop_profiler = 1;
+static std::atomic<bool> g_loop_profiling{true};
+static LoopProfile *g_loopprof = lp_new();
+
+static void loop_profiler_set(){
+    g_loop_profiling.store(g_loop_profiler != 0, std::memory_order_relaxed);
+}
+
+// the profile for the next iteration of a loop thread, NULL when off
+static LoopProfile *loop_profile(){
+    return g_loop_profiling.load(std::memory_order_relaxed) ? g_loopprof : NULL;
+}
+
+static void slowlog_max_len_set(){
+    slowlog_set_max_len(g_slowlog, (size_t)g_slowlog_max_len);
+}
+
+// applies to segments started after the change
+static void tier_segment_bytes_set(){
+    if(g_vlog){
+        vlog_set_segment_bytes(g_vlog, (size_t)g_tier_segment_bytes);
+    }
+}
+
+// builds or drops the index, if it is not that way already
+static void ordered_index_set(){
+    if((g_oindex != NULL) != (g_ordered_index != 0)){
+        oindex_rebuild();
+    }
+}
+
+static const ConfigParam g_config[] = {
+    {"client-output-hard-limit", &g_out_hard_limit, 0, INT64_MAX, NULL},
+    {"client-output-soft-limit", &g_out_soft_limit, 0, INT64_MAX, NULL},
+    {"client-output-soft-seconds", &g_out_soft_seconds, 0, INT64_MAX / 1000000, NULL},
+    {"loop-profiler", &g_loop_profiler, 0, 1, loop_profiler_set},
+    {"ordered-index", &g_ordered_index, 0, 1, ordered_index_set},
+    {"slowlog-log-slower-than", &g_slowlog_slower_than, -1, INT64_MAX, NULL},
+    {"slowlog-max-len", &g_slowlog_max_len, 0, 1 << 20, slowlog_max_len_set},
+    {"tiered-max-memory", &g_tier_max_memory, 0, INT64_MAX, NULL},
+    {"tiered-min-value", &g_tier_min_value, 0, INT64_MAX, NULL},
+    {"tiered-segment-bytes", &g_tier_segment_bytes, 4096, (int64_t)k_vlog_max_segment_bytes, tier_segment_bytes_set},
+    {"tracking-table-max-keys", &g_tracking_max_keys, 0, INT64_MAX, NULL},
+};
+
+// CONFIG GET <name|*>
+// CONFIG SET <name> <value>
+static void do_config(std::vector<std::string> &cmd, std::string &out){
+    size_t nparams = sizeof(g_config) / sizeof(g_config[0]);
+    if(cmd.size() == 3 && 0 == strcasecmp(cmd[1].c_str(), "get")){
+        size_t ctx = out_begin_arr(out);
+        uint32_t n = 0;
+        for(size_t i = 0; i < nparams; ++i){
+            const ConfigParam &p = g_config[i];
+            if(cmd[2] == "*" || 0 == strcasecmp(cmd[2].c_str(), p.name)){
+                out_str(out, p.name, strlen(p.name));
+                out_int_as_str(out, *p.val);
+                n += 2;
+            }
+        }
+        out_end_arr(out, ctx, n);
+        return;
+    }
+    if(cmd.size() == 4 && 0 == strcasecmp(cmd[1].c_str(), "set")){
+        for(size_t i = 0; i < nparams; ++i){
+            const ConfigParam &p = g_config[i];
+            if(0 != strcasecmp(cmd[2].c_str(), p.name)){
+                continue;
+            }
+            int64_t val = 0;
+            if(!str2int(cmd[3], val) || val < p.min || val > p.max){
+                return out_err(out, ERR_ARG, "invalid value for " + cmd[2]);
+            }
+            *p.val = val;
+            if(p.on_set){
+                p.on_set();
+            }
+            return out_ok(out);
+        }
+        return out_err(out, ERR_ARG, "unknown parameter " + cmd[2]);
+    }
+    return out_err(out, ERR_ARG, "CONFIG GET <name> or CONFIG SET <name> <value>");
+}
+
+/*
+ * Called with the execution time of every request. The log is only touched
+ * when the command was slow; only then are its arguments copied.
+ */
+static void slowlog_check(Conn *conn, std::vector<std::string> &cmd, uint64_t duration_us){
+    if(g_slowlog_slower_than < 0 || duration_us < (uint64_t)g_slowlog_slower_than){
+        return;
+    }
+    std::vector<std::string> args;
+    slowlog_args(args, cmd);
+    // SET took the buffer of its value (see do_set()), the key holds it now
+    if(cmd.size() == 3 && cmd[2].empty() && 0 == strcasecmp(cmd[0].c_str(), "set")){
+        Entry *ent = entry_find(cmd[1]);
+        if(ent && ent->type == T_STR && ent->enc == ENC_RAW && ent->val){
+            slowlog_arg(args[2], ent->val->str);
+        }
+    }
+    slowlog_push_args(g_slowlog, args, conn->fd, duration_us);
+}
+
+/*
+ * SLOWLOG GET [count] | LEN | RESET
+ *
+ * GET replies with the newest `count` records (10 by default, all if
+ * negative), each as [id, unix time, duration in usec, [args...], fd].
+ */
+static void do_slowlog(std::vector<std::string> &cmd, std::string &out){
+    if(cmd.size() == 2 && 0 == strcasecmp(cmd[1].c_str(), "len")){
+        return out_int(out, (int64_t)slowlog_len(g_slowlog));
+    }
+    if(cmd.size() == 2 && 0 == strcasecmp(cmd[1].c_str(), "reset")){
+        slowlog_reset(g_slowlog);
+        return out_ok(out);
+    }
+    if(cmd.size() <= 3 && 0 == strcasecmp(cmd[1].c_str(), "get")){
+        int64_t count = 10;
+        if(cmd.size() == 3 && !str2int(cmd[2], count)){
+            return out_err(out, ERR_ARG, "expect int");
+        }
+        size_t n = slowlog_len(g_slowlog);
+        if(count >= 0 && (uint64_t)count < n){
+            n = (size_t)count;
+        }
+        out_arr(out, (uint32_t)n);
+        for(size_t i = 0; i < n; ++i){
+            const SlowlogEntry *ent = slowlog_get(g_slowlog, i);
+            out_arr(out, 5);
+            out_int(out, (int64_t)ent->id);
+            out_int(out, ent->unix_time);
+            out_int(out, (int64_t)ent->duration_us);
+            out_arr(out, (uint32_t)ent->args.size());
+            for(const std::string &arg : ent->args){
+                out_str(out, arg);
+            }
+            out_int(out, ent->fd);
+        }
+        return;
+    }
+    return out_err(out, ERR_ARG, "SLOWLOG GET [count], LEN or RESET");
+}
+
+/*
+ * HOTKEYS [count] | RESET
+ *
+ * Replies with up to `count` (10 by default) of the most accessed keys,
+ * hottest first, as [key, estimate] pairs. Estimates are decayed access
+ * counts (see hotkeys.h), comparable with each other but not exact.
+ */
+static void do_hotkeys(std::vector<std::string> &cmd, std::string &out){
+    if(cmd.size() == 2 && 0 == strcasecmp(cmd[1].c_str(), "reset")){
+        hk_reset(g_hotkeys);
+        return out_ok(out);
+    }
+    int64_t count = 10;
+    if(cmd.size() == 2 && (!str2int(cmd[1], count) || count < 0)){
+        return out_err(out, ERR_ARG, "expect count or RESET");
+    }
+    std::vector<HotKey> top;
+    hk_top(g_hotkeys, top);
+    if((uint64_t)count < top.size()){
+        top.resize((size_t)count);
+    }
+    out_arr(out, (uint32_t)top.size());
+    for(const HotKey &hot : top){
+        out_arr(out, 2);
+        out_str(out, hot.key);
+        out_int(out, hot.count);
+    }
+}
+
+/*
+ * LATENCY DOCTOR | LOOP | RESET
+ *
+ * How the event loop iterations, of the main thread and of the I/O
+ * threads, split their time between phases (see loopprof.h). DOCTOR
+ * replies with a report for people, with the longest iterations and where
+ * to look first. LOOP replies with [iterations, [row...]], a row being
+ * [name, sum, p50, p99, max] per iteration: one per phase and one for the
+ * busy time, in nsec, then one for events and one for requests.
  */
-
-static int32_t parse_req(const uint8_t *data, 
-                            size_t len,
-                            std::vector<std::string> &out){
-
-    // Check if the length of the data is at least 4 bytes. If not, return -1.
-    if(len < 4){
-        return -1;
+static void do_latency(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+    if(0 == strcasecmp(cmd[1].c_str(), "reset")){
+        lp_reset(g_loopprof);
+        return out_ok(out);
     }
-
-    // Get the number of strings from the first 4 bytes of the data
-    uint32_t n = 0;
-    memcpy(&n, &data[0], 4);
-
-    // Check if the number of strings is less than or equal to k_max_msg. If not, return -1.
-    if(n > k_max_msg){
-        return -1;
+    bool doctor = 0 == strcasecmp(cmd[1].c_str(), "doctor");
+    if(!doctor && 0 != strcasecmp(cmd[1].c_str(), "loop")){
+        return out_err(out, ERR_ARG, "expect DOCTOR, LOOP or RESET");
     }
-
-    // Initialize the position to 4, since the first 4 bytes were used to get the number of strings
-    size_t pos = 4;
-
-    // Loop n times, parsing each string
-    while(n--){
-        // Check if there is enough data to read the length of the string
-        if(pos + 4 > len){
-            return -1;
-        }
-
-        // Get the length of the string
-        uint32_t sz = 0;
-        memcpy(&sz, &data[pos], 4);
-
-        // Check if there is enough data to read the string
-        if(pos + 4 + sz > len){
-            return -1;
-        }
-
-        // Copy the string into a new std::string object and add it to the vector of strings
-        out.push_back(std::string((char*)&data[pos+4], sz));
-
-        // Update the position to the start of the next string
-        pos += 4 + sz;
+    LoopReport *r = new LoopReport();
+    lp_report(g_loopprof, *r);
+    if(doctor){
+        // longer than a reply buffer, so sent by reference
+        std::string text = lp_doctor(*r);
+        RcStr *val = rcstr_new(text);
+        out_str_ref(conn, out, val);
+        rcstr_unref(val);
+        delete r;
+        return;
     }
-
-    // Check if the parsing was successful and all data was used. If not, return -1.
-    if(pos != len){
-        return -1;
+    auto row = [&](const char *name, const Histogram &h, double scale){
+        out_arr(out, 5);
+        out_str(out, name, strlen(name));
+        out_int(out, (int64_t)(h.sum * scale));
+        out_int(out, (int64_t)(hist_percentile(&h, 50) * scale));
+        out_int(out, (int64_t)(hist_percentile(&h, 99) * scale));
+        out_int(out, (int64_t)(h.max * scale));
+    };
+    out_arr(out, 2);
+    out_int(out, (int64_t)r->iterations);
+    out_arr(out, LP_NPHASES + 3);
+    for(int i = 0; i < LP_NPHASES; ++i){
+        row(k_lp_phase_names[i], r->phases[i], r->ns_per_cycle);
     }
-
-    // Return 0 to indicate success
-    return 0;
+    row("busy", r->busy, r->ns_per_cycle);
+    row("events", r->events, 1);
+    row("requests", r->requests, 1);
+    delete r;
 }
-static std::map<std::string, std::string> g_map;
 
 /*
- * Function: do_get
- * 
- * This function is called when the server receives a "GET" command.
- * It retrieves the value associated with the given key from a global map.
- * If the key is not found in the map, it returns RES_NX, indicating that
- * the key does not exist. Otherwise, it copies the value into the provided
- * buffer and returns RES_OK.
- * 
- * Parameters:
- * - `cmd`: a vector of strings, where the first element is the command ("GET")
- *          and the second element is the key to retrieve.
- * - `res`: a pointer to a buffer where the value will be copied.
- * - `reslen`: a pointer to the length of the buffer. This function will update
- *            this value with the length of the value.
- * 
- * Returns:
- * - `RES_NX` if the key is not found in the map.
- * - `RES_OK` if the value is found and copied into the buffer.
+ * CLIENT TRACKING ON [BCAST] [PREFIX prefix ...] | OFF
+ *
+ * RESP connections need RESP3 (HELLO 3), where pushes have their own type
+ * and can't be taken for replies.
  */
-static uint32_t do_get(const std::vector<std::string> &cmd, uint8_t *res, uint32_t *reslen){
-        // Check if the key exists in the map
-        if(!g_map.count(cmd[1])){
-            // If the key is not found, return RES_NX
-            return RES_NX;
+static void do_client_tracking(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+    bool on = 0 == strcasecmp(cmd[2].c_str(), "on");
+    if(!on && 0 != strcasecmp(cmd[2].c_str(), "off")){
+        return out_err(out, ERR_ARG, "expect ON or OFF");
+    }
+    bool bcast = false;
+    std::vector<std::string> prefixes;
+    for(size_t i = 3; i < cmd.size(); ++i){
+        if(0 == strcasecmp(cmd[i].c_str(), "bcast")){
+            bcast = true;
         }
+        else if(0 == strcasecmp(cmd[i].c_str(), "prefix") && i + 1 < cmd.size()){
+            prefixes.push_back(cmd[++i]);
+        }
+        else{
+            return out_err(out, ERR_ARG, "syntax error");
+        }
+    }
+    if(!prefixes.empty() && !bcast){
+        return out_err(out, ERR_ARG, "PREFIX needs BCAST");
+    }
+    if(on && conn->proto == PROTO_RESP && conn->resp_ver < 3){
+        return out_err(out, ERR_ARG, "tracking needs RESP3, see HELLO");
+    }
+    // pushes are queued by whichever thread runs the write, see set_io_threads()
+    if(on && g_io_threads){
+        return out_err(out, ERR_ARG, "tracking is not supported with I/O threads");
+    }
 
-        // Retrieve the value associated with the key
-        std::string &val = g_map[cmd[1]];
-
-        // Assert that the value is not longer than the maximum allowed message size
-        assert(val.size() <= k_max_msg);
-
-        // Copy the value into the provided buffer
-        memcpy(res, val.data(), val.size());
-
-        // Update the length of the buffer with the length of the value
-        *reslen = (uint32_t)val.size();
-
-        // Return RES_OK to indicate success
-        return RES_OK;
+    tracking_off(conn);
+    if(!on){
+        return out_ok(out);
+    }
+    conn->tracking = true;
+    conn->tracking_bcast = bcast;
+    g_tracking_conns[conn->id] = conn;
+    if(bcast){
+        if(prefixes.empty()){
+            prefixes.push_back("");
+        }
+        for(const std::string &prefix : prefixes){
+            g_bcast_prefixes[prefix].insert(conn->id);
+        }
+        conn->tracking_prefixes.swap(prefixes);
+    }
+    return out_ok(out);
 }
 
 /*
- * This function is called when the server receives a "SET" command.
- * It sets the value associated with the given key in a global map.
- * The parameters are as follows:
- * - `cmd`: a vector of strings, where the first element is the command ("SET")
- *          and the second element is the key, and the third element is the value.
- * - `res`: a pointer to a buffer, which is not used in this function.
- * - `reslen`: a pointer to an integer, which is also not used in this function.
- * 
- * This function does not return anything, but instead updates the global map.
- *
- * The function updates the global map by associating the value of `cmd[2]` 
- * (the third element of `cmd`) with the key `cmd[1]` (the second element of `cmd`).
+ * CLIENT BULK ON | OFF
  *
- * The function does not perform any error checking, so it is assumed that the
- * caller has properly formatted the `cmd` parameter.
+ * Bulk mode is for loading data through one connection, see pipe_mode()
+ * in client.cpp. Commands that succeed are not replied to, which saves
+ * building, translating and writing a reply per command; a failed one
+ * still gets its error, in order. OFF replies with the number of commands
+ * run in bulk mode and how many of those failed. Blocking commands don't
+ * block in bulk mode.
  */
-static uint32_t do_set(const std::vector<std::string> &cmd, uint8_t *res, uint32_t *reslen){
-        (void)res; // We don't use `res`, so we cast it to void to indicate this.
-        (void)reslen; // We also don't use `reslen`, so we cast it to void to indicate this.
-        
-        // Associate the value of `cmd[2]` with the key `cmd[1]` in the global map.
-        g_map[cmd[1]] = cmd[2];
-        
-        // Return RES_OK to indicate success.
-        return RES_OK;
+static void do_client_bulk(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+    if(0 == strcasecmp(cmd[2].c_str(), "on")){
+        conn->bulk = true;
+        conn->bulk_run = 0;
+        conn->bulk_failed = 0;
+        return out_ok(out);
+    }
+    if(0 != strcasecmp(cmd[2].c_str(), "off")){
+        return out_err(out, ERR_ARG, "expect ON or OFF");
+    }
+    conn->bulk = false;
+    out_arr(out, 2);
+    out_int(out, (int64_t)conn->bulk_run);
+    out_int(out, (int64_t)conn->bulk_failed);
 }
 
-
 /*
- * This function is called when the server receives a "DEL" command.
- * It deletes the key-value pair associated with the given key from the global map.
- * The parameters are as follows:
- * - `cmd`: a vector of strings, where the first element is the command ("DEL")
- *          and the second element is the key.
- * - `res`: a pointer to a buffer, which is not used in this function.
- * - `reslen`: a pointer to an integer, which is also not used in this function.
- * 
- * This function does not return anything, but instead updates the global map.
+ * CAPTURE START file [ring-bytes] | STOP
  *
- * The function updates the global map by erasing the key-value pair from the map,
- * where the key is the second element of the `cmd` vector.
+ * Writes every request, with when it came in and on which connection, to
+ * a file that main_replay can send again, see capture.h. The file is a
+ * plain name in the capture directory (set_capture_dir()), so a client can
+ * not write anywhere else; connections are told apart by their id, as fds
+ * are reused. Requests are
+ * recorded under the command lock, so there is one producer; GETs are not
+ * served by the I/O threads while capturing, so that they are recorded too.
+ * STOP replies with the number of requests written, dropped because the
+ * ring was full, and the bytes written.
  *
- * The function does not perform any error checking, so it is assumed that the
- * caller has properly formatted the `cmd` parameter.
+ * CAPTURE itself is not recorded, nor is CLIENT BULK: a replay waits for
+ * a reply to every request, and only the commands run in bulk mode are
+ * recorded.
  */
-static uint32_t do_del(const std::vector<std::string> &cmd, uint8_t *res, uint32_t *reslen){
-        // We don't use `res` or `reslen`, so we cast them to void to indicate this.
-        (void)res;
-        (void)reslen;
-        
-        // Erase the key-value pair from the global map, where the key is the second element of `cmd`.
-        g_map.erase(cmd[1]);
-        
-        // Return RES_OK to indicate success.
-        return RES_OK;
+static std::atomic<Capture *> g_capture{NULL};
+static std::string g_capture_dir = ".";
+const int64_t k_capture_ring_bytes = 16 << 20;
+
+void set_capture_dir(const char *dir){
+    g_capture_dir = dir;
+}
+
+static bool capture_skips(const std::vector<std::string> &cmd){
+    return cmd.empty() || 0 == strcasecmp(cmd[0].c_str(), "capture")
+        || (cmd.size() >= 2 && 0 == strcasecmp(cmd[0].c_str(), "client")
+            && 0 == strcasecmp(cmd[1].c_str(), "bulk"));
+}
+
+static void do_capture(std::vector<std::string> &cmd, std::string &out){
+    Capture *cap = g_capture.load(std::memory_order_relaxed);
+    if(cmd.size() >= 3 && cmd.size() <= 4 && 0 == strcasecmp(cmd[1].c_str(), "start")){
+        int64_t ring = k_capture_ring_bytes;
+        if(cmd.size() == 4 && (!str2int(cmd[3], ring) || ring <= 0 || ring > (1ll << 32))){
+            return out_err(out, ERR_ARG, "expect a ring size in bytes");
+        }
+        const std::string &name = cmd[2];
+        if(name.empty() || name == "." || name == ".." || name.find('/') != std::string::npos){
+            return out_err(out, ERR_ARG, "expect a file name without a directory");
+        }
+        if(cap){
+            return out_err(out, ERR_ARG, "already capturing");
+        }
+        cap = capture_start((g_capture_dir + "/" + name).c_str(), (size_t)ring);
+        if(!cap){
+            return out_err(out, ERR_UNKNOWN, "can not create the capture file");
+        }
+        g_capture.store(cap, std::memory_order_release);
+        return out_ok(out);
+    }
+    if(cmd.size() == 2 && 0 == strcasecmp(cmd[1].c_str(), "stop")){
+        if(!cap){
+            return out_err(out, ERR_ARG, "not capturing");
+        }
+        g_capture.store(NULL, std::memory_order_release);
+        CaptureStats stats = capture_stop(cap);
+        out_arr(out, 3);
+        out_int(out, (int64_t)stats.records);
+        out_int(out, (int64_t)stats.dropped);
+        out_int(out, (int64_t)stats.bytes);
+        return;
+    }
+    return out_err(out, ERR_ARG, "expect START file [ring-bytes] or STOP");
+}
+
+// read-only commands and the range of their arguments that are keys
+struct ReadCmd {
+    const char *name;
+    size_t first;
+    bool all;       // every argument from `first` on is a key
+};
+
+static const ReadCmd g_read_cmds[] = {
+    {"get", 1, false}, {"zscore", 1, false}, {"zrank", 1, false},
+    {"zrange", 1, false}, {"zrangebyscore", 1, false}, {"llen", 1, false},
+    {"lrange", 1, false}, {"bf.exists", 1, false}, {"bf.mexists", 1, false},
+    {"pfcount", 1, true},
+};
+
+// remembers the keys a tracking connection read with a command
+static void tracking_after_cmd(Conn *conn, std::vector<std::string> &cmd){
+    for(const ReadCmd &rc : g_read_cmds){
+        if(0 != strcasecmp(cmd[0].c_str(), rc.name)){
+            continue;
+        }
+        size_t last = rc.all ? cmd.size() : rc.first + 1;
+        for(size_t i = rc.first; i < last && i < cmd.size(); ++i){
+            tracking_remember(conn, cmd[i]);
+        }
+        return;
+    }
 }
 
 static int32_t cmd_is(const std::string &word, const char *cmd){
@@ -275,131 +2721,378 @@ static int32_t cmd_is(const std::string &word, const char *cmd){
 /**
  * This function processes a single request received from a client.
  *
- * @param req The buffer containing the received request.
- * @param reqlen The length of the request buffer.
- * @param rescode Pointer to store the result code of the request.
- * @param res Pointer to store the response buffer.
- * @param reslen Pointer to store the length of the response buffer.
- *
- * @return Returns 0 on success, -1 on error.
+ * @param conn The connection the request came from.
+ * @param cmd The parsed request, a command followed by its parameters.
+ * @param out The serialized response.
  *
  * Steps involved in processing a request:
- * 1. Parse the request buffer into a vector of strings, where each string
- *    represents a command or a parameter.
+ * 1. The request has already been split into a vector of strings by the
+ *    protocol front-end (parse_req() or resp_parse_batch()).
  * 2. Check if the parsed request has a valid format based on the number
  *    of elements in the vector and the commands.
  * 3. If the request is valid, dispatch the request to the appropriate
- *    handler function (do_get, do_set, do_del) based on the command.
- * 4. The appropriate handler function performs the operation and stores the
- *    result in the response buffer.
- * 5. If the request is not valid, set the result code to RES_ERR and
- *    store the error message in the response buffer.
- */
-static int32_t do_request(const uint8_t *req, uint32_t reqlen,
-                            uint32_t *rescode, uint8_t *res,
-                            uint32_t *reslen){
-    
-    // Parse the request buffer into a vector of strings
-    std::vector<std::string> cmd;
-    if(0 != parse_req(req, reqlen, cmd)){
-        // If parsing fails, log a message and return an error
-        msg("bad req");
-        return -1;
+ *    handler function (do_get, do_set, do_del, do_incr, do_z*, list
+ *    commands) based on the command.
+ * 4. The appropriate handler function performs the operation and serializes
+ *    the result into the response.
+ * 5. If the request is not valid, serialize an error into the response.
+ *
+ * Inside MULTI, commands are queued on the connection instead, and EXEC
+ * calls back into this function for each of them.
+ */
+void do_request(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+
+    // Inside MULTI everything but the transaction commands is queued
+    if(conn->in_multi && !cmd.empty() && !cmd_is(cmd[0], "exec")
+        && !cmd_is(cmd[0], "discard") && !cmd_is(cmd[0], "multi")
+        && !cmd_is(cmd[0], "watch")){
+        conn->multi_queue.push_back(cmd);
+        return out_status(out, "QUEUED");
     }
 
     // Check if the parsed request has a valid format
     if(cmd.size() == 2 && cmd_is(cmd[0], "get")){
         // Dispatch the request to the appropriate handler function
-        *rescode = do_get(cmd, res, reslen);
+        do_get(conn, cmd, out);
     } else if(cmd.size() == 3 && cmd_is(cmd[0], "set")){
-        *rescode = do_set(cmd, res, reslen);
+        do_set(cmd, out);
     } else if(cmd.size() == 2 && cmd_is(cmd[0], "del")){
-        *rescode = do_del(cmd, res, reslen);
+        do_del(cmd, out);
+    } else if(cmd.size() == 2 && cmd_is(cmd[0], "incr")){
+        do_incr(cmd, 1, out);
+    } else if(cmd.size() == 2 && cmd_is(cmd[0], "decr")){
+        do_incr(cmd, -1, out);
+    } else if(cmd.size() == 3 && cmd_is(cmd[0], "incrby")){
+        do_incrby(cmd, false, out);
+    } else if(cmd.size() == 3 && cmd_is(cmd[0], "decrby")){
+        do_incrby(cmd, true, out);
+    } else if(cmd.size() >= 4 && cmd.size() % 2 == 0 && cmd_is(cmd[0], "zadd")){
+        do_zadd(cmd, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "zrem")){
+        do_zrem(cmd, out);
+    } else if(cmd.size() == 3 && cmd_is(cmd[0], "zscore")){
+        do_zscore(cmd, out);
+    } else if(cmd.size() == 3 && cmd_is(cmd[0], "zrank")){
+        do_zrank(cmd, out);
+    } else if((cmd.size() == 4 || cmd.size() == 5) && cmd_is(cmd[0], "zrange")){
+        do_zrange(cmd, out);
+    } else if(cmd.size() >= 4 && cmd_is(cmd[0], "zrangebyscore")){
+        do_zrangebyscore(cmd, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "lpush")){
+        do_push(cmd, QL_HEAD, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "rpush")){
+        do_push(cmd, QL_TAIL, out);
+    } else if(cmd.size() == 2 && cmd_is(cmd[0], "lpop")){
+        do_pop(cmd, QL_HEAD, out);
+    } else if(cmd.size() == 2 && cmd_is(cmd[0], "rpop")){
+        do_pop(cmd, QL_TAIL, out);
+    } else if(cmd.size() == 2 && cmd_is(cmd[0], "llen")){
+        do_llen(cmd, out);
+    } else if(cmd.size() == 4 && cmd_is(cmd[0], "lrange")){
+        do_lrange(cmd, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "blpop")){
+        do_blpop(conn, cmd, out);
+    } else if(cmd.size() == 4 && cmd_is(cmd[0], "bf.reserve")){
+        do_bf_reserve(cmd, out);
+    } else if(cmd.size() == 3 && cmd_is(cmd[0], "bf.add")){
+        do_bf_add(cmd, false, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "bf.madd")){
+        do_bf_add(cmd, true, out);
+    } else if(cmd.size() == 3 && cmd_is(cmd[0], "bf.exists")){
+        do_bf_exists(cmd, false, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "bf.mexists")){
+        do_bf_exists(cmd, true, out);
+    } else if(cmd.size() >= 2 && cmd_is(cmd[0], "pfadd")){
+        do_pfadd(cmd, out);
+    } else if(cmd.size() >= 2 && cmd_is(cmd[0], "pfcount")){
+        do_pfcount(cmd, out);
+    } else if(cmd.size() >= 2 && cmd_is(cmd[0], "pfmerge")){
+        do_pfmerge(cmd, out);
+    } else if(cmd.size() == 1 && cmd_is(cmd[0], "multi")){
+        do_multi(conn, out);
+    } else if(cmd.size() == 1 && cmd_is(cmd[0], "exec")){
+        do_exec(conn, out);
+    } else if(cmd.size() == 1 && cmd_is(cmd[0], "discard")){
+        do_discard(conn, out);
+    } else if(cmd.size() >= 2 && cmd_is(cmd[0], "watch")){
+        do_watch(conn, cmd, out);
+    } else if(cmd.size() == 1 && cmd_is(cmd[0], "unwatch")){
+        do_unwatch(conn, out);
+    } else if(cmd.size() == 1 && cmd_is(cmd[0], "ping")){
+        out_status(out, "PONG");
+    } else if(cmd.size() == 2 && cmd_is(cmd[0], "echo")){
+        out_str(out, cmd[1]);
+    } else if(cmd.size() <= 2 && cmd_is(cmd[0], "hello")){
+        do_hello(conn, cmd, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "config")){
+        do_config(cmd, out);
+    } else if(cmd.size() >= 2 && cmd_is(cmd[0], "slowlog")){
+        do_slowlog(cmd, out);
+    } else if(cmd.size() <= 2 && cmd_is(cmd[0], "hotkeys")){
+        do_hotkeys(cmd, out);
+    } else if(cmd.size() == 2 && cmd_is(cmd[0], "latency")){
+        do_latency(conn, cmd, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "range")){
+        do_range(cmd, out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "prefixscan")){
+        do_prefixscan(cmd, out);
+    } else if(cmd.size() == 1 && cmd_is(cmd[0], "save")){
+        do_save(out);
+    } else if(cmd.size() == 1 && cmd_is(cmd[0], "tiering")){
+        do_tiering(out);
+    } else if(cmd.size() >= 3 && cmd_is(cmd[0], "client") && cmd_is(cmd[1], "tracking")){
+        do_client_tracking(conn, cmd, out);
+    } else if(cmd.size() == 3 && cmd_is(cmd[0], "client") && cmd_is(cmd[1], "bulk")){
+        do_client_bulk(conn, cmd, out);
+    } else if(cmd.size() >= 2 && cmd_is(cmd[0], "capture")){
+        do_capture(cmd, out);
     } else {
-        // If the request format is invalid, set the result code to RES_ERR
-        // and store an error message in the response buffer
-        *rescode = RES_ERR;
-        const char *msg = "Unknown command";
-        strcpy((char*)res, msg);
-        *reslen = strlen(msg);
-        return 0;
+        // If the request format is invalid, reply with an error
+        out_err(out, ERR_UNKNOWN, "Unknown command");
     }
 
-    // Return 0 to indicate success
-    return 0;
+    if(conn->tracking && !conn->tracking_bcast){
+        tracking_after_cmd(conn, cmd);
+    }
+}
+
+/*
+ * I/O threads.
+ *
+ * With set_io_threads(n), the main thread only accepts connections and
+ * hands each one to one of n threads, which run their own poll loop over
+ * the connections they own. A GET is answered on the I/O thread from the
+ * read index, with no lock (try_read_fast()). Every other command runs
+ * with g_cmd_lock held, so commands still run one at a time and all the
+ * state of the server besides the read index has one writer at a time.
+ *
+ * A connection on an I/O thread can only be written to by its own thread,
+ * so BLPOP does not wait there and CLIENT TRACKING is refused. The keys of
+ * GETs served from the index are noted per thread and counted by HOTKEYS
+ * and the tiering clock in batches, under the lock (fast_reads_flush()).
+ */
+static std::mutex g_cmd_lock;
+
+// holds g_cmd_lock while in scope, when there are I/O threads
+struct CmdLock {
+    CmdLock(){
+        if(g_io_threads){
+            g_cmd_lock.lock();
+        }
+    }
+    ~CmdLock(){
+        if(g_io_threads){
+            g_cmd_lock.unlock();
+        }
+    }
+};
+
+// keys read by try_read_fast() on this thread and not counted yet; the
+// slots are reused, so noting a short key does not allocate
+const size_t k_fast_reads_max = 256;
+static thread_local std::vector<std::string> t_fast_reads;
+static thread_local size_t t_fast_reads_n = 0;
+
+// counts the noted reads as entry_lookup() would have; with the lock held,
+// which every command of this thread takes first, so they come before it
+static void fast_reads_count(){
+    for(size_t i = 0; i < t_fast_reads_n; ++i){
+        (void)entry_lookup(t_fast_reads[i]);
+    }
+    t_fast_reads_n = 0;
+}
+
+static void fast_reads_flush(){
+    if(t_fast_reads_n){
+        CmdLock lock;
+        fast_reads_count();
+    }
+}
+
+static void fast_read_note(const std::string &key){
+    if(t_fast_reads.size() < k_fast_reads_max){
+        t_fast_reads.resize(k_fast_reads_max);
+    }
+    t_fast_reads[t_fast_reads_n++].assign(key);
+    if(t_fast_reads_n == k_fast_reads_max){
+        fast_reads_flush();
+    }
+}
+
+/*
+ * GET on an I/O thread, answered from the read index. Returns false if the
+ * command has to run on the keyspace instead: anything but a GET, a GET
+ * queued by MULTI, or a key that is not a string in memory.
+ */
+static bool try_read_fast(Conn *conn, std::vector<std::string> &cmd, std::string &out){
+    if(cmd.size() != 2 || !cmd_is(cmd[0], "get") || conn->in_multi){
+        return false;
+    }
+    bool handled = true;
+    RiValue v;
+    epoch_enter();
+    if(!ri_get(g_rindex, cmd[1].data(), cmd[1].size(), &v)){
+        out_nil(out);
+    }
+    else if(v.kind == RI_INT){
+        out_int_as_str(out, v.ival);
+    }
+    else if(v.kind == RI_STR && v.val->str.size() >= k_zero_copy_min){
+        // the reply's reference keeps the value after epoch_exit()
+        out_str_ref(conn, out, v.val);
+    }
+    else if(v.kind == RI_STR){
+        out_str(out, v.val->str);
+    }
+    else{
+        handled = false;
+    }
+    epoch_exit();
+    if(handled){
+        fast_read_note(cmd[1]);
+    }
+    return handled;
 }
 
 /**
  * Tries to parse and process a single request from the connection buffer.
  *
- * Checks if there is enough data in the read buffer to contain a full request.
- * A request starts with a 4 byte length header indicating the total message size.
+ * The protocol of a connection is decided by its first 4 bytes (see
+ * resp_detect()), after which requests are taken from the read buffer:
  *
- * If there is not enough data yet, returns false to indicate the outer loop
- * should retry on the next iteration after more data is read.
+ * - Native: a request starts with a 4 byte length header indicating the
+ *   total message size. If there is not enough data yet, returns false to
+ *   indicate the outer loop should retry after more data is read.
  *
- * If there is enough data, parses the length and verifies it is within the
- * allowed maximum.
- *
- * Prints the request payload and generates an echo response by copying the
- * request to the write buffer.
+ * - RESP: every complete command in the read buffer is parsed in one pass
+ *   into `resp_queue`, and requests are then taken from the queue.
  *
  * Removes the processed request data from the read buffer and updates the buffer
  * size.
  *
- * Changes the connection state to response and calls the response handler.
+ * Executes the request, changes the connection state to response and calls
+ * the response handler.
  *
- * Returns false if the request was fully handled, which continues the outer loop.
- * Returns true if the connection state changed back to requesting more data,
- * which breaks the outer loop.
+ * Returns true if the request was fully handled and the connection is back
+ * to reading, which continues the outer loop.
+ * Returns false if there is no complete request, the response could not be
+ * flushed yet, or the connection got blocked or closed.
  *
  * @param conn The connection containing the read/write buffers.
  * @return bool Whether the outer loop should continue or break.
  */
-static bool try_one_request(Conn *conn){
-    // try to parse a request from the buffer
-    if(conn->rbuf_size < 4){
-        // not enough data in the buffer wil retry in the next iteration
-        return false;
+bool try_one_request(Conn *conn){
+    lp_phase(LP_PARSE);
+    if(conn->proto == PROTO_UNKNOWN){
+        int32_t rv = resp_detect(conn->rbuf.data(), conn->rbuf_size, k_max_req);
+        if(rv < 0){
+            // not enough data in the buffer wil retry in the next iteration
+            return false;
+        }
+        conn->proto = rv ? PROTO_RESP : PROTO_NATIVE;
     }
 
-    uint32_t len = 0;
-    memcpy(&len, &conn->rbuf[0], 4);
-    
-    if(len > k_max_msg){
-        msg("too long");
-        conn->state = STATE_END;
-        return false;
+    std::vector<std::string> cmd;
+    if(conn->proto == PROTO_RESP){
+        if(conn->resp_queue.empty()){
+            size_t consumed = 0;
+            if(0 != resp_parse_batch(conn->rbuf.data(), conn->rbuf_size, k_max_req,
+                                     conn->resp_queue, &consumed, conn->resp_parse)){
+                msg("bad req");
+                conn->state = STATE_END;
+                return false;
+            }
+            if(consumed == 0 && conn->rbuf_size == 4 + k_max_req){
+                msg("too long");
+                conn->state = STATE_END;
+                return false;
+            }
+
+            // remove all the parsed requests from the buffer at once
+            size_t remain = conn->rbuf_size - consumed;
+            if(remain && consumed){
+                memmove(conn->rbuf.data(), &conn->rbuf[consumed], remain);
+            }
+            conn->rbuf_size = remain;
+        }
+        if(conn->resp_queue.empty()){
+            return false;
+        }
+        cmd.swap(conn->resp_queue.front());
+        conn->resp_queue.pop_front();
     }
+    else{
+        // try to parse a request from the buffer
+        if(conn->rbuf_size < 4){
+            // not enough data in the buffer wil retry in the next iteration
+            return false;
+        }
 
-    if(len + 4 > conn->rbuf_size){
-        return false;
+        uint32_t len = 0;
+        memcpy(&len, &conn->rbuf[0], 4);
+
+        if(len > k_max_req){
+            msg("too long");
+            conn->state = STATE_END;
+            return false;
+        }
+
+        if(len + 4 > conn->rbuf_size){
+            return false;
+        }
+
+        // got one request
+        if(0 != parse_req(&conn->rbuf[4], len, cmd)){
+            msg("bad req");
+            conn->state = STATE_END;
+            return false;
+        }
+
+        // remove the request from the buffer
+        size_t remain = conn->rbuf_size - 4 - len;
+        if (remain){
+            memmove(conn->rbuf.data(), &conn->rbuf[4 + len], remain);
+        }
+        conn->rbuf_size = remain;
     }
 
-    // got one request
-    // printf("Client says: %.*s\n", len, &conn->rbuf[4]);
+    bool bulk = conn->bulk;
+    std::string out;
+    lp_phase(LP_EXEC);
+    lp_request();
+    bool capturing = g_capture.load(std::memory_order_relaxed) != NULL;
+    if(!(g_io_threads && !capturing && try_read_fast(conn, cmd, out))){
+        CmdLock lock;
+        fast_reads_count();
+        uint64_t start_us = get_monotonic_usec();
+        Capture *cap = g_capture.load(std::memory_order_acquire);
+        if(cap && !capture_skips(cmd)){
+            capture_record(cap, start_us, (uint32_t)conn->id, cmd);
+        }
+        do_request(conn, cmd, out);
+        slowlog_check(conn, cmd, get_monotonic_usec() - start_us);
 
-    uint32_t rescode = 0;
-    uint32_t wlen = 0;
-    uint32_t err = do_request(&conn->rbuf[4], len, &rescode, &conn->wbuf[4 + 4], &wlen);
+        // Wake up connections blocked on lists this request pushed to
+        serve_ready_keys();
+    }
 
-    if(err){
-        conn->state = STATE_END;
+    // a blocking command parked the connection, it is replied to later
+    if(conn->state == STATE_BLOCK){
         return false;
     }
 
-    wlen += 4;
-    // generate echoing response
-    memcpy(&conn->wbuf[0], &wlen, 4);
-    memcpy(&conn->wbuf[4], &rescode, 4);
-    conn->wbuf_size = 4 + wlen;
-
-    // remove the request from the buffer
-    size_t remain = conn->rbuf_size - 4 - len;
-    if (remain){
-        memmove(conn->rbuf, &conn->rbuf[4 + len], remain);
+    // in bulk mode, only failed commands are replied to
+    if(bulk && conn->bulk){
+        conn->bulk_run++;
+        if(out[0] != SER_ERR){
+            rcstr_unref(conn->reply_ref);
+            conn->reply_ref = NULL;
+            return true;
+        }
+        conn->bulk_failed++;
     }
-    conn->rbuf_size = remain;
+
+    conn_write_response(conn, out);
 
     // change the state
     conn->state = STATE_RES;
@@ -416,8 +3109,10 @@ static bool try_one_request(Conn *conn){
  * It will read as much data as possible without blocking into the
  * receive buffer.
  *
- * The receive buffer has a fixed capacity, so it will return false
- * if the buffer is already full.
+ * A full receive buffer is doubled first, up to 4 + k_max_req bytes, as
+ * it can only be full while holding the start of a big request. Once
+ * empty again it goes back to its initial size, so an idle connection
+ * does not keep a big buffer.
  *
  * It also watches out for EOF and errors on the socket. If EOF is
  * received, it will transition the connection state to CLOSED. For
@@ -429,11 +3124,15 @@ static bool try_one_request(Conn *conn){
  */
 static bool try_fill_buffer(Conn *conn){
     // try to fill the buffer
-    assert(conn->rbuf_size < sizeof(conn->rbuf));
+    if(conn->rbuf_size == conn->rbuf.size()){
+        conn->rbuf.resize(std::min(2 * conn->rbuf.size(), 4 + k_max_req));
+    }
+    assert(conn->rbuf_size < conn->rbuf.size());
     ssize_t rv = 0;
 
+    lp_phase(LP_READ);
     do{
-       size_t cap = sizeof(conn->rbuf) - conn->rbuf_size;
+       size_t cap = conn->rbuf.size() - conn->rbuf_size;
        rv = read(conn->fd,&conn->rbuf[conn->rbuf_size], cap); 
     }while(rv < 0 && errno == EINTR);
 
@@ -459,10 +3158,14 @@ static bool try_fill_buffer(Conn *conn){
     }
 
     conn->rbuf_size += rv;
-    assert(conn->rbuf_size <= sizeof(conn->rbuf));
+    assert(conn->rbuf_size <= conn->rbuf.size());
 
     // try to process requests one by one
     while(try_one_request(conn)){}
+
+    if(conn->rbuf_size == 0 && conn->rbuf.size() > 4 + k_max_msg){
+        std::vector<uint8_t>(4 + k_max_msg).swap(conn->rbuf);
+    }
     return (conn->state == STATE_REQ);
 }
 
@@ -472,9 +3175,11 @@ static bool try_fill_buffer(Conn *conn){
  * This will attempt to write any remaining unsent data in the write buffer
  * to the socket. It will repeatedly call write() in a loop until either:
  *
- * - All data is successfully written (wbuf_sent == wbuf_size)
+ * - All data is successfully written, including a value sent by reference
+ *   (wref) in the middle of the buffer, using writev()
  * - An error occurs other than EAGAIN (e.g. broken pipe)
- * - write() returns EAGAIN, indicating the socket is not ready for more writes.
+ * - write() returns EAGAIN, indicating the socket is not ready for more
+ *   writes; the event loop calls again on POLLOUT.
  *
  * On success (all data flushed), it will reset the write buffer and
  * transition the connection state back to STATE_REQ.
@@ -486,15 +3191,42 @@ static bool try_fill_buffer(Conn *conn){
  *  - false if the buffer has been completely flushed.
  */
 static bool try_flush_buffer(Conn *conn){
+    // what is left of wbuf[0, wref_at), the referenced value and the rest
+    // of wbuf, skipping the `wbuf_sent` bytes already written
+    size_t ref_len = conn->wref ? conn->wref->str.size() : 0;
+    size_t total = conn->wbuf_size + ref_len;
+    struct iovec iov[3];
+    int niov = 0;
+    size_t skip = conn->wbuf_sent;
+    if(conn->wref){
+        if(skip < conn->wref_at){
+            iov[niov++] = {&conn->wbuf[skip], conn->wref_at - skip};
+            skip = 0;
+        }
+        else{
+            skip -= conn->wref_at;
+        }
+        if(skip < ref_len){
+            iov[niov++] = {(void *)&conn->wref->str[skip], ref_len - skip};
+            skip = 0;
+        }
+        else{
+            skip -= ref_len;
+        }
+        skip += conn->wref_at;
+    }
+    if(skip < conn->wbuf_size){
+        iov[niov++] = {&conn->wbuf[skip], conn->wbuf_size - skip};
+    }
+
     ssize_t rv = 0;
+    lp_phase(LP_WRITE);
     do{
-        size_t remain = conn->wbuf_size - conn->wbuf_sent;
-        rv = write(conn->fd, &conn->wbuf[conn->wbuf_sent], remain);
-
-    }while(rv < 0 && errno == EAGAIN);
+        rv = writev(conn->fd, iov, niov);
+    }while(rv < 0 && errno == EINTR);
 
     if (rv < 0 && errno == EAGAIN) {
-        // got EAGAIN, stop.
+        // the socket is full, wait for POLLOUT
         return false;
     }
     if (rv < 0) {
@@ -504,13 +3236,16 @@ static bool try_flush_buffer(Conn *conn){
     }
 
     conn->wbuf_sent += (size_t)rv;
-    assert(conn->wbuf_sent <= conn->wbuf_size);
+    assert(conn->wbuf_sent <= total);
 
-    if(conn->wbuf_sent == conn->wbuf_size){
+    if(conn->wbuf_sent == total){
         // response was full sent
         conn->state = STATE_REQ;
         conn->wbuf_sent = 0;
         conn->wbuf_size = 0;
+        rcstr_unref(conn->wref);
+        conn->wref = NULL;
+        conn->wref_at = 0;
         return false; 
     }
 
@@ -543,12 +3278,49 @@ static void fd_set_nb(int fd){
     }
 }
 
+/*
+ * Reads from a connection parked in BLPOP. Requests pipelined behind the
+ * blocking one wait in rbuf until it is replied to; EOF takes it off the
+ * wait queues at once, so a push does not hand an element to a closed
+ * socket.
+ */
+static void block_read(Conn *conn){
+    if(conn->rbuf_size == conn->rbuf.size() && conn->rbuf.size() < 4 + k_max_req){
+        conn->rbuf.resize(std::min(2 * conn->rbuf.size(), 4 + k_max_req));
+    }
+    // with no room left, it is only polled for a hangup
+    if(conn->rbuf_size < conn->rbuf.size()){
+        ssize_t rv = 0;
+        lp_phase(LP_READ);
+        do{
+            rv = read(conn->fd, &conn->rbuf[conn->rbuf_size], conn->rbuf.size() - conn->rbuf_size);
+        }while(rv < 0 && errno == EINTR);
+        if(rv < 0 && errno == EAGAIN){
+            return;
+        }
+        if(rv > 0){
+            conn->rbuf_size += (size_t)rv;
+            return;
+        }
+    }
+    CmdLock lock;
+    unblock_conn(conn);
+    conn->state = STATE_END;
+}
+
 static void connection_io(Conn *conn){
     if(conn->state == STATE_REQ){
         state_req(conn);
     }
     else if(conn->state == STATE_RES){
         state_res(conn);
+        // a response that had to wait may have left pipelined requests behind
+        if(conn->state == STATE_REQ){
+            while(try_one_request(conn)){}
+        }
+    }
+    else if(conn->state == STATE_BLOCK){
+        block_read(conn);
     }
     else {
         assert(0);
@@ -556,6 +3328,19 @@ static void connection_io(Conn *conn){
 
 }
 
+/**
+ * Closes a connection and frees it, after taking it off every wait queue
+ * that may still point at it.
+ */
+void conn_free(Conn *conn){
+    unblock_conn(conn);
+    tracking_off(conn);
+    rcstr_unref(conn->wref);
+    rcstr_unref(conn->reply_ref);
+    (void)close(conn->fd);
+    delete conn;
+}
+
 static void conn_put(std::vector<Conn*> &fd2conn, Conn *conn){
     if(fd2conn.size() <= (size_t)conn->fd){
         fd2conn.resize(conn->fd+1);
@@ -563,9 +3348,11 @@ static void conn_put(std::vector<Conn*> &fd2conn, Conn *conn){
     fd2conn[conn->fd] = conn;
 }
 
+static void io_thread_add(Conn *conn);
+
 static int32_t accept_new_connection(std::vector<Conn *> &fd2conn, int fd){
-    // accept 
-    struct sockaddr_in client_addr = {};
+    // accept, from TCP or a Unix domain socket
+    struct sockaddr_storage client_addr = {};
     socklen_t socklen = sizeof(client_addr);
     int connfd = accept(fd, (struct sockaddr *)&client_addr, &socklen);
     if(connfd < 0){
@@ -576,26 +3363,180 @@ static int32_t accept_new_connection(std::vector<Conn *> &fd2conn, int fd){
     // set the new connection tfd to nonblocking mode
     fd_set_nb(connfd);
 
+    // responses are small writes, don't let Nagle hold them back waiting
+    // for the ACK of the previous one
+    if(client_addr.ss_family != AF_UNIX){
+        int val = 1;
+        (void)setsockopt(connfd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+    }
+
     // Create a connection struct
-    Conn *conn = (Conn*) malloc(sizeof(Conn));
+    Conn *conn = new Conn();
     conn->fd = connfd;
+    conn->id = ++g_conn_id_seq;
     conn->state = STATE_REQ;
     conn->rbuf_size = 0;
     conn->wbuf_size = 0;
     conn->wbuf_sent = 0;
-    conn_put(fd2conn, conn);
+    if(g_io_threads){
+        io_thread_add(conn);
+    }
+    else{
+        conn_put(fd2conn, conn);
+    }
 
     return 0;
 }
 
+// adds a pollfd for every connection, for the events its state waits on,
+// and closes those over their output limits
+static void conns_poll_args(std::vector<Conn *> &fd2conn, std::vector<pollfd> &poll_args){
+    uint64_t now_us = get_monotonic_usec();
+    for(Conn* con : fd2conn){
+        if(!con)
+            continue;
+        if(!conn_out_ok(con, now_us)){
+            msg("output buffer limit");
+            fd2conn[con->fd] = NULL;
+            CmdLock lock;
+            conn_free(con);
+            continue;
+        }
+        // start writing pushes queued for an idle connection
+        if(con->state == STATE_REQ && !con->pushes.empty()){
+            conn_flush_pushes(con);
+            con->state = STATE_RES;
+        }
+        struct pollfd pfd = {};
+        pfd.fd = con->fd;
+        if(con->state == STATE_REQ){
+            pfd.events = POLLIN;
+        }
+        else if(con->state == STATE_RES){
+            pfd.events = POLLOUT;
+        }
+        else if(con->state == STATE_BLOCK){
+            pfd.events = POLLRDHUP;
+            if(con->rbuf_size < 4 + k_max_req){
+                pfd.events |= POLLIN;
+            }
+        }
+        pfd.events = pfd.events | POLLERR;
+        poll_args.push_back(pfd);
+    }
+}
+
+// does the IO of connections with events, from poll_args[first] on
+static void conns_io(std::vector<Conn *> &fd2conn, std::vector<pollfd> &poll_args, size_t first){
+    for(size_t i = first; i<poll_args.size();++i){
+        if(poll_args[i].revents){
+            Conn *conn = fd2conn[poll_args[i].fd];
+            connection_io(conn);
+            if(conn->state == STATE_END){
+                // client closed normally or something bad happened
+                // destroy this connection
+                lp_phase(LP_OTHER);
+                fd2conn[conn->fd] = NULL;
+                CmdLock lock;
+                conn_free(conn);
+            }
+        }
+    }
+}
+
+struct IoThread {
+    int wake[2] = {-1, -1};         // a byte per connection handed over
+    std::mutex lock;
+    std::vector<Conn *> incoming;   // handed over, not polled yet
+};
+
+static std::vector<IoThread *> g_io;
+static size_t g_io_next = 0;
+
+void set_io_threads(int n){
+    g_io_threads = std::max(0, std::min(n, (int)k_epoch_max_readers));
+}
+
+// the poll loop of an I/O thread
+static void io_thread_main(IoThread *t){
+    epoch_register();
+    std::vector<Conn *> fd2conn;
+    std::vector<pollfd> poll_args;
+    while(true){
+        lp_begin(loop_profile());
+        poll_args.clear();
+        struct pollfd wake = {t->wake[0], POLLIN, 0};
+        poll_args.push_back(wake);
+        conns_poll_args(fd2conn, poll_args);
+
+        // wake up now and then to check output limits
+        lp_phase(LP_POLL);
+        int rv = poll(poll_args.data(), (nfds_t)poll_args.size(), 1000);
+        lp_phase(LP_OTHER);
+        if(rv < 0){
+            if(errno == EINTR){
+                lp_end();
+                continue;
+            }
+            die("poll");
+        }
+        lp_events((uint32_t)rv);
+        conns_io(fd2conn, poll_args, 1);
+        lp_phase(LP_EXEC);
+        fast_reads_flush();
+        lp_phase(LP_OTHER);
+
+        if(poll_args[0].revents){
+            char buf[64];
+            (void)read(t->wake[0], buf, sizeof(buf));
+            std::lock_guard<std::mutex> lock(t->lock);
+            for(Conn *conn : t->incoming){
+                conn_put(fd2conn, conn);
+            }
+            t->incoming.clear();
+        }
+        lp_end();
+    }
+}
+
+// hands a new connection to the next I/O thread
+static void io_thread_add(Conn *conn){
+    IoThread *t = g_io[g_io_next++ % g_io.size()];
+    {
+        std::lock_guard<std::mutex> lock(t->lock);
+        t->incoming.push_back(conn);
+    }
+    (void)write(t->wake[1], "c", 1);
+}
+
+// builds the read index from the keyspace and starts the threads
+static void io_threads_start(){
+    g_rindex = ri_new();
+    for(auto &it : g_map){
+        rindex_sync(it.first, it.second);
+    }
+    // so the first GETs on the threads do not wait for it
+    (void)shared_ints();
+    for(int i = 0; i < g_io_threads; ++i){
+        IoThread *t = new IoThread();
+        if(pipe(t->wake) < 0){
+            die("pipe()");
+        }
+        fd_set_nb(t->wake[0]);
+        g_io.push_back(t);
+        std::thread(io_thread_main, t).detach();
+    }
+}
+
 /**
- * Accepts new connections on the given server socket and handles IO with
+ * Accepts new connections on the given server sockets and handles IO with
  * existing connections.
  *
  * This uses poll() to monitor sockets for events and non-blocking IO.
  *
  * Parameters:
- * - server_sock: The listening server socket to accept connections on.
+ * - server_socks: The listening server sockets to accept connections on,
+ *   any mix of TCP and Unix domain sockets.
  *
  * It maintains a map (fd2conn) from socket FDs to Conn objects representing
  * each connection.
@@ -604,63 +3545,83 @@ static int32_t accept_new_connection(std::vector<Conn *> &fd2conn, int fd){
  * - Accepting new connections
  * - Reading requests from connections in STATE_REQ
  * - Writing responses to connections in STATE_RES
+ * - Timing out connections parked in STATE_BLOCK by BLPOP
  *
  * If a socket has an error or closes, its Conn is freed.
  */
-void accept_connection(int server_sock){
+void accept_connections(const std::vector<int> &server_socks){
 
     // a map of all client connections, keyed by fd
     std::vector<Conn *> fd2conn;
 
-    // set the listen fd to non-blocking
-    fd_set_nb(server_sock);
+    // set the listen fds to non-blocking
+    for(int server_sock : server_socks){
+        fd_set_nb(server_sock);
+    }
+    size_t nlisten = server_socks.size();
+
+    if(g_io_threads){
+        io_threads_start();
+    }
 
     // event loop
     std::vector<pollfd> poll_args;
+    bool tier_busy = false;
     while(true){
+        lp_begin(loop_profile());
 
         // prepare arguments for poll
         poll_args.clear();
 
-        // the listening fd is put in the first position
-        struct pollfd pfd = {server_sock, POLLIN, 0};
-
-        poll_args.push_back(pfd);
-
-        // connection fds
-        for(Conn* con : fd2conn){
-            if(!con)
-                continue;
-            struct pollfd pfd = {};
-            pfd.fd = con->fd;
-            pfd.events = (con->state == STATE_REQ) ? POLLIN : POLLOUT;
-            pfd.events = pfd.events | POLLERR;
+        // the listening fds are put in the first positions
+        for(int server_sock : server_socks){
+            struct pollfd pfd = {server_sock, POLLIN, 0};
             poll_args.push_back(pfd);
         }
 
-        // poll for activ fds
-        int rv = poll(poll_args.data(), (nfds_t)poll_args.size(), 1000);
+        // connection fds
+        conns_poll_args(fd2conn, poll_args);
+
+        // poll for activ fds, without waiting while tiering has work left
+        int timeout_ms = next_block_timeout_ms(fd2conn, get_monotonic_usec(), tier_busy ? 0 : 1000);
+        lp_phase(LP_POLL);
+        int rv = poll(poll_args.data(), (nfds_t)poll_args.size(), timeout_ms);
+        lp_phase(LP_OTHER);
         if(rv < 0){
             die("poll");
         }
+        lp_events((uint32_t)rv);
 
         // process actiev connections
-        for(size_t i = 1; i<poll_args.size();++i){
-            if(poll_args[i].revents){
-                Conn *conn = fd2conn[poll_args[i].fd];
-                connection_io(conn);
-                if(conn->state == STATE_END){
-                    // client closed normally or something bad happened
-                    // destroy this connection
-                    fd2conn[conn->fd] = NULL;
-                    (void)close(conn->fd);
-                    free(conn);
-                }
+        conns_io(fd2conn, poll_args, nlisten);
+
+        lp_phase(LP_CRON);
+        {
+            CmdLock lock;
+
+            // reply to BLPOP waiters that ran out of time
+            expire_blocked(fd2conn, get_monotonic_usec());
+
+            // move cold values to disk and compact the value log
+            tier_busy = tier_cron();
+
+            // free what I/O threads may have still been reading
+            if(g_rindex){
+                epoch_reclaim();
             }
         }
 
-        if(poll_args[0].revents){
-            (void)accept_new_connection(fd2conn,server_sock);
+        lp_phase(LP_ACCEPT);
+        for(size_t i = 0; i < nlisten; ++i){
+            if(poll_args[i].revents){
+                (void)accept_new_connection(fd2conn, server_socks[i]);
+            }
         }
+        lp_end();
     }
+}
+
+// runs the event loop on a single listening socket
+void accept_connection(int server_sock){
+    accept_connections({server_sock});
 }
\ No newline at end of file
@@ -7,48 +7,153 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/un.h>
 #include <assert.h>
 #include <vector>
+#include <algorithm>
+#include <sys/uio.h>
 #include <poll.h>
 #include <fcntl.h>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <time.h>
 #include <string>
+#include <math.h>
 
+#include "resp.h"
 
+
+// size of a connection's write buffer; a bigger reply is sent from a
+// string of its own, and string values by reference (see RcStr)
 const size_t k_max_msg = 4096;
+// largest request, which also bounds the size of a value
+const size_t k_max_req = (size_t)32 << 20;
 
 enum {
     STATE_REQ = 0,
     STATE_RES = 1,
     STATE_END = 2,      // Mark the connection for deletion
+    STATE_BLOCK = 3,    // Parked in a blocking command, waiting for data
+};
+
+// wire protocol of a connection, detected from its first bytes
+enum {
+    PROTO_UNKNOWN = 0,
+    PROTO_NATIVE = 1,   // 4-byte length framing
+    PROTO_RESP = 2,     // Redis serialization protocol
+};
+
+// tags of the serialized response values
+enum {
+    SER_NIL = 0,    // like `NULL`
+    SER_ERR = 1,    // an error code and message
+    SER_STR = 2,    // a string
+    SER_INT = 3,    // an int64
+    SER_DBL = 4,    // a double
+    SER_ARR = 5,    // an array of values
+    SER_PUSH = 6,   // like SER_ARR, but sent unasked, e.g. an invalidation
+    SER_STATUS = 7, // a status such as OK, encoded like SER_STR
 };
 
+// error codes carried by SER_ERR
 enum {
-    RES_OK = 0,
-    RES_ERR = 1,
-    RES_NX = 2,
+    ERR_UNKNOWN = 1,    // unknown command
+    ERR_2BIG = 2,       // response does not fit in a message
+    ERR_TYPE = 3,       // key holds the wrong type
+    ERR_ARG = 4,        // bad argument
 };
 
+struct RcStr;
+
 struct Conn {
     int fd = -1;
     uint32_t state = 0;
-    // buffer for reading
+    // buffer for reading, grown up to 4 + k_max_req for big requests
     size_t rbuf_size = 0;
-    uint8_t rbuf[4 + k_max_msg];
+    std::vector<uint8_t> rbuf = std::vector<uint8_t>(4 + k_max_msg);
+    // buffer for writing; `wref` is sent by reference between
+    // wbuf[0, wref_at) and wbuf[wref_at, wbuf_size), and `wbuf_sent` counts
+    // the bytes sent out of all three
     size_t wbuf_size = 0;
     size_t wbuf_sent = 0;
     uint8_t wbuf[4 + k_max_msg];
+    RcStr *wref = NULL;
+    size_t wref_at = 0;
+    RcStr *reply_ref = NULL;    // the tail of the reply being built
+    // blocking commands
+    uint64_t block_deadline_us = 0;     // 0 waits forever
+    std::vector<std::string> block_keys;
+    // protocol
+    uint32_t proto = PROTO_UNKNOWN;
+    uint32_t resp_ver = 2;
+    std::deque<std::vector<std::string>> resp_queue;    // parsed, not yet run
+    RespParse resp_parse;               // the partial command in rbuf
+    // transactions
+    bool in_multi = false;
+    bool in_exec = false;
+    std::vector<std::vector<std::string>> multi_queue;
+    std::vector<std::pair<std::string, uint64_t>> watched;  // key, version
+    // client side caching
+    uint64_t id = 0;                    // unique, unlike fds, which are reused
+    bool tracking = false;
+    bool tracking_bcast = false;
+    std::vector<std::string> tracking_prefixes;
+    std::deque<std::string> pushes;     // framed, waiting for room in wbuf
+    // bulk loading, see CLIENT BULK
+    bool bulk = false;
+    uint64_t bulk_run = 0;
+    uint64_t bulk_failed = 0;
+    // output limits, see conn_out_ok()
+    size_t push_bytes = 0;              // in `pushes`
+    bool out_over_hard = false;         // pushes were dropped, close it
+    uint64_t out_soft_since_us = 0;     // over the soft limit since, or 0
 };
 
 int create_server_socket();
 int create_client_socket();
+int create_unix_server_socket(const char *path);
+int create_unix_client_socket();
 
 void bind_socket(int socket, uint16_t);
 void listen_socket(int socket);
 void accept_connection(int socket);
+void accept_connections(const std::vector<int> &sockets);
+// where the value log of tiered storage is kept, the working directory by default
+void tiering_set_dir(const char *dir);
+// serves connections on `n` threads, see "I/O threads" in server.cpp; set
+// before accept_connections()
+void set_io_threads(int n);
+// the file SAVE writes to
+void set_snapshot_path(const char *path);
+// where CAPTURE START writes its files, the working directory by default
+void set_capture_dir(const char *dir);
+// replaces the keyspace with a snapshot, decoding its chunks on `nthreads`
+// threads; before accept_connections(), false if it can not be read
+bool snapshot_load(const char *path, int nthreads);
 int connect(int socket, uint32_t ip, uint16_t port);
+int connect_unix(int socket, const char *path);
+
+// request processing, exposed for benchmarks and fuzzing
+void do_request(Conn *conn, std::vector<std::string> &cmd, std::string &out);
+bool try_one_request(Conn *conn);
+void conn_free(Conn *conn);
 
+// appends `cmd` to `buf`, framed as send_req() sends it; -1 if too long
+int32_t append_req(std::string &buf, const std::vector<std::string> &cmd);
 int32_t send_req(int fd, std::vector<std::string> &cmd);
 int32_t read_res(int fd);
 
+struct PipeStats {
+    uint64_t sent = 0;          // commands sent
+    uint64_t errors = 0;        // of those, failed
+    uint64_t bad_lines = 0;     // input lines that are not a command
+};
+
+// sends the commands in `in`, one per line, in bulk mode; see client.cpp
+int32_t pipe_mode(int fd, FILE *in, PipeStats &stats);
+
 void die(const char *message);
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include "slowlog.h"
+
+#include <time.h>
+
+struct Slowlog {
+    std::vector<SlowlogEntry> ring;     // capacity is the max length
+    size_t next = 0;                    // slot written by the next push
+    size_t count = 0;
+    uint64_t next_id = 0;
+};
+
+Slowlog *slowlog_new(size_t max_len){
+    Slowlog *sl = new Slowlog();
+    sl->ring.resize(max_len);
+    return sl;
+}
+
+void slowlog_free(Slowlog *sl){
+    delete sl;
+}
+
+void slowlog_arg(std::string &dst, const std::string &src){
+    if(src.size() <= k_slowlog_max_arglen){
+        dst.assign(src);
+        return;
+    }
+    dst.assign(src, 0, k_slowlog_max_arglen);
+    dst += "... (" + std::to_string(src.size() - k_slowlog_max_arglen) + " more bytes)";
+}
+
+void slowlog_args(std::vector<std::string> &out, const std::vector<std::string> &cmd){
+    // the last slot notes how many arguments were left out
+    size_t argc = cmd.size();
+    if(argc > k_slowlog_max_argc){
+        argc = k_slowlog_max_argc - 1;
+    }
+    out.resize(argc);
+    for(size_t i = 0; i < argc; ++i){
+        slowlog_arg(out[i], cmd[i]);
+    }
+    if(argc < cmd.size()){
+        out.push_back("... (" + std::to_string(cmd.size() - argc) + " more arguments)");
+    }
+}
+
+// the slot of a new record, filled but for its arguments
+static SlowlogEntry &slowlog_next(Slowlog *sl, int fd, uint64_t duration_us){
+    SlowlogEntry &ent = sl->ring[sl->next];
+    ent.id = sl->next_id++;
+    ent.unix_time = (int64_t)time(NULL);
+    ent.duration_us = duration_us;
+    ent.fd = fd;
+    sl->next = (sl->next + 1) % sl->ring.size();
+    if(sl->count < sl->ring.size()){
+        sl->count++;
+    }
+    return ent;
+}
+
+void slowlog_push(Slowlog *sl, const std::vector<std::string> &cmd, int fd,
+                  uint64_t duration_us){
+    if(sl->ring.empty()){
+        return;
+    }
+    slowlog_args(slowlog_next(sl, fd, duration_us).args, cmd);
+}
+
+void slowlog_push_args(Slowlog *sl, std::vector<std::string> &args, int fd,
+                       uint64_t duration_us){
+    if(sl->ring.empty()){
+        return;
+    }
+    slowlog_next(sl, fd, duration_us).args.swap(args);
+}
+
+size_t slowlog_len(const Slowlog *sl){
+    return sl->count;
+}
+
+void slowlog_reset(Slowlog *sl){
+    for(SlowlogEntry &ent : sl->ring){
+        ent = SlowlogEntry();
+    }
+    sl->next = 0;
+    sl->count = 0;
+}
+
+void slowlog_set_max_len(Slowlog *sl, size_t max_len){
+    if(max_len == sl->ring.size()){
+        return;
+    }
+    std::vector<SlowlogEntry> ring(max_len);
+    size_t keep = sl->count < max_len ? sl->count : max_len;
+    // oldest kept record first, so the newest ends up just before `next`
+    for(size_t i = 0; i < keep; ++i){
+        size_t src = (sl->next + sl->ring.size() - keep + i) % sl->ring.size();
+        ring[i] = std::move(sl->ring[src]);
+    }
+    sl->ring.swap(ring);
+    sl->count = keep;
+    sl->next = max_len ? keep % max_len : 0;
+}
+
+const SlowlogEntry *slowlog_get(const Slowlog *sl, size_t i){
+    if(i >= sl->count){
+        return NULL;
+    }
+    size_t n = sl->ring.size();
+    return &sl->ring[(sl->next + n - 1 - i) % n];
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/*
+ * Slow log: a fixed-size ring of the most recent commands whose execution
+ * took longer than a threshold.
+ *
+ * The caller times the command and only calls slowlog_push() when it was
+ * slow, so the fast path costs a clock read on each side of the command.
+ * Arguments are copied with a cap on their count and length, so one huge
+ * SET does not pin megabytes in the log. Slots are reused in place once the
+ * ring is full, which overwrites the oldest record.
+ */
+
+const size_t k_slowlog_max_argc = 32;
+const size_t k_slowlog_max_arglen = 128;
+
+struct SlowlogEntry {
+    uint64_t id = 0;            // increasing, never reused
+    int64_t unix_time = 0;      // seconds, when the command was logged
+    uint64_t duration_us = 0;
+    int fd = -1;                // the client that sent the command
+    std::vector<std::string> args;
+};
+
+struct Slowlog;
+
+Slowlog *slowlog_new(size_t max_len);
+void slowlog_free(Slowlog *sl);
+
+void slowlog_push(Slowlog *sl, const std::vector<std::string> &cmd, int fd,
+                  uint64_t duration_us);
+// the arguments of `cmd` as a record keeps them, for a caller that fixes
+// some up before pushing them
+void slowlog_args(std::vector<std::string> &out, const std::vector<std::string> &cmd);
+// one argument as a record keeps it, the cut part replaced with its size
+void slowlog_arg(std::string &dst, const std::string &src);
+// like slowlog_push(), with arguments cut by slowlog_args(); they are taken,
+// and `args` is left with the buffers of the record it overwrote
+void slowlog_push_args(Slowlog *sl, std::vector<std::string> &args, int fd,
+                       uint64_t duration_us);
+size_t slowlog_len(const Slowlog *sl);
+void slowlog_reset(Slowlog *sl);
+// keeps the newest records that still fit
+void slowlog_set_max_len(Slowlog *sl, size_t max_len);
+
+// i = 0 is the newest record, up to slowlog_len() - 1
+const SlowlogEntry *slowlog_get(const Slowlog *sl, size_t i);
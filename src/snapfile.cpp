@@ -0,0 +1,216 @@
+#include "snapfile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+static const char k_magic[8] = {'S', 'N', 'A', 'P', '0', '0', '0', '1'};
+const size_t k_footer_entry = 8 + 4 + 4 + 4;
+const size_t k_tail = 4 + 8 + 8;
+
+struct SnapWriter {
+    int fd = -1;
+    std::string path;
+    std::string tmp_path;
+    size_t chunk_bytes = 0;
+    uint64_t offset = 0;            // of the chunk being built
+    std::string chunk;
+    uint32_t records = 0;
+    std::vector<SnapChunk> chunks;
+    bool ok = true;
+};
+
+// Castagnoli polynomial, reflected
+static uint32_t g_crc_table[256];
+
+static bool crc_table_init(){
+    for(uint32_t i = 0; i < 256; ++i){
+        uint32_t c = i;
+        for(int k = 0; k < 8; ++k){
+            c = (c >> 1) ^ (0x82f63b78 & (0 - (c & 1)));
+        }
+        g_crc_table[i] = c;
+    }
+    return true;
+}
+
+uint32_t crc32c(uint32_t crc, const char *data, size_t len){
+    static const bool ready = crc_table_init();
+    (void)ready;
+    crc = ~crc;
+    const uint8_t *p = (const uint8_t *)data;
+#if defined(__SSE4_2__)
+    for(; len >= 8; len -= 8, p += 8){
+        uint64_t v;
+        memcpy(&v, p, 8);
+        crc = (uint32_t)_mm_crc32_u64(crc, v);
+    }
+#endif
+    for(; len > 0; --len, ++p){
+        crc = g_crc_table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static bool write_all(int fd, const char *buf, size_t n){
+    while(n > 0){
+        ssize_t rv = write(fd, buf, n);
+        if(rv < 0 && errno == EINTR){
+            continue;
+        }
+        if(rv <= 0){
+            return false;
+        }
+        buf += rv;
+        n -= (size_t)rv;
+    }
+    return true;
+}
+
+static bool pread_full(int fd, char *buf, size_t n, uint64_t off){
+    while(n > 0){
+        ssize_t rv = pread(fd, buf, n, (off_t)off);
+        if(rv < 0 && errno == EINTR){
+            continue;
+        }
+        if(rv <= 0){
+            return false;
+        }
+        buf += rv;
+        n -= (size_t)rv;
+        off += (uint64_t)rv;
+    }
+    return true;
+}
+
+SnapWriter *snap_create(const char *path, size_t chunk_bytes){
+    SnapWriter *w = new SnapWriter();
+    w->path = path;
+    w->tmp_path = w->path + ".tmp";
+    w->chunk_bytes = chunk_bytes;
+    w->fd = open(w->tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(w->fd < 0 || !write_all(w->fd, k_magic, sizeof(k_magic))){
+        snap_abort(w);
+        return NULL;
+    }
+    w->offset = sizeof(k_magic);
+    return w;
+}
+
+static void flush_chunk(SnapWriter *w){
+    if(w->chunk.empty()){
+        return;
+    }
+    SnapChunk c;
+    c.offset = w->offset;
+    c.len = (uint32_t)w->chunk.size();
+    c.records = w->records;
+    c.crc = crc32c(0, w->chunk.data(), w->chunk.size());
+    w->ok = w->ok && w->chunk.size() <= UINT32_MAX
+        && write_all(w->fd, w->chunk.data(), w->chunk.size());
+    w->chunks.push_back(c);
+    w->offset += w->chunk.size();
+    w->chunk.clear();
+    w->records = 0;
+}
+
+bool snap_append(SnapWriter *w, const char *rec, size_t len){
+    w->chunk.append(rec, len);
+    w->records++;
+    if(w->chunk.size() >= w->chunk_bytes){
+        flush_chunk(w);
+    }
+    return w->ok;
+}
+
+bool snap_finish(SnapWriter *w){
+    flush_chunk(w);
+    std::string footer;
+    for(const SnapChunk &c : w->chunks){
+        footer.append((const char *)&c.offset, 8);
+        footer.append((const char *)&c.len, 4);
+        footer.append((const char *)&c.records, 4);
+        footer.append((const char *)&c.crc, 4);
+    }
+    uint32_t n = (uint32_t)w->chunks.size();
+    footer.append((const char *)&n, 4);
+    footer.append((const char *)&w->offset, 8);
+    footer.append(k_magic, sizeof(k_magic));
+
+    bool ok = w->ok && write_all(w->fd, footer.data(), footer.size())
+        && fsync(w->fd) == 0;
+    ok = (close(w->fd) == 0) && ok;
+    w->fd = -1;
+    ok = ok && rename(w->tmp_path.c_str(), w->path.c_str()) == 0;
+    if(!ok){
+        (void)unlink(w->tmp_path.c_str());
+    }
+    delete w;
+    return ok;
+}
+
+void snap_abort(SnapWriter *w){
+    if(w->fd >= 0){
+        close(w->fd);
+    }
+    (void)unlink(w->tmp_path.c_str());
+    delete w;
+}
+
+int snap_open(const char *path, std::vector<SnapChunk> &chunks){
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return -1;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    char tail[k_tail];
+    char head[sizeof(k_magic)];
+    if(size < (off_t)(sizeof(k_magic) + k_tail)
+        || !pread_full(fd, head, sizeof(head), 0)
+        || !pread_full(fd, tail, k_tail, (uint64_t)size - k_tail)
+        || memcmp(head, k_magic, sizeof(k_magic)) != 0
+        || memcmp(&tail[12], k_magic, sizeof(k_magic)) != 0){
+        close(fd);
+        return -1;
+    }
+    uint32_t n = 0;
+    uint64_t footer_off = 0;
+    memcpy(&n, &tail[0], 4);
+    memcpy(&footer_off, &tail[4], 8);
+    if(footer_off + (uint64_t)n * k_footer_entry + k_tail != (uint64_t)size){
+        close(fd);
+        return -1;
+    }
+
+    std::string footer((size_t)n * k_footer_entry, '\0');
+    if(!pread_full(fd, &footer[0], footer.size(), footer_off)){
+        close(fd);
+        return -1;
+    }
+    chunks.resize(n);
+    for(uint32_t i = 0; i < n; ++i){
+        const char *p = &footer[(size_t)i * k_footer_entry];
+        SnapChunk &c = chunks[i];
+        memcpy(&c.offset, p, 8);
+        memcpy(&c.len, p + 8, 4);
+        memcpy(&c.records, p + 12, 4);
+        memcpy(&c.crc, p + 16, 4);
+        if(c.offset + c.len > footer_off){
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+bool snap_read_chunk(int fd, const SnapChunk &chunk, std::string &buf){
+    buf.resize(chunk.len);
+    return pread_full(fd, &buf[0], buf.size(), chunk.offset)
+        && crc32c(0, buf.data(), buf.size()) == chunk.crc;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/*
+ * Snapshot files: records split into chunks that can each be read and
+ * decoded on their own, so a loader can hand chunks to several threads.
+ *
+ *   [8B magic]
+ *   [chunk 0][chunk 1]...[chunk n-1]
+ *   [footer: per chunk, 8B offset, 4B length, 4B record count, 4B CRC-32C]
+ *   [4B chunk count][8B footer offset][8B magic]
+ *
+ * A chunk is records back to back, whose encoding is up to the caller; a
+ * chunk is cut at the first record boundary past the chunk size. The tail
+ * is read first to find the footer, and every chunk is checked against its
+ * CRC when read. A snapshot is written to `<path>.tmp` and renamed over
+ * `path` when complete, so a crash while saving leaves the old one.
+ */
+
+struct SnapChunk {
+    uint64_t offset = 0;
+    uint32_t len = 0;
+    uint32_t records = 0;
+    uint32_t crc = 0;
+};
+
+struct SnapWriter;
+
+// NULL if the file can not be created
+SnapWriter *snap_create(const char *path, size_t chunk_bytes);
+bool snap_append(SnapWriter *w, const char *rec, size_t len);
+// writes the footer and puts the file in place; frees `w` either way
+bool snap_finish(SnapWriter *w);
+// drops the file being written and frees `w`
+void snap_abort(SnapWriter *w);
+
+// opens a snapshot and reads its footer; returns the fd, or -1
+int snap_open(const char *path, std::vector<SnapChunk> &chunks);
+// reads a chunk, safe to call from several threads on one fd; false if it
+// can not be read or its CRC does not match
+bool snap_read_chunk(int fd, const SnapChunk &chunk, std::string &buf);
+
+uint32_t crc32c(uint32_t crc, const char *data, size_t len);
@@ -0,0 +1,222 @@
+#include "vlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <vector>
+
+const size_t k_rec_header = 8;
+
+struct Segment {
+    int fd = -1;                // -1 for an unused segment number
+    uint64_t size = 0;          // bytes written
+    uint64_t value_bytes = 0;   // value bytes appended
+    uint64_t live_bytes = 0;    // value bytes not released yet
+    bool skip = false;          // see vlog_skip()
+};
+
+struct VLog {
+    std::string dir;
+    size_t segment_bytes = 0;
+    std::vector<Segment> segs;  // indexed by segment number
+    int active = -1;            // the segment taking appends
+    size_t nsegs = 0;
+    uint64_t file_bytes = 0;
+    uint64_t live_bytes = 0;
+    uint64_t seq = 0;           // for unique file names
+};
+
+static VLoc make_loc(uint32_t seg, uint64_t off, size_t len){
+    return ((VLoc)seg << (k_vlog_off_bits + k_vlog_len_bits))
+        | ((VLoc)off << k_vlog_len_bits) | (VLoc)len;
+}
+
+// starts a new active segment in the lowest free segment number
+static bool seg_open(VLog *log){
+    size_t n = 0;
+    while(n < log->segs.size() && log->segs[n].fd >= 0){
+        ++n;
+    }
+    if(n == k_vlog_max_segments){
+        return false;
+    }
+    std::string path = log->dir + "/vlog." + std::to_string(getpid())
+        + "." + std::to_string(log->seq++);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if(fd < 0){
+        return false;
+    }
+    // the open fd keeps the file until the segment is dropped
+    (void)unlink(path.c_str());
+    if(n == log->segs.size()){
+        log->segs.emplace_back();
+    }
+    log->segs[n] = Segment();
+    log->segs[n].fd = fd;
+    log->active = (int)n;
+    log->nsegs++;
+    return true;
+}
+
+void vlog_set_segment_bytes(VLog *log, size_t segment_bytes){
+    log->segment_bytes = segment_bytes < k_vlog_max_segment_bytes
+        ? segment_bytes : k_vlog_max_segment_bytes;
+}
+
+VLog *vlog_new(const char *dir, size_t segment_bytes){
+    VLog *log = new VLog();
+    log->dir = dir;
+    vlog_set_segment_bytes(log, segment_bytes);
+    if(!seg_open(log)){
+        delete log;
+        return NULL;
+    }
+    return log;
+}
+
+void vlog_free(VLog *log){
+    for(Segment &s : log->segs){
+        if(s.fd >= 0){
+            close(s.fd);
+        }
+    }
+    delete log;
+}
+
+static bool pread_full(int fd, char *buf, size_t n, uint64_t off){
+    while(n > 0){
+        ssize_t rv = pread(fd, buf, n, (off_t)off);
+        if(rv < 0 && errno == EINTR){
+            continue;
+        }
+        if(rv <= 0){
+            return false;
+        }
+        buf += rv;
+        n -= (size_t)rv;
+        off += (uint64_t)rv;
+    }
+    return true;
+}
+
+VLoc vlog_append(VLog *log, const char *key, size_t klen, const char *val, size_t vlen){
+    if(vlen > k_vlog_max_value || klen > UINT32_MAX){
+        return k_vloc_none;
+    }
+    if(log->active < 0 || log->segs[log->active].size >= log->segment_bytes){
+        // seal the full segment
+        log->active = -1;
+        if(!seg_open(log)){
+            return k_vloc_none;
+        }
+    }
+    Segment &s = log->segs[log->active];
+    uint64_t off = s.size + k_rec_header + klen;
+    if(off >= k_vlog_max_segment_bytes){
+        return k_vloc_none;
+    }
+
+    uint32_t header[2] = {(uint32_t)klen, (uint32_t)vlen};
+    struct iovec iov[3] = {
+        {header, k_rec_header},
+        {(void *)key, klen},
+        {(void *)val, vlen},
+    };
+    size_t total = k_rec_header + klen + vlen;
+    ssize_t rv = pwritev(s.fd, iov, 3, (off_t)s.size);
+    if(rv != (ssize_t)total){
+        // a short write leaves garbage past `size`, which is overwritten later
+        return k_vloc_none;
+    }
+
+    VLoc loc = make_loc((uint32_t)log->active, off, vlen);
+    s.size += total;
+    s.value_bytes += vlen;
+    s.live_bytes += vlen;
+    log->file_bytes += total;
+    log->live_bytes += vlen;
+    return loc;
+}
+
+bool vlog_read(VLog *log, VLoc loc, std::string &out){
+    uint32_t seg = vloc_seg(loc);
+    if(seg >= log->segs.size() || log->segs[seg].fd < 0){
+        return false;
+    }
+    out.resize(vloc_len(loc));
+    return pread_full(log->segs[seg].fd, &out[0], out.size(), vloc_off(loc));
+}
+
+void vlog_release(VLog *log, VLoc loc){
+    Segment &s = log->segs[vloc_seg(loc)];
+    s.live_bytes -= vloc_len(loc);
+    log->live_bytes -= vloc_len(loc);
+}
+
+int vlog_pick(VLog *log, double max_live){
+    int best = -1;
+    double best_live = max_live;
+    for(size_t i = 0; i < log->segs.size(); ++i){
+        const Segment &s = log->segs[i];
+        if(s.fd < 0 || (int)i == log->active || (s.skip && s.live_bytes > 0)){
+            continue;
+        }
+        double live = s.value_bytes ? (double)s.live_bytes / (double)s.value_bytes : 0;
+        if(live <= best_live){
+            best = (int)i;
+            best_live = live;
+        }
+    }
+    return best;
+}
+
+bool vlog_scan(VLog *log, uint32_t seg, uint64_t *pos, std::string &key, std::string &val, VLoc *loc){
+    const Segment &s = log->segs[seg];
+    if(*pos + k_rec_header > s.size){
+        return false;
+    }
+    uint32_t header[2];
+    if(!pread_full(s.fd, (char *)header, k_rec_header, *pos)){
+        return false;
+    }
+    key.resize(header[0]);
+    val.resize(header[1]);
+    uint64_t at = *pos + k_rec_header;
+    if(!pread_full(s.fd, &key[0], key.size(), at)
+        || !pread_full(s.fd, &val[0], val.size(), at + key.size())){
+        return false;
+    }
+    *loc = make_loc(seg, at + key.size(), val.size());
+    *pos = at + key.size() + val.size();
+    return true;
+}
+
+bool vlog_drop(VLog *log, uint32_t seg){
+    Segment &s = log->segs[seg];
+    if(s.fd < 0 || (int)seg == log->active || s.live_bytes > 0){
+        return false;
+    }
+    close(s.fd);
+    log->file_bytes -= s.size;
+    s = Segment();
+    log->nsegs--;
+    return true;
+}
+
+void vlog_skip(VLog *log, uint32_t seg){
+    log->segs[seg].skip = true;
+}
+
+size_t vlog_segments(const VLog *log){
+    return log->nsegs;
+}
+
+uint64_t vlog_file_bytes(const VLog *log){
+    return log->file_bytes;
+}
+
+uint64_t vlog_live_bytes(const VLog *log){
+    return log->live_bytes;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/*
+ * Value log: append-only files holding string values moved out of memory.
+ *
+ * The log is a set of segment files. Records are appended to the newest
+ * segment until it reaches the segment size, at which point it is sealed
+ * and a new one is started. A record is
+ *
+ *   [4B key length][4B value length][key][value]
+ *
+ * and the key is only there for compaction, which walks a sealed segment
+ * record by record, asks the owner of each key whether the record is still
+ * its value, and appends the live ones again before the segment is dropped.
+ * The log counts the live bytes of every segment (vlog_release() is called
+ * when a value is no longer used), which tells compaction which segments
+ * are worth it.
+ *
+ * Segment files are unlinked as soon as they are created: the log is
+ * scratch space for one process, and never outlives it.
+ *
+ * A value is addressed by a VLoc that packs the segment number, the offset
+ * of the value in it and the value length into 64 bits, so reading it back
+ * is a single pread().
+ */
+
+typedef uint64_t VLoc;
+
+const VLoc k_vloc_none = UINT64_MAX;
+
+const uint32_t k_vlog_seg_bits = 10;
+const uint32_t k_vlog_off_bits = 28;
+const uint32_t k_vlog_len_bits = 26;
+const size_t k_vlog_max_segments = (size_t)1 << k_vlog_seg_bits;
+const size_t k_vlog_max_segment_bytes = (size_t)1 << k_vlog_off_bits;
+const size_t k_vlog_max_value = ((size_t)1 << k_vlog_len_bits) - 1;
+
+inline uint32_t vloc_seg(VLoc loc){
+    return (uint32_t)(loc >> (k_vlog_off_bits + k_vlog_len_bits));
+}
+
+inline uint32_t vloc_off(VLoc loc){
+    return (uint32_t)(loc >> k_vlog_len_bits) & (uint32_t)(k_vlog_max_segment_bytes - 1);
+}
+
+inline uint32_t vloc_len(VLoc loc){
+    return (uint32_t)(loc & k_vlog_max_value);
+}
+
+struct VLog;
+
+// segments of `segment_bytes` (at most k_vlog_max_segment_bytes) are made in
+// `dir`; returns NULL if a file can not be created there
+VLog *vlog_new(const char *dir, size_t segment_bytes);
+void vlog_free(VLog *log);
+// applies to segments started from now on
+void vlog_set_segment_bytes(VLog *log, size_t segment_bytes);
+
+// returns k_vloc_none if the value is too big, every segment number is in
+// use, or the write failed
+VLoc vlog_append(VLog *log, const char *key, size_t klen, const char *val, size_t vlen);
+bool vlog_read(VLog *log, VLoc loc, std::string &out);
+// the value at `loc` is dead; its bytes are reclaimed when its segment is
+void vlog_release(VLog *log, VLoc loc);
+
+/*
+ * Compaction, driven by the owner of the values:
+ *
+ *   int seg = vlog_pick(log, 0.5);
+ *   uint64_t pos = 0;
+ *   while(vlog_scan(log, seg, &pos, key, val, &loc)){
+ *       if(the value of `key` is at `loc`){
+ *           move it to vlog_append(...) and vlog_release(log, loc)
+ *       }
+ *   }
+ *   vlog_drop(log, seg);
+ */
+
+// a sealed segment whose live bytes are at most `max_live` of its size,
+// the emptiest one first; -1 if there is none
+int vlog_pick(VLog *log, double max_live);
+// reads the record at `*pos` and moves `*pos` past it; false at the end
+bool vlog_scan(VLog *log, uint32_t seg, uint64_t *pos, std::string &key, std::string &val, VLoc *loc);
+// closes a sealed segment once all its values are released; returns false,
+// keeping it, if some are not
+bool vlog_drop(VLog *log, uint32_t seg);
+// leaves a segment that could not be compacted, e.g. because vlog_scan()
+// failed on it, out of vlog_pick() until all its values are released
+void vlog_skip(VLog *log, uint32_t seg);
+
+size_t vlog_segments(const VLog *log);
+// bytes in all segment files, and the value bytes in them still in use
+uint64_t vlog_file_bytes(const VLog *log);
+uint64_t vlog_live_bytes(const VLog *log);
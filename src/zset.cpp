@@ -0,0 +1,560 @@
+#include "zset.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+const int k_zsl_max_level = 32;
+
+struct ZNode;
+
+struct ZLevel {
+    ZNode *forward;
+    size_t span;        // number of level-0 links this link jumps over
+};
+
+struct ZNode {
+    double score;
+    uint32_t len;
+    char *name;         // points into the same allocation, after the levels
+    ZNode *backward;
+    ZLevel level[];
+};
+
+struct ZSkiplist {
+    ZNode *header = NULL;
+    ZNode *tail = NULL;
+    size_t length = 0;
+    int level = 1;
+};
+
+struct ZSet {
+    uint32_t enc = ZSET_PACKED;
+    // ZSET_PACKED
+    std::string packed;
+    size_t count = 0;
+    // ZSET_SKIPLIST
+    ZSkiplist zsl;
+    std::unordered_map<std::string_view, ZNode *> dict;
+};
+
+/*
+ * Orders two members by score first, then by the member bytes.
+ * Returns <0, 0 or >0 like memcmp().
+ */
+static int zcmp(double s1, const char *n1, size_t l1,
+                double s2, const char *n2, size_t l2){
+    if(s1 < s2){
+        return -1;
+    }
+    if(s1 > s2){
+        return 1;
+    }
+    int rv = memcmp(n1, n2, l1 < l2 ? l1 : l2);
+    if(rv){
+        return rv;
+    }
+    return (l1 < l2) ? -1 : (l1 > l2);
+}
+
+static bool gte_min(double score, const ZRangeSpec &range){
+    return range.minex ? (score > range.min) : (score >= range.min);
+}
+
+static bool lte_max(double score, const ZRangeSpec &range){
+    return range.maxex ? (score < range.max) : (score <= range.max);
+}
+
+// ---------------------------------------------------------------------------
+// ZSET_PACKED helpers
+// ---------------------------------------------------------------------------
+
+static size_t packed_entry_size(size_t len){
+    return 8 + 1 + len;
+}
+
+static void packed_read(const std::string &buf, size_t pos,
+                        double *score, const char **name, size_t *len){
+    memcpy(score, &buf[pos], 8);
+    *len = (uint8_t)buf[pos + 8];
+    *name = &buf[pos + 9];
+}
+
+/*
+ * Finds the byte offset of `name` in the packed buffer.
+ * Returns buf.size() if the member is not present.
+ */
+static size_t packed_find(const ZSet *zset, const char *name, size_t len, size_t *rank){
+    const std::string &buf = zset->packed;
+    size_t pos = 0;
+    size_t idx = 0;
+    while(pos < buf.size()){
+        double s;
+        const char *n;
+        size_t l;
+        packed_read(buf, pos, &s, &n, &l);
+        if(l == len && 0 == memcmp(n, name, len)){
+            if(rank){
+                *rank = idx;
+            }
+            return pos;
+        }
+        pos += packed_entry_size(l);
+        idx++;
+    }
+    return buf.size();
+}
+
+static void packed_insert(ZSet *zset, const char *name, size_t len, double score){
+    std::string &buf = zset->packed;
+    size_t pos = 0;
+    while(pos < buf.size()){
+        double s;
+        const char *n;
+        size_t l;
+        packed_read(buf, pos, &s, &n, &l);
+        if(zcmp(score, name, len, s, n, l) < 0){
+            break;
+        }
+        pos += packed_entry_size(l);
+    }
+
+    char hdr[9];
+    memcpy(hdr, &score, 8);
+    hdr[8] = (char)(uint8_t)len;
+    buf.insert(pos, hdr, sizeof(hdr));
+    buf.insert(pos + sizeof(hdr), name, len);
+    zset->count++;
+}
+
+static void packed_erase(ZSet *zset, size_t pos){
+    size_t len = (uint8_t)zset->packed[pos + 8];
+    zset->packed.erase(pos, packed_entry_size(len));
+    zset->count--;
+}
+
+// ---------------------------------------------------------------------------
+// ZSET_SKIPLIST helpers
+// ---------------------------------------------------------------------------
+
+static ZNode *znode_new(int level, const char *name, size_t len, double score){
+    size_t sz = sizeof(ZNode) + level * sizeof(ZLevel);
+    ZNode *node = (ZNode *)malloc(sz + len);
+    assert(node);
+    node->score = score;
+    node->len = (uint32_t)len;
+    node->name = (char *)node + sz;
+    memcpy(node->name, name, len);
+    node->backward = NULL;
+    for(int i = 0; i < level; ++i){
+        node->level[i].forward = NULL;
+        node->level[i].span = 0;
+    }
+    return node;
+}
+
+static int zsl_random_level(){
+    // each level is promoted with a probability of 1/4
+    int level = 1;
+    while(level < k_zsl_max_level && (rand() & 0xffff) < (0xffff / 4)){
+        level++;
+    }
+    return level;
+}
+
+static void zsl_init(ZSkiplist *zsl){
+    zsl->header = znode_new(k_zsl_max_level, "", 0, 0);
+    zsl->tail = NULL;
+    zsl->length = 0;
+    zsl->level = 1;
+}
+
+static ZNode *zsl_insert(ZSkiplist *zsl, const char *name, size_t len, double score){
+    ZNode *update[k_zsl_max_level];
+    size_t rank[k_zsl_max_level];
+
+    // find the predecessor on every level, and its rank
+    ZNode *x = zsl->header;
+    for(int i = zsl->level - 1; i >= 0; --i){
+        rank[i] = (i == zsl->level - 1) ? 0 : rank[i + 1];
+        while(x->level[i].forward){
+            ZNode *fwd = x->level[i].forward;
+            if(zcmp(fwd->score, fwd->name, fwd->len, score, name, len) >= 0){
+                break;
+            }
+            rank[i] += x->level[i].span;
+            x = fwd;
+        }
+        update[i] = x;
+    }
+
+    int level = zsl_random_level();
+    if(level > zsl->level){
+        for(int i = zsl->level; i < level; ++i){
+            rank[i] = 0;
+            update[i] = zsl->header;
+            update[i]->level[i].span = zsl->length;
+        }
+        zsl->level = level;
+    }
+
+    x = znode_new(level, name, len, score);
+    for(int i = 0; i < level; ++i){
+        x->level[i].forward = update[i]->level[i].forward;
+        update[i]->level[i].forward = x;
+
+        // split the span of the predecessor around the new node
+        x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+        update[i]->level[i].span = (rank[0] - rank[i]) + 1;
+    }
+
+    // untouched levels above now jump over one more node
+    for(int i = level; i < zsl->level; ++i){
+        update[i]->level[i].span++;
+    }
+
+    x->backward = (update[0] == zsl->header) ? NULL : update[0];
+    if(x->level[0].forward){
+        x->level[0].forward->backward = x;
+    }
+    else{
+        zsl->tail = x;
+    }
+    zsl->length++;
+    return x;
+}
+
+static void zsl_unlink(ZSkiplist *zsl, ZNode *x, ZNode **update){
+    for(int i = 0; i < zsl->level; ++i){
+        if(update[i]->level[i].forward == x){
+            update[i]->level[i].span += x->level[i].span - 1;
+            update[i]->level[i].forward = x->level[i].forward;
+        }
+        else{
+            update[i]->level[i].span -= 1;
+        }
+    }
+
+    if(x->level[0].forward){
+        x->level[0].forward->backward = x->backward;
+    }
+    else{
+        zsl->tail = x->backward;
+    }
+
+    while(zsl->level > 1 && zsl->header->level[zsl->level - 1].forward == NULL){
+        zsl->level--;
+    }
+    zsl->length--;
+}
+
+// removes the node with the given (score, name) and frees it
+static void zsl_delete(ZSkiplist *zsl, const char *name, size_t len, double score){
+    ZNode *update[k_zsl_max_level];
+    ZNode *x = zsl->header;
+    for(int i = zsl->level - 1; i >= 0; --i){
+        while(x->level[i].forward){
+            ZNode *fwd = x->level[i].forward;
+            if(zcmp(fwd->score, fwd->name, fwd->len, score, name, len) >= 0){
+                break;
+            }
+            x = fwd;
+        }
+        update[i] = x;
+    }
+
+    x = x->level[0].forward;
+    assert(x && x->score == score && x->len == len && 0 == memcmp(x->name, name, len));
+    zsl_unlink(zsl, x, update);
+    free(x);
+}
+
+// returns the node at the 1-based `rank`, or NULL
+static ZNode *zsl_by_rank(const ZSkiplist *zsl, size_t rank){
+    size_t traversed = 0;
+    ZNode *x = zsl->header;
+    for(int i = zsl->level - 1; i >= 0; --i){
+        while(x->level[i].forward && traversed + x->level[i].span <= rank){
+            traversed += x->level[i].span;
+            x = x->level[i].forward;
+        }
+        if(traversed == rank){
+            return x;
+        }
+    }
+    return NULL;
+}
+
+// returns the 1-based rank of the node, which must exist
+static size_t zsl_rank(const ZSkiplist *zsl, const ZNode *node){
+    size_t rank = 0;
+    ZNode *x = zsl->header;
+    for(int i = zsl->level - 1; i >= 0; --i){
+        while(x->level[i].forward){
+            ZNode *fwd = x->level[i].forward;
+            if(zcmp(fwd->score, fwd->name, fwd->len,
+                    node->score, node->name, node->len) > 0){
+                break;
+            }
+            rank += x->level[i].span;
+            x = fwd;
+        }
+        if(x == node){
+            return rank;
+        }
+    }
+    assert(0);
+    return 0;
+}
+
+// returns the first node with a score inside the range, or NULL
+static ZNode *zsl_first_in_range(const ZSkiplist *zsl, const ZRangeSpec &range){
+    ZNode *x = zsl->header;
+    for(int i = zsl->level - 1; i >= 0; --i){
+        while(x->level[i].forward && !gte_min(x->level[i].forward->score, range)){
+            x = x->level[i].forward;
+        }
+    }
+    x = x->level[0].forward;
+    if(!x || !lte_max(x->score, range)){
+        return NULL;
+    }
+    return x;
+}
+
+static ZNode *zset_lookup(const ZSet *zset, const char *name, size_t len){
+    auto it = zset->dict.find(std::string_view(name, len));
+    return (it == zset->dict.end()) ? NULL : it->second;
+}
+
+static void zset_insert_node(ZSet *zset, const char *name, size_t len, double score){
+    ZNode *node = zsl_insert(&zset->zsl, name, len, score);
+    zset->dict[std::string_view(node->name, node->len)] = node;
+}
+
+// converts a packed set into a skiplist plus hash index
+static void zset_convert(ZSet *zset){
+    assert(zset->enc == ZSET_PACKED);
+    zsl_init(&zset->zsl);
+    zset->dict.reserve(zset->count * 2);
+
+    const std::string &buf = zset->packed;
+    size_t pos = 0;
+    while(pos < buf.size()){
+        double s;
+        const char *n;
+        size_t l;
+        packed_read(buf, pos, &s, &n, &l);
+        zset_insert_node(zset, n, l, s);
+        pos += packed_entry_size(l);
+    }
+
+    zset->enc = ZSET_SKIPLIST;
+    std::string().swap(zset->packed);
+    zset->count = 0;
+}
+
+// ---------------------------------------------------------------------------
+// public API
+// ---------------------------------------------------------------------------
+
+ZSet *zset_new(){
+    return new ZSet();
+}
+
+void zset_free(ZSet *zset){
+    if(!zset){
+        return;
+    }
+    if(zset->enc == ZSET_SKIPLIST){
+        ZNode *x = zset->zsl.header;
+        while(x){
+            ZNode *next = x->level[0].forward;
+            free(x);
+            x = next;
+        }
+    }
+    delete zset;
+}
+
+uint32_t zset_encoding(const ZSet *zset){
+    return zset->enc;
+}
+
+size_t zset_len(const ZSet *zset){
+    return (zset->enc == ZSET_PACKED) ? zset->count : zset->zsl.length;
+}
+
+/*
+ * Adds a member or updates the score of an existing one.
+ * Returns true if the member was newly added.
+ */
+bool zset_add(ZSet *zset, const char *name, size_t len, double score){
+    if(zset->enc == ZSET_PACKED){
+        size_t pos = packed_find(zset, name, len, NULL);
+        if(pos != zset->packed.size()){
+            double old;
+            memcpy(&old, &zset->packed[pos], 8);
+            if(old != score){
+                packed_erase(zset, pos);
+                packed_insert(zset, name, len, score);
+            }
+            return false;
+        }
+        if(zset->count < zset_max_packed_entries && len <= zset_max_packed_value){
+            packed_insert(zset, name, len, score);
+            return true;
+        }
+        zset_convert(zset);
+    }
+
+    ZNode *node = zset_lookup(zset, name, len);
+    if(node){
+        if(node->score != score){
+            zset->dict.erase(std::string_view(node->name, node->len));
+            zsl_delete(&zset->zsl, name, len, node->score);
+            zset_insert_node(zset, name, len, score);
+        }
+        return false;
+    }
+    zset_insert_node(zset, name, len, score);
+    return true;
+}
+
+/*
+ * Removes a member. Returns false if it was not present.
+ */
+bool zset_rem(ZSet *zset, const char *name, size_t len){
+    if(zset->enc == ZSET_PACKED){
+        size_t pos = packed_find(zset, name, len, NULL);
+        if(pos == zset->packed.size()){
+            return false;
+        }
+        packed_erase(zset, pos);
+        return true;
+    }
+
+    ZNode *node = zset_lookup(zset, name, len);
+    if(!node){
+        return false;
+    }
+    zset->dict.erase(std::string_view(node->name, node->len));
+    zsl_delete(&zset->zsl, name, len, node->score);
+    return true;
+}
+
+bool zset_score(const ZSet *zset, const char *name, size_t len, double *score){
+    if(zset->enc == ZSET_PACKED){
+        size_t pos = packed_find(zset, name, len, NULL);
+        if(pos == zset->packed.size()){
+            return false;
+        }
+        memcpy(score, &zset->packed[pos], 8);
+        return true;
+    }
+
+    ZNode *node = zset_lookup(zset, name, len);
+    if(!node){
+        return false;
+    }
+    *score = node->score;
+    return true;
+}
+
+/*
+ * Returns the 0-based rank of a member in (score, member) order,
+ * or -1 if it is not present.
+ */
+int64_t zset_rank(const ZSet *zset, const char *name, size_t len){
+    if(zset->enc == ZSET_PACKED){
+        size_t rank = 0;
+        size_t pos = packed_find(zset, name, len, &rank);
+        return (pos == zset->packed.size()) ? -1 : (int64_t)rank;
+    }
+
+    ZNode *node = zset_lookup(zset, name, len);
+    if(!node){
+        return -1;
+    }
+    return (int64_t)zsl_rank(&zset->zsl, node) - 1;
+}
+
+/*
+ * Visits members with 0-based ranks in [start, stop], in order.
+ * The caller clamps the bounds to the set length.
+ */
+void zset_range_by_rank(const ZSet *zset, size_t start, size_t stop,
+                        zset_visit_fn fn, void *arg){
+    if(start > stop || start >= zset_len(zset)){
+        return;
+    }
+
+    if(zset->enc == ZSET_PACKED){
+        const std::string &buf = zset->packed;
+        size_t pos = 0;
+        for(size_t idx = 0; pos < buf.size() && idx <= stop; ++idx){
+            double s;
+            const char *n;
+            size_t l;
+            packed_read(buf, pos, &s, &n, &l);
+            if(idx >= start){
+                fn(n, l, s, arg);
+            }
+            pos += packed_entry_size(l);
+        }
+        return;
+    }
+
+    ZNode *x = zsl_by_rank(&zset->zsl, start + 1);
+    for(size_t idx = start; x && idx <= stop; ++idx){
+        fn(x->name, x->len, x->score, arg);
+        x = x->level[0].forward;
+    }
+}
+
+/*
+ * Visits members whose score falls in `range`, skipping the first `offset`
+ * matches and stopping after `limit` visits.
+ */
+void zset_range_by_score(const ZSet *zset, const ZRangeSpec &range,
+                         size_t offset, size_t limit,
+                         zset_visit_fn fn, void *arg){
+    if(zset->enc == ZSET_PACKED){
+        const std::string &buf = zset->packed;
+        size_t pos = 0;
+        while(pos < buf.size() && limit > 0){
+            double s;
+            const char *n;
+            size_t l;
+            packed_read(buf, pos, &s, &n, &l);
+            pos += packed_entry_size(l);
+            if(!gte_min(s, range)){
+                continue;
+            }
+            if(!lte_max(s, range)){
+                break;
+            }
+            if(offset > 0){
+                offset--;
+                continue;
+            }
+            fn(n, l, s, arg);
+            limit--;
+        }
+        return;
+    }
+
+    ZNode *x = zsl_first_in_range(&zset->zsl, range);
+    while(x && offset > 0){
+        x = x->level[0].forward;
+        offset--;
+    }
+    while(x && limit > 0 && lte_max(x->score, range)){
+        fn(x->name, x->len, x->score, arg);
+        x = x->level[0].forward;
+        limit--;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Sorted set: a collection of unique members, each with a double score,
+ * ordered by (score, member).
+ *
+ * Two encodings are used:
+ *
+ * - ZSET_PACKED: small sets are kept in one contiguous, sorted byte buffer
+ *   of entries
+ *
+ *     +-----------+-----+--------+-----------+-----+--------+--------
+ *     | score(8B) | len | member | score(8B) | len | member | more...
+ *     +-----------+-----+--------+-----------+-----+--------+--------
+ *
+ *   Lookups are a linear scan, which is cheaper than chasing pointers for
+ *   a handful of entries and costs no per-member allocation.
+ *
+ * - ZSET_SKIPLIST: once the set grows past zset_max_packed_entries members
+ *   (or any member is longer than zset_max_packed_value) it is converted to
+ *   a skiplist whose links carry spans, giving O(log n) rank and range
+ *   queries, plus a hash index from member to node for O(1) score lookup.
+ */
+
+enum {
+    ZSET_PACKED = 0,
+    ZSET_SKIPLIST = 1,
+};
+
+const size_t zset_max_packed_entries = 128;
+const size_t zset_max_packed_value = 64;
+
+struct ZSet;
+
+// a score interval for range queries; `minex`/`maxex` make a bound exclusive
+struct ZRangeSpec {
+    double min = 0;
+    double max = 0;
+    bool minex = false;
+    bool maxex = false;
+};
+
+// called once per member visited by a range query
+typedef void (*zset_visit_fn)(const char *name, size_t len, double score, void *arg);
+
+ZSet *zset_new();
+void zset_free(ZSet *zset);
+
+uint32_t zset_encoding(const ZSet *zset);
+size_t zset_len(const ZSet *zset);
+
+bool zset_add(ZSet *zset, const char *name, size_t len, double score);
+bool zset_rem(ZSet *zset, const char *name, size_t len);
+bool zset_score(const ZSet *zset, const char *name, size_t len, double *score);
+int64_t zset_rank(const ZSet *zset, const char *name, size_t len);
+
+void zset_range_by_rank(const ZSet *zset, size_t start, size_t stop,
+                        zset_visit_fn fn, void *arg);
+void zset_range_by_score(const ZSet *zset, const ZRangeSpec &range,
+                         size_t offset, size_t limit,
+                         zset_visit_fn fn, void *arg);
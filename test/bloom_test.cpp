@@ -0,0 +1,64 @@
+#include "../src/bloom.h"
+#include <gtest/gtest.h>
+#include <string>
+
+TEST(BloomTest, NoFalseNegatives) {
+  Bloom *bf = bloom_new(1000, 0.01);
+  for (int i = 0; i < 1000; ++i) {
+    std::string item = "id:" + std::to_string(i);
+    bloom_add(bf, item.data(), item.size());
+  }
+  for (int i = 0; i < 1000; ++i) {
+    std::string item = "id:" + std::to_string(i);
+    ASSERT_TRUE(bloom_exists(bf, item.data(), item.size()));
+    ASSERT_FALSE(bloom_add(bf, item.data(), item.size()));
+  }
+  ASSERT_EQ(bloom_filters(bf), 1u);
+  // about 10 bits per item at 1%
+  ASSERT_LE(bloom_bytes(bf), 1000u * 12 / 8 + 64);
+  bloom_free(bf);
+}
+
+// the false positive rate stays within the target as the filter scales
+TEST(BloomTest, ScalesWithinErrorRate) {
+  Bloom *bf = bloom_new(1000, 0.01);
+  const int n = 50000;
+  for (int i = 0; i < n; ++i) {
+    std::string item = "in:" + std::to_string(i);
+    bloom_add(bf, item.data(), item.size());
+  }
+  ASSERT_GT(bloom_filters(bf), 1u);
+  ASSERT_GE(bloom_count(bf), (uint64_t)n * 97 / 100);
+
+  int fp = 0;
+  const int probes = 100000;
+  for (int i = 0; i < probes; ++i) {
+    std::string item = "out:" + std::to_string(i);
+    fp += bloom_exists(bf, item.data(), item.size());
+  }
+  ASSERT_LT(fp, probes * 2 / 100);
+  bloom_free(bf);
+}
+
+TEST(BloomTest, Limits) {
+  ASSERT_EQ(bloom_new(0, 0.01), nullptr);
+  ASSERT_EQ(bloom_new(k_bloom_max_capacity + 1, 0.01), nullptr);
+  ASSERT_EQ(bloom_new(100, k_bloom_min_error / 2), nullptr);
+  ASSERT_EQ(bloom_new(100, 0), nullptr);
+  // about 52 bits per item, past k_bloom_max_bytes
+  ASSERT_EQ(bloom_new(k_bloom_max_capacity, k_bloom_min_error), nullptr);
+
+  // scaling stops halving the error rate at the floor
+  Bloom *bf = bloom_new(10, k_bloom_min_error * 2);
+  for (int i = 0; i < 1000; ++i) {
+    std::string item = "id:" + std::to_string(i);
+    bloom_add(bf, item.data(), item.size());
+  }
+  ASSERT_GT(bloom_filters(bf), 2u);
+  std::string dump;
+  bloom_dump(bf, dump);
+  double error = 0;
+  memcpy(&error, &dump[8], 8);
+  ASSERT_EQ(error, k_bloom_min_error);
+  bloom_free(bf);
+}
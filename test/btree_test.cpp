@@ -0,0 +1,87 @@
+#include "../src/btree.h"
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <set>
+#include <string>
+
+static void expect_same(const BTree *bt, const std::set<std::string> &model) {
+  ASSERT_EQ(bt_size(bt), model.size());
+  BtIter it = bt_seek(bt, "", 0);
+  for (const std::string &key : model) {
+    ASSERT_TRUE(bt_valid(it));
+    ASSERT_EQ(bt_key(it), key);
+    bt_next(it);
+  }
+  ASSERT_FALSE(bt_valid(it));
+}
+
+TEST(BTreeTest, SeekAndScan) {
+  BTree *bt = bt_new();
+  ASSERT_FALSE(bt_valid(bt_seek(bt, "a", 1)));
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(bt_insert(bt, "user:" + std::to_string(i)));
+  }
+  ASSERT_FALSE(bt_insert(bt, "user:42"));
+  ASSERT_LE(bt_height(bt), 4u);
+
+  // keys sharing their first 8 bytes are told apart by the rest
+  BtIter it = bt_seek(bt, "user:42", 7);
+  ASSERT_EQ(bt_key(it), "user:42");
+  bt_next(it);
+  ASSERT_EQ(bt_key(it), "user:420");
+  it = bt_seek(bt, "user:9999", 9);
+  bt_next(it);
+  ASSERT_FALSE(bt_valid(it));
+  it = bt_seek(bt, "user:99990", 10);
+  ASSERT_FALSE(bt_valid(it));
+
+  // keys with zero bytes and high bytes, in byte order
+  ASSERT_TRUE(bt_insert(bt, std::string("user", 4)));
+  ASSERT_TRUE(bt_insert(bt, std::string("user\0", 5)));
+  ASSERT_TRUE(bt_insert(bt, "user\xff"));
+  it = bt_seek(bt, "", 0);
+  ASSERT_EQ(bt_key(it), "user");
+  bt_next(it);
+  ASSERT_EQ(bt_key(it), std::string("user\0", 5));
+  it = bt_seek(bt, "user;", 5);
+  ASSERT_EQ(bt_key(it), "user\xff");
+  bt_free(bt);
+}
+
+// random inserts and erases, checked against std::set
+TEST(BTreeTest, MatchesModel) {
+  BTree *bt = bt_new();
+  std::set<std::string> model;
+  srand(7);
+  for (int round = 0; round < 4; ++round) {
+    for (int i = 0; i < 20000; ++i) {
+      std::string key = "k" + std::to_string(rand() % 5000);
+      if (rand() % 3) {
+        ASSERT_EQ(bt_insert(bt, key), model.insert(key).second);
+      } else {
+        ASSERT_EQ(bt_erase(bt, key), model.erase(key) == 1);
+      }
+    }
+    expect_same(bt, model);
+
+    // seeks land on the same key as std::set::lower_bound
+    for (int i = 0; i < 1000; ++i) {
+      std::string key = "k" + std::to_string(rand() % 6000);
+      BtIter it = bt_seek(bt, key.data(), key.size());
+      auto mit = model.lower_bound(key);
+      ASSERT_EQ(bt_valid(it), mit != model.end());
+      if (mit != model.end()) {
+        ASSERT_EQ(bt_key(it), *mit);
+      }
+    }
+  }
+
+  // erasing everything merges the tree back into one leaf
+  for (const std::string &key : model) {
+    ASSERT_TRUE(bt_erase(bt, key));
+  }
+  model.clear();
+  expect_same(bt, model);
+  ASSERT_EQ(bt_height(bt), 1u);
+  bt_free(bt);
+}
@@ -0,0 +1,52 @@
+#include "../src/histogram.h"
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+TEST(HistogramTest, Buckets) {
+  // every value is in the bucket whose range holds it, in order
+  size_t last = 0;
+  for (uint64_t v : std::vector<uint64_t>{0, 1, 31, 32, 33, 63, 64, 1000,
+                     123456789, 1ull << 40, UINT64_MAX}) {
+    size_t i = hist_bucket(v);
+    ASSERT_LT(i, k_hist_buckets);
+    ASSERT_GE(i, last);
+    ASSERT_LE(hist_bucket_low(i), v);
+    if (i + 1 < k_hist_buckets) {
+      ASSERT_GT(hist_bucket_low(i + 1), v);
+    }
+    last = i;
+  }
+  ASSERT_EQ(hist_bucket(UINT64_MAX), k_hist_buckets - 1);
+}
+
+TEST(HistogramTest, Percentiles) {
+  Histogram *h = new Histogram();
+  ASSERT_EQ(hist_percentile(h, 50), 0u);
+  std::vector<uint64_t> values;
+  srand(3);
+  for (int i = 0; i < 100000; ++i) {
+    uint64_t v = (uint64_t)rand() % 1000 + (rand() % 100 == 0 ? 100000 : 0);
+    values.push_back(v);
+    hist_add(h, v);
+  }
+  std::sort(values.begin(), values.end());
+  for (double p : {1.0, 50.0, 90.0, 99.0, 99.9, 100.0}) {
+    uint64_t exact = values[(size_t)(p / 100 * values.size() + 0.5) - 1];
+    uint64_t got = hist_percentile(h, p);
+    ASSERT_GE(got, exact);
+    ASSERT_LE(got, exact + exact / 32 + 1);
+  }
+  ASSERT_EQ(hist_percentile(h, 100), values.back());
+
+  Histogram *sum = new Histogram();
+  hist_merge(sum, h);
+  hist_merge(sum, h);
+  ASSERT_EQ(sum->count, 2 * h->count);
+  ASSERT_EQ(hist_percentile(sum, 50), hist_percentile(h, 50));
+  hist_reset(sum);
+  ASSERT_EQ(sum->count, 0u);
+  delete sum;
+  delete h;
+}
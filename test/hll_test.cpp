@@ -0,0 +1,91 @@
+#include "../src/hll.h"
+#include <gtest/gtest.h>
+#include <string>
+
+static void add_range(HLL *hll, const char *prefix, int from, int to) {
+  for (int i = from; i < to; ++i) {
+    std::string item = prefix + std::to_string(i);
+    hll_add(hll, item.data(), item.size());
+  }
+}
+
+static void expect_near(uint64_t est, double exact) {
+  ASSERT_NEAR((double)est, exact, exact * 0.03) << "exact " << exact;
+}
+
+TEST(HLLTest, SparseThenDense) {
+  HLL *hll = hll_new();
+  ASSERT_EQ(hll_count(hll), 0u);
+  add_range(hll, "u:", 0, 100);
+  ASSERT_EQ(hll_encoding(hll), (uint32_t)HLL_SPARSE);
+  ASSERT_LT(hll_bytes(hll), 1000u);
+  expect_near(hll_count(hll), 100);
+
+  // adding the same items again changes nothing
+  std::string item = "u:7";
+  ASSERT_FALSE(hll_add(hll, item.data(), item.size()));
+
+  add_range(hll, "u:", 100, 100000);
+  ASSERT_EQ(hll_encoding(hll), (uint32_t)HLL_DENSE);
+  ASSERT_LE(hll_bytes(hll), 12 * 1024 + 1u);
+  expect_near(hll_count(hll), 100000);
+  hll_free(hll);
+}
+
+TEST(HLLTest, Merge) {
+  HLL *a = hll_new();
+  HLL *b = hll_new();
+  add_range(a, "v:", 0, 30000);
+  add_range(b, "v:", 20000, 50000);
+  const HLL *both[] = {a, b};
+  expect_near(hll_count_union(both, 2), 50000);
+
+  hll_merge(a, b);
+  expect_near(hll_count(a), 50000);
+  // b is unchanged
+  expect_near(hll_count(b), 30000);
+
+  // a sparse source merges the same way
+  HLL *c = hll_new();
+  add_range(c, "w:", 0, 10);
+  hll_merge(c, b);
+  ASSERT_EQ(hll_encoding(c), (uint32_t)HLL_DENSE);
+  expect_near(hll_count(c), 30010);
+  hll_free(a);
+  hll_free(b);
+  hll_free(c);
+}
+
+TEST(HLLTest, RestoreRejectsBadRegisters) {
+  HLL *hll = hll_new();
+  add_range(hll, "r:", 0, 10);
+  std::string dump;
+  hll_dump(hll, dump);
+  hll_free(hll);
+  hll = hll_restore(dump.data(), dump.size());
+  ASSERT_NE(hll, nullptr);
+  hll_free(hll);
+
+  // pairs are index << 8 | value, after the encoding byte
+  auto with_pair = [&](size_t i, uint32_t pair) {
+    std::string bad = dump;
+    memcpy(&bad[1 + 4 * i], &pair, 4);
+    return hll_restore(bad.data(), bad.size());
+  };
+  uint32_t first = 0, second = 0;
+  memcpy(&first, &dump[1], 4);
+  memcpy(&second, &dump[5], 4);
+  ASSERT_EQ(with_pair(0, (uint32_t)k_hll_registers << 8 | 1), nullptr);
+  ASSERT_EQ(with_pair(0, (first & ~0xffu) | (64 - k_hll_p + 2)), nullptr);
+  ASSERT_EQ(with_pair(1, first), nullptr);
+  ASSERT_EQ(with_pair(0, second), nullptr);
+
+  // a dense register above the largest value
+  hll = hll_new();
+  add_range(hll, "d:", 0, 100000);
+  dump.clear();
+  hll_dump(hll, dump);
+  hll_free(hll);
+  dump[1] = (char)(dump[1] | 63);
+  ASSERT_EQ(hll_restore(dump.data(), dump.size()), nullptr);
+}
@@ -0,0 +1,55 @@
+#include "../src/hotkeys.h"
+#include <gtest/gtest.h>
+
+static void touch(HotKeys *hk, const std::string &key, int times) {
+  for (int i = 0; i < times; ++i) {
+    hk_touch(hk, key.data(), key.size());
+  }
+}
+
+TEST(HotKeysTest, FindsHotKeys) {
+  HotKeys *hk = hk_new();
+  // a long tail of cold keys interleaved with three hot ones
+  for (int round = 0; round < 100; ++round) {
+    for (int i = 0; i < 1000; ++i) {
+      touch(hk, "cold:" + std::to_string(round * 1000 + i), 1);
+    }
+    touch(hk, "hot:a", 30);
+    touch(hk, "hot:b", 20);
+    touch(hk, "hot:c", 10);
+  }
+
+  std::vector<HotKey> top;
+  hk_top(hk, top);
+  ASSERT_LE(top.size(), k_hk_topk);
+  ASSERT_GE(top.size(), 3u);
+  ASSERT_EQ(top[0].key, "hot:a");
+  ASSERT_EQ(top[1].key, "hot:b");
+  ASSERT_EQ(top[2].key, "hot:c");
+  // count-min only overestimates
+  ASSERT_GE(top[0].count, 3000u);
+  ASSERT_GE(hk_estimate(hk, "hot:c", 5), 1000u);
+
+  hk_reset(hk);
+  hk_top(hk, top);
+  ASSERT_TRUE(top.empty());
+  hk_free(hk);
+}
+
+TEST(HotKeysTest, Decays) {
+  HotKeys *hk = hk_new();
+  touch(hk, "old", 1000);
+  // enough accesses elsewhere to pass several decay periods
+  for (uint64_t i = 0; i < 4 * k_hk_decay_period; ++i) {
+    std::string k = std::to_string(i % 100);
+    hk_touch(hk, k.data(), k.size());
+  }
+  ASSERT_LT(hk_estimate(hk, "old", 3), 1000u / 8);
+
+  std::vector<HotKey> top;
+  hk_top(hk, top);
+  for (const HotKey &hot : top) {
+    ASSERT_NE(hot.key, "old");
+  }
+  hk_free(hk);
+}
@@ -0,0 +1,125 @@
+#include "../src/loopprof.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// an iteration on the clock that handles one event and runs `requests`
+// commands; the time it takes is not looked at
+static void iteration(LoopProfile *p, uint32_t requests) {
+  lp_begin(p);
+  lp_phase(LP_POLL);
+  lp_phase(LP_OTHER);
+  lp_events(1);
+  lp_phase(LP_READ);
+  for (uint32_t i = 0; i < requests; ++i) {
+    lp_phase(LP_EXEC);
+    lp_request();
+  }
+  lp_end();
+}
+
+// an iteration of known cycles that reads for `read` and runs `requests`
+// commands of `exec` each
+static LoopIter fixed(uint64_t read, uint32_t requests, uint64_t exec) {
+  LoopIter it;
+  it.cycles[LP_POLL] = 10;
+  it.cycles[LP_READ] = read;
+  it.cycles[LP_EXEC] = requests * exec;
+  it.events = 1;
+  it.requests = requests;
+  return it;
+}
+
+TEST(LoopProfTest, Phases) {
+  LoopProfile *p = lp_new();
+  for (int i = 0; i < 20; ++i) {
+    iteration(p, 2);
+  }
+  iteration(p, 1);
+  // not profiled
+  iteration(NULL, 5);
+  lp_phase(LP_EXEC);
+
+  LoopReport *r = new LoopReport();
+  lp_report(p, *r);
+  ASSERT_EQ(r->iterations, 21u);
+  ASSERT_EQ(r->requests.sum, 41u);
+  ASSERT_EQ(r->events.sum, 21u);
+  ASSERT_EQ(r->busy.count, 21u);
+  ASSERT_EQ(r->nlongest, k_lp_longest);
+  lp_reset(p);
+
+  for (int i = 0; i < 20; ++i) {
+    lp_add(p, fixed(100, 2, 1000));
+  }
+  lp_add(p, fixed(20000, 1, 0));
+  lp_report(p, *r);
+  ASSERT_EQ(r->iterations, 21u);
+  ASSERT_EQ(r->phases[LP_EXEC].sum, 40000u);
+  ASSERT_EQ(r->phases[LP_READ].sum, 22000u);
+  ASSERT_EQ(r->phases[LP_POLL].sum, 210u);
+  ASSERT_EQ(r->busy.sum, 62000u);
+
+  // the read-heavy one is the longest
+  ASSERT_EQ(r->nlongest, k_lp_longest);
+  ASSERT_EQ(r->longest[0].requests, 1u);
+  ASSERT_NE(r->longest[0].unix_time, 0);
+  for (size_t i = 1; i < r->nlongest; ++i) {
+    ASSERT_GE(lp_busy(r->longest[i - 1]), lp_busy(r->longest[i]));
+  }
+
+  std::string text = lp_doctor(*r);
+  ASSERT_NE(text.find("21 event loop iterations"), std::string::npos);
+  ASSERT_NE(text.find("Longest iterations"), std::string::npos);
+  ASSERT_NE(text.find("Parsing and commands take"), std::string::npos);
+
+  lp_reset(p);
+  lp_report(p, *r);
+  ASSERT_EQ(r->iterations, 0u);
+  ASSERT_EQ(r->nlongest, 0u);
+  delete r;
+  lp_free(p);
+}
+
+// threads keep reports of their own, merged when reported
+TEST(LoopProfTest, MergesThreads) {
+  LoopProfile *p = lp_new();
+  std::vector<std::thread> threads;
+  for (uint32_t t = 1; t <= 4; ++t) {
+    threads.emplace_back([p, t] {
+      for (int i = 0; i < 10; ++i) {
+        lp_add(p, fixed(100, t, 100));
+      }
+    });
+  }
+  for (std::thread &t : threads) {
+    t.join();
+  }
+  lp_add(p, fixed(5000, 9, 0));
+
+  LoopReport *r = new LoopReport();
+  lp_report(p, *r);
+  ASSERT_EQ(r->iterations, 41u);
+  ASSERT_EQ(r->requests.sum, 10u * (1 + 2 + 3 + 4) + 9);
+  ASSERT_EQ(r->requests.max, 9u);
+  ASSERT_EQ(r->busy.count, 41u);
+  ASSERT_EQ(r->busy.sum, 10u * (4 * 100 + 100 * (1 + 2 + 3 + 4)) + 5000);
+
+  // longest first, from every thread
+  ASSERT_EQ(r->nlongest, k_lp_longest);
+  ASSERT_EQ(r->longest[0].requests, 9u);
+  ASSERT_NE(r->longest[0].unix_time, 0);
+  for (size_t i = 1; i < r->nlongest; ++i) {
+    ASSERT_EQ(r->longest[i].requests, 4u);
+  }
+
+  lp_reset(p);
+  lp_report(p, *r);
+  ASSERT_EQ(r->iterations, 0u);
+  iteration(p, 1);
+  lp_report(p, *r);
+  ASSERT_EQ(r->iterations, 1u);
+  delete r;
+  lp_free(p);
+}
@@ -0,0 +1,90 @@
+#include "test_server.h"
+#include "../src/nearcache.h"
+
+TEST(NearCacheTest, InvalidatedByOtherClient) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int reader = connect_client(port);
+  int writer = connect_client(port);
+
+  NearCache *nc = nc_new(reader, 100);
+  ASSERT_NE(nc, nullptr);
+  std::string res;
+  std::vector<std::string> set = {"set", "k", "v1"};
+  ASSERT_EQ(nc_call(nc, set, res), 0);
+
+  // the second read is served locally
+  std::string val;
+  bool found = false;
+  ASSERT_EQ(nc_get(nc, "k", val, &found), 0);
+  ASSERT_TRUE(found);
+  ASSERT_EQ(val, "v1");
+  ASSERT_EQ(nc_get(nc, "k", val, &found), 0);
+  ASSERT_EQ(nc_hits(nc), 1u);
+
+  // a write from another connection invalidates it
+  set[2] = "v2";
+  ASSERT_EQ(request(writer, set), k_ok);
+
+  // wait for the push to arrive before reading again
+  struct pollfd pfd = {reader, POLLIN, 0};
+  ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+  ASSERT_EQ(nc_get(nc, "k", val, &found), 0);
+  ASSERT_EQ(val, "v2");
+  ASSERT_EQ(nc_invalidations(nc), 1u);
+  ASSERT_EQ(nc_hits(nc), 1u);
+
+  // missing keys are cached and invalidated the same way
+  ASSERT_EQ(nc_get(nc, "missing", val, &found), 0);
+  ASSERT_FALSE(found);
+  std::vector<std::string> create = {"set", "missing", "x"};
+  ASSERT_EQ(nc_call(nc, create, res), 0);
+  ASSERT_EQ(nc_get(nc, "missing", val, &found), 0);
+  ASSERT_TRUE(found);
+
+  nc_free(nc);
+  close(reader);
+  close(writer);
+  stop_server(pid);
+}
+
+TEST(NearCacheTest, EvictedAndFlushed) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int reader = connect_client(port);
+  int writer = connect_client(port);
+  NearCache *nc = nc_new(reader, 100);
+  ASSERT_NE(nc, nullptr);
+  std::string val;
+  bool found = false;
+  struct pollfd pfd = {reader, POLLIN, 0};
+
+  // a full tracking table forgets a key, and tells its readers
+  request(writer, {"config", "set", "tracking-table-max-keys", "1"});
+  ASSERT_EQ(nc_get(nc, "a", val, &found), 0);
+  ASSERT_EQ(nc_get(nc, "b", val, &found), 0);
+  ASSERT_EQ(nc_get(nc, "a", val, &found), 0);
+  ASSERT_EQ(nc_invalidations(nc), 1u);
+  ASSERT_EQ(nc_hits(nc), 0u);
+  // the push for "b" follows that reply
+  ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+  ASSERT_EQ(nc_get(nc, "a", val, &found), 0);
+  ASSERT_EQ(nc_invalidations(nc), 2u);
+  ASSERT_EQ(nc_hits(nc), 1u);
+
+  // a key too long to push empties the whole cache
+  request(writer, {"config", "set", "tracking-table-max-keys", "0"});
+  std::string long_key(k_max_msg, 'k');
+  ASSERT_EQ(nc_get(nc, long_key, val, &found), 0);
+  ASSERT_EQ(nc_size(nc), 2u);
+  request(writer, {"set", long_key, "v"});
+  ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+  ASSERT_EQ(nc_get(nc, "a", val, &found), 0);
+  ASSERT_EQ(nc_hits(nc), 1u);
+  ASSERT_EQ(nc_invalidations(nc), 4u);
+
+  nc_free(nc);
+  close(reader);
+  close(writer);
+  stop_server(pid);
+}
@@ -5,6 +5,7 @@
 #include <string>      // If one_request or query use std::string
 #include <fcntl.h> 
 #include <fstream>    // For O_RDONLY, O_WRONLY (potentially)
+#include <sys/wait.h>
 
 
 bool write_test_data(const std::string& filename, const std::string& data) {
@@ -55,8 +56,17 @@ TEST(ParserTest, Query) {
   int fds[2];
   socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
 
+  // Serve one request on the other end
+  pid_t pid = fork();
+  if (pid == 0) {
+    exit(one_request(fds[1]) == 0 ? 0 : 1);
+  }
+
   // Normal query
   ASSERT_EQ(query(fds[0], "hello"), 0);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  ASSERT_EQ(WEXITSTATUS(status), 0);
 
   // Invalid query
   ASSERT_EQ(query(fds[0], std::string(100000, 'a').c_str()), -1);
@@ -64,3 +74,22 @@ TEST(ParserTest, Query) {
   close(fds[0]);
   close(fds[1]);  
 }
+
+TEST(ParserTest, CanonicalInt) {
+  int64_t v = 0;
+  ASSERT_TRUE(str2canonical_int("0", v));
+  ASSERT_EQ(v, 0);
+  ASSERT_TRUE(str2canonical_int("-17", v));
+  ASSERT_EQ(v, -17);
+  ASSERT_TRUE(str2canonical_int("9223372036854775807", v));
+  ASSERT_EQ(v, INT64_MAX);
+  ASSERT_TRUE(str2canonical_int("-9223372036854775808", v));
+  ASSERT_EQ(v, INT64_MIN);
+
+  // would not read back as the same bytes, or out of range
+  for (const char *s : {"", "-", "-0", "007", "+1", " 1", "1 ", "1.0", "0x10", "1e3",
+                        "9223372036854775808", "-9223372036854775809",
+                        "18446744073709551616", "123456789012345678901"}) {
+    ASSERT_FALSE(str2canonical_int(s, v)) << s;
+  }
+}
@@ -0,0 +1,72 @@
+#include "../src/quicklist.h"
+#include <gtest/gtest.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+static void collect(const char *data, size_t len, void *arg) {
+  ((std::vector<std::string> *)arg)->push_back(std::string(data, len));
+}
+
+TEST(QuickListTest, PushPopBothEnds) {
+  QuickList *ql = ql_new();
+  ql_push(ql, QL_TAIL, "b", 1);
+  ql_push(ql, QL_HEAD, "a", 1);
+  ql_push(ql, QL_TAIL, "c", 1);
+  ASSERT_EQ(ql_len(ql), 3u);
+  ASSERT_EQ(ql_nodes(ql), 1u);
+
+  std::string out;
+  ASSERT_TRUE(ql_pop(ql, QL_TAIL, out));
+  ASSERT_EQ(out, "c");
+  ASSERT_TRUE(ql_pop(ql, QL_HEAD, out));
+  ASSERT_EQ(out, "a");
+  ASSERT_TRUE(ql_pop(ql, QL_HEAD, out));
+  ASSERT_EQ(out, "b");
+  ASSERT_FALSE(ql_pop(ql, QL_HEAD, out));
+  ASSERT_EQ(ql_nodes(ql), 0u);
+  ql_free(ql);
+}
+
+// small and long elements in a queue pattern must match a std::deque model
+TEST(QuickListTest, MatchesModel) {
+  QuickList *ql = ql_new();
+  std::deque<std::string> model;
+  srand(7);
+  for (int i = 0; i < 100000; ++i) {
+    int op = rand() % 5;
+    if (op < 3) {
+      std::string val(rand() % 3 == 0 ? 200 : rand() % 20, 'a' + rand() % 26);
+      uint32_t where = (op == 0) ? QL_HEAD : QL_TAIL;
+      ql_push(ql, where, val.data(), val.size());
+      if (where == QL_HEAD) {
+        model.push_front(val);
+      } else {
+        model.push_back(val);
+      }
+    } else {
+      uint32_t where = (op == 3) ? QL_HEAD : QL_TAIL;
+      std::string out;
+      ASSERT_EQ(ql_pop(ql, where, out), !model.empty());
+      if (!model.empty()) {
+        ASSERT_EQ(out, where == QL_HEAD ? model.front() : model.back());
+        if (where == QL_HEAD) {
+          model.pop_front();
+        } else {
+          model.pop_back();
+        }
+      }
+    }
+  }
+  ASSERT_EQ(ql_len(ql), model.size());
+  ASSERT_GT(ql_nodes(ql), 1u);
+
+  std::vector<std::string> all;
+  ql_range(ql, 0, model.size() - 1, collect, &all);
+  ASSERT_EQ(all, std::vector<std::string>(model.begin(), model.end()));
+
+  std::vector<std::string> some;
+  ql_range(ql, 100, 110, collect, &some);
+  ASSERT_EQ(some, std::vector<std::string>(model.begin() + 100, model.begin() + 111));
+  ql_free(ql);
+}
@@ -0,0 +1,110 @@
+#include "../src/readindex.h"
+#include "../src/epoch.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+static RcStr *str(const std::string &s) {
+  std::string copy = s;
+  return rcstr_new(copy);
+}
+
+TEST(ReadIndexTest, SetGetDel) {
+  ASSERT_TRUE(epoch_register());
+  ReadIndex *ri = ri_new();
+  for (int i = 0; i < 5000; ++i) {
+    RcStr *v = str("v" + std::to_string(i));
+    ri_set_str(ri, "k" + std::to_string(i), v);
+    rcstr_unref(v);
+  }
+  ri_set_int(ri, "n", -7);
+  ri_set_other(ri, "z");
+  ASSERT_EQ(ri_size(ri), 5002u);
+
+  RiValue v;
+  epoch_enter();
+  ASSERT_TRUE(ri_get(ri, "k1234", 5, &v));
+  ASSERT_EQ(v.kind, (uint32_t)RI_STR);
+  ASSERT_EQ(v.val->str, "v1234");
+  ASSERT_TRUE(ri_get(ri, "n", 1, &v));
+  ASSERT_EQ(v.ival, -7);
+  ASSERT_TRUE(ri_get(ri, "z", 1, &v));
+  ASSERT_EQ(v.kind, (uint32_t)RI_OTHER);
+  ASSERT_FALSE(ri_get(ri, "k5000", 5, &v));
+  epoch_exit();
+
+  ri_del(ri, "k1234");
+  ri_set_int(ri, "k1", 1);
+  epoch_enter();
+  ASSERT_FALSE(ri_get(ri, "k1234", 5, &v));
+  ASSERT_TRUE(ri_get(ri, "k1", 2, &v));
+  ASSERT_EQ(v.kind, (uint32_t)RI_INT);
+  epoch_exit();
+
+  epoch_reclaim();
+  ASSERT_EQ(epoch_pending(), 0u);
+  ri_free(ri);
+  epoch_unregister();
+}
+
+// readers always find a whole value of the key while one writer replaces,
+// deletes and re-adds keys and the table grows
+TEST(ReadIndexTest, ConcurrentReaders) {
+  ReadIndex *ri = ri_new();
+  const int nkeys = 256;
+  std::atomic<bool> stop{false};
+  std::atomic<uint64_t> reads{0};
+  std::atomic<bool> bad{false};
+
+  std::vector<std::thread> readers;
+  for (int r = 0; r < 4; ++r) {
+    readers.emplace_back([&, r] {
+      ASSERT_TRUE(epoch_register());
+      uint64_t n = 0;
+      while (!stop.load()) {
+        std::string key = "k" + std::to_string((n * 7 + r) % nkeys);
+        RiValue v;
+        epoch_enter();
+        if (ri_get(ri, key.data(), key.size(), &v) && v.kind == RI_STR) {
+          // every value is the key followed by a version
+          if (v.val->str.compare(0, key.size() + 1, key + ":") != 0) {
+            bad = true;
+          }
+        }
+        epoch_exit();
+        ++n;
+      }
+      reads += n;
+      epoch_unregister();
+    });
+  }
+
+  for (int round = 0; round < 200; ++round) {
+    for (int i = 0; i < nkeys; ++i) {
+      std::string key = "k" + std::to_string(i);
+      if ((i + round) % 5 == 0) {
+        ri_del(ri, key);
+        continue;
+      }
+      RcStr *v = str(key + ":" + std::to_string(round));
+      ri_set_str(ri, key, v);
+      rcstr_unref(v);
+    }
+    // filler keys make the table grow under the readers
+    for (int i = 0; i < 50; ++i) {
+      ri_set_other(ri, "f" + std::to_string(round * 50 + i));
+    }
+  }
+  stop = true;
+  for (std::thread &t : readers) {
+    t.join();
+  }
+  ASSERT_FALSE(bad.load());
+  ASSERT_GT(reads.load(), 0u);
+
+  epoch_reclaim();
+  ASSERT_EQ(epoch_pending(), 0u);
+  ri_free(ri);
+}
@@ -0,0 +1,118 @@
+#include "../src/server_client.h"
+#include "../src/resp.h"
+#include <gtest/gtest.h>
+
+static const uint8_t *bytes(const std::string &s) {
+  return (const uint8_t *)s.data();
+}
+
+TEST(RespTest, Detect) {
+  std::string native("\x0c\x00\x00\x00", 4);
+  ASSERT_EQ(resp_detect(bytes(native), 4, k_max_msg), 0);
+  ASSERT_EQ(resp_detect(bytes("*2\r\n"), 4, k_max_msg), 1);
+  ASSERT_EQ(resp_detect(bytes("PING\r\n"), 6, k_max_msg), 1);
+  ASSERT_EQ(resp_detect(bytes("*2"), 2, k_max_msg), -1);
+}
+
+TEST(RespTest, ScanMatchesScalar) {
+  std::string buf;
+  for (int i = 0; i < 1000; ++i) {
+    buf.push_back("ab\r\n\r"[rand() % 5]);
+  }
+  std::vector<uint32_t> pos;
+  resp_scan_crlf(bytes(buf), buf.size(), pos);
+
+  std::vector<uint32_t> expect;
+  for (size_t i = 0; i + 1 < buf.size(); ++i) {
+    if (buf[i] == '\r' && buf[i + 1] == '\n') {
+      expect.push_back(i);
+    }
+  }
+  ASSERT_EQ(pos, expect);
+}
+
+TEST(RespTest, PipelinedBatch) {
+  std::string buf = "*2\r\n$3\r\nGET\r\n$1\r\nk\r\n"
+                    "PING\r\n"
+                    "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$4\r\na\r\nb\r\n"
+                    "*2\r\n$3\r\nGET";
+  std::deque<std::vector<std::string>> cmds;
+  size_t consumed = 0;
+  RespParse st;
+  ASSERT_EQ(resp_parse_batch(bytes(buf), buf.size(), k_max_msg, cmds, &consumed, st), 0);
+  ASSERT_EQ(cmds.size(), 3u);
+  ASSERT_EQ(cmds[0], (std::vector<std::string>{"GET", "k"}));
+  ASSERT_EQ(cmds[1], (std::vector<std::string>{"PING"}));
+  ASSERT_EQ(cmds[2], (std::vector<std::string>{"SET", "k", "a\r\nb"}));
+  ASSERT_EQ(consumed, buf.size() - strlen("*2\r\n$3\r\nGET"));
+
+  // a partial command is left for the next read, byte by byte
+  for (size_t n = 0; n < buf.size(); ++n) {
+    cmds.clear();
+    RespParse fresh;
+    ASSERT_EQ(resp_parse_batch(bytes(buf), n, k_max_msg, cmds, &consumed, fresh), 0);
+    ASSERT_LE(consumed, n);
+  }
+
+  cmds.clear();
+  RespParse bad;
+  ASSERT_EQ(resp_parse_batch(bytes("*1\r\n$x\r\n"), 8, k_max_msg, cmds, &consumed, bad), -1);
+}
+
+// bytes arrive one at a time, and the caller drops what was consumed
+TEST(RespTest, ResumesPartialCommand) {
+  std::string input = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$6\r\nab\r\ncd\r\n"
+                      "PING\r\n*0\r\n*1\r\n$4\r\nPING\r\n";
+  std::deque<std::vector<std::string>> cmds;
+  RespParse st;
+  std::string buf;
+  for (char c : input) {
+    buf.push_back(c);
+    size_t consumed = 0;
+    ASSERT_EQ(resp_parse_batch(bytes(buf), buf.size(), k_max_msg, cmds, &consumed, st), 0);
+    buf.erase(0, consumed);
+  }
+  ASSERT_TRUE(buf.empty());
+  ASSERT_EQ(cmds.size(), 3u);
+  ASSERT_EQ(cmds[0], (std::vector<std::string>{"SET", "k", "ab\r\ncd"}));
+  ASSERT_EQ(cmds[1], (std::vector<std::string>{"PING"}));
+  ASSERT_EQ(cmds[2], (std::vector<std::string>{"PING"}));
+}
+
+TEST(RespTest, FromSer) {
+  std::string ser;
+  ser.push_back(SER_ARR);
+  uint32_t n = 2;
+  ser.append((char *)&n, 4);
+  ser.push_back(SER_INT);
+  int64_t v = -7;
+  ser.append((char *)&v, 8);
+  ser.push_back(SER_NIL);
+
+  std::string out;
+  ASSERT_EQ(resp_from_ser(bytes(ser), ser.size(), 2, out), (int32_t)ser.size());
+  ASSERT_EQ(out, "*2\r\n:-7\r\n$-1\r\n");
+  out.clear();
+  resp_from_ser(bytes(ser), ser.size(), 3, out);
+  ASSERT_EQ(out, "*2\r\n:-7\r\n_\r\n");
+
+  // a push is an array in RESP2 and its own type in RESP3
+  ser[0] = SER_PUSH;
+  out.clear();
+  resp_from_ser(bytes(ser), ser.size(), 2, out);
+  ASSERT_EQ(out, "*2\r\n:-7\r\n$-1\r\n");
+  out.clear();
+  resp_from_ser(bytes(ser), ser.size(), 3, out);
+  ASSERT_EQ(out, ">2\r\n:-7\r\n_\r\n");
+
+  // a status is a simple string in both
+  std::string ok(1, SER_STATUS);
+  uint32_t len = 2;
+  ok.append((char *)&len, 4);
+  ok += "OK";
+  for (uint32_t ver : {2u, 3u}) {
+    out.clear();
+    ASSERT_EQ(resp_from_ser(bytes(ok), ok.size(), ver, out), (int32_t)ok.size());
+    ASSERT_EQ(out, "+OK\r\n");
+  }
+}
@@ -0,0 +1,51 @@
+#include "../src/slowlog.h"
+#include <gtest/gtest.h>
+
+TEST(SlowlogTest, RingKeepsNewest) {
+  Slowlog *sl = slowlog_new(3);
+  for (int i = 0; i < 5; ++i) {
+    slowlog_push(sl, {"get", "k" + std::to_string(i)}, 7, 100 + i);
+  }
+  ASSERT_EQ(slowlog_len(sl), 3u);
+  ASSERT_EQ(slowlog_get(sl, 0)->id, 4u);
+  ASSERT_EQ(slowlog_get(sl, 0)->args[1], "k4");
+  ASSERT_EQ(slowlog_get(sl, 2)->duration_us, 102u);
+  ASSERT_EQ(slowlog_get(sl, 2)->fd, 7);
+  ASSERT_EQ(slowlog_get(sl, 3), nullptr);
+
+  // shrinking keeps the newest records, growing keeps them all
+  slowlog_set_max_len(sl, 2);
+  ASSERT_EQ(slowlog_len(sl), 2u);
+  ASSERT_EQ(slowlog_get(sl, 1)->id, 3u);
+  slowlog_set_max_len(sl, 8);
+  slowlog_push(sl, {"set", "k", "v"}, 7, 1);
+  ASSERT_EQ(slowlog_len(sl), 3u);
+  ASSERT_EQ(slowlog_get(sl, 0)->id, 5u);
+  ASSERT_EQ(slowlog_get(sl, 2)->id, 3u);
+
+  slowlog_reset(sl);
+  ASSERT_EQ(slowlog_len(sl), 0u);
+  slowlog_free(sl);
+}
+
+TEST(SlowlogTest, TruncatesArguments) {
+  Slowlog *sl = slowlog_new(1);
+  std::vector<std::string> cmd = {"rpush", "k", std::string(1000, 'x')};
+  for (int i = 0; i < 40; ++i) {
+    cmd.push_back("e");
+  }
+  slowlog_push(sl, cmd, 3, 1);
+
+  const SlowlogEntry *ent = slowlog_get(sl, 0);
+  ASSERT_EQ(ent->args.size(), k_slowlog_max_argc);
+  ASSERT_EQ(ent->args[2], std::string(k_slowlog_max_arglen, 'x') + "... (872 more bytes)");
+  ASSERT_EQ(ent->args.back(), "... (12 more arguments)");
+
+  // cut ahead of time, as the server does before running a command
+  std::vector<std::string> args;
+  slowlog_args(args, cmd);
+  std::vector<std::string> expect = args;
+  slowlog_push_args(sl, args, 3, 1);
+  ASSERT_EQ(slowlog_get(sl, 0)->args, expect);
+  slowlog_free(sl);
+}
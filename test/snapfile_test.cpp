@@ -0,0 +1,87 @@
+#include "../src/snapfile.h"
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static const char *k_path = "snapfile_test.snap";
+
+static std::string record(int i) {
+  return std::to_string(i) + std::string(i % 300, 'r');
+}
+
+static void write_snapshot(int n) {
+  SnapWriter *w = snap_create(k_path, 4096);
+  ASSERT_NE(w, nullptr);
+  for (int i = 0; i < n; ++i) {
+    std::string rec = record(i);
+    ASSERT_TRUE(snap_append(w, rec.data(), rec.size()));
+  }
+  ASSERT_TRUE(snap_finish(w));
+}
+
+TEST(SnapFileTest, RoundTrip) {
+  write_snapshot(2000);
+  std::vector<SnapChunk> chunks;
+  int fd = snap_open(k_path, chunks);
+  ASSERT_GE(fd, 0);
+  ASSERT_GT(chunks.size(), 10u);
+
+  // records come back in order, none split across chunks
+  std::string buf;
+  std::string all;
+  uint32_t records = 0;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    const SnapChunk &c = chunks[i];
+    ASSERT_TRUE(snap_read_chunk(fd, c, buf));
+    if (i + 1 < chunks.size()) {
+      ASSERT_GE(buf.size(), 4096u);
+    }
+    records += c.records;
+    all += buf;
+  }
+  close(fd);
+  std::string expect;
+  for (int i = 0; i < 2000; ++i) {
+    expect += record(i);
+  }
+  ASSERT_EQ(records, 2000u);
+  ASSERT_EQ(all, expect);
+
+  // an empty snapshot has no chunks
+  write_snapshot(0);
+  fd = snap_open(k_path, chunks);
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(chunks.empty());
+  close(fd);
+  unlink(k_path);
+}
+
+TEST(SnapFileTest, Corruption) {
+  write_snapshot(500);
+  std::vector<SnapChunk> chunks;
+  int fd = snap_open(k_path, chunks);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  // a flipped byte in a chunk fails its CRC
+  fd = open(k_path, O_RDWR);
+  char c = 0;
+  ASSERT_EQ(pread(fd, &c, 1, chunks[1].offset + 10), 1);
+  c ^= 1;
+  ASSERT_EQ(pwrite(fd, &c, 1, chunks[1].offset + 10), 1);
+  std::string buf;
+  ASSERT_TRUE(snap_read_chunk(fd, chunks[0], buf));
+  ASSERT_FALSE(snap_read_chunk(fd, chunks[1], buf));
+
+  // a cut off file has no footer
+  off_t size = lseek(fd, 0, SEEK_END);
+  ASSERT_EQ(ftruncate(fd, size - 1), 0);
+  close(fd);
+  ASSERT_EQ(snap_open(k_path, chunks), -1);
+  unlink(k_path);
+
+  // the known CRC-32C of "123456789"
+  ASSERT_EQ(crc32c(0, "123456789", 9), 0xe3069283u);
+}
@@ -1,77 +1,822 @@
-#include "gtest/gtest.h"
-#include "../src/server_client.h"
+#include "test_server.h"
+#include "../src/capture.h"
+#include "../src/slowlog.h"
+#include <chrono>
 
 TEST(ServerTest, AcceptConnection) {
-  int server_sock = socket(AF_INET, SOCK_STREAM, 0);
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
 
-  // Bind and listen on server socket
+  // Connect client socket
+  int client_sock = connect_client(port);
+
+  // Validate client socket was accepted and processed
+  ASSERT_EQ(request(client_sock, {"set", "k", "v"}), k_ok);
+  std::string body = request(client_sock, {"get", "k"});
+  ASSERT_EQ(body.size(), 1u + 4 + 1);
+  ASSERT_EQ(body[0], SER_STR);
+  ASSERT_EQ(body.back(), 'v');
+
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, ClientDisconnect) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+
+  // Disconnect a client in the middle of a request
+  int client_sock = connect_client(port);
+  ASSERT_EQ(write_all(client_sock, "\x10\x00", 2), 0);
+  close(client_sock);
+
+  // The server keeps serving other clients
+  client_sock = connect_client(port);
+  ASSERT_EQ(request(client_sock, {"get", "missing"}), std::string(1, SER_NIL));
+
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, InvalidRequest) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+
+  // Unknown commands get an error reply
+  int client_sock = connect_client(port);
+  std::string body = request(client_sock, {"nosuchcommand"});
+  ASSERT_GE(body.size(), 5u);
+  ASSERT_EQ(body[0], SER_ERR);
+  int32_t code = 0;
+  memcpy(&code, &body[1], 4);
+  ASSERT_EQ(code, ERR_UNKNOWN);
+
+  // Send invalid request: a frame longer than k_max_req closes the connection
+  uint32_t len = k_max_req + 1;
+  ASSERT_EQ(write_all(client_sock, (char *)&len, 4), 0);
+  ASSERT_FALSE(read_reply(client_sock, body));
+
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, UnixSocket) {
+  // a TCP and a Unix domain listener served by one event loop
+  std::string path = "/tmp/server_test_" + std::to_string(getpid()) + ".sock";
+  int tcp_sock = create_server_socket();
+  bind_socket(tcp_sock, 0);
+  struct sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  getsockname(tcp_sock, (struct sockaddr *)&addr, &len);
+  uint16_t port = ntohs(addr.sin_port);
+  listen_socket(tcp_sock);
+  int unix_sock = create_unix_server_socket(path.c_str());
+  listen_socket(unix_sock);
 
   pid_t pid = fork();
   if (pid == 0) {
-    // Child process
-    int client_sock = socket(AF_INET, SOCK_STREAM, 0);
-    
-    // Connect client socket
+    accept_connections({tcp_sock, unix_sock});
+    exit(0);
+  }
+  close(tcp_sock);
+  close(unix_sock);
 
-    accept_connection(server_sock);
+  int local = create_unix_client_socket();
+  ASSERT_EQ(connect_unix(local, path.c_str()), 0);
+  int remote = connect_client(port);
 
-    // Validate client socket was accepted and processed
+  // both see the same keyspace
+  ASSERT_EQ(request(local, {"set", "k", "unix"}), k_ok);
+  std::string body = request(remote, {"get", "k"});
+  ASSERT_EQ(body.substr(5), "unix");
 
-    close(client_sock);
-    exit(0);
-  } else {
-    // Parent process
-    wait(NULL);
-    close(server_sock);
+  close(local);
+  close(remote);
+  stop_server(pid);
+  unlink(path.c_str());
+}
+
+TEST(ServerTest, Tiering) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+
+  // keep about 10 values in memory, in small log segments
+  ASSERT_EQ(request(client_sock, {"config", "set", "tiered-max-memory", "2000"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"config", "set", "tiered-segment-bytes", "4096"}), k_ok);
+  for (int i = 0; i < 200; ++i) {
+    std::string val(200, 'a' + i % 26);
+    request(client_sock, {"set", "k" + std::to_string(i), val});
+  }
+
+  // the event loop moves values out between requests
+  int64_t disk_keys = 0;
+  for (int tries = 0; tries < 100 && disk_keys < 150; ++tries) {
+    usleep(10000);
+    std::string body = request(client_sock, {"tiering"});
+    // [memory-bytes, <int>, disk-keys, <int>, ...]
+    size_t at = 5 + (5 + 12) + (1 + 8) + (5 + 9);
+    ASSERT_EQ(body[at], SER_INT);
+    memcpy(&disk_keys, &body[at + 1], 8);
+  }
+  ASSERT_GE(disk_keys, 150);
+
+  // values read back the same, from disk or after coming back to memory
+  for (int round = 0; round < 2; ++round) {
+    for (int i = 0; i < 200; ++i) {
+      std::string body = request(client_sock, {"get", "k" + std::to_string(i)});
+      ASSERT_EQ(body.substr(5), std::string(200, 'a' + i % 26));
+    }
   }
+  ASSERT_EQ(request(client_sock, {"set", "k0", "7"}), k_ok);
+  std::string body = request(client_sock, {"incr", "k0"});
+  int64_t v = 0;
+  memcpy(&v, &body[1], 8);
+  ASSERT_EQ(v, 8);
+
+  close(client_sock);
+  stop_server(pid);
 }
 
-TEST(ServerTest, ClientDisconnect) {
-  int server_sock = socket(AF_INET, SOCK_STREAM, 0);
+TEST(ServerTest, IoThreads) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port, [] { set_io_threads(3); });
+
+  // clients on different threads see each other's writes
+  std::vector<int> socks;
+  for (int i = 0; i < 4; ++i) {
+    socks.push_back(connect_client(port));
+  }
+  for (int i = 0; i < 100; ++i) {
+    std::string key = "k" + std::to_string(i);
+    ASSERT_EQ(request(socks[i % 4], {"set", key, std::string(i * 20, 'v')}), k_ok);
+    std::string body = request(socks[(i + 1) % 4], {"get", key});
+    ASSERT_EQ(body.substr(5), std::string(i * 20, 'v'));
+  }
+  request(socks[0], {"set", "n", "41"});
+  request(socks[1], {"incr", "n"});
+  ASSERT_EQ(request(socks[2], {"get", "n"}).substr(5), "42");
+  request(socks[3], {"del", "n"});
+  ASSERT_EQ(request(socks[0], {"get", "n"}), std::string(1, SER_NIL));
 
-  // Bind and listen on server socket
+  // GET of another type still gets the type error
+  request(socks[1], {"zadd", "z", "1", "m"});
+  ASSERT_EQ(request(socks[2], {"get", "z"})[0], SER_ERR);
 
-  pid_t pid = fork();
-  if (pid == 0) {  
-    // Child process
-    int client_sock = socket(AF_INET, SOCK_STREAM, 0);
-    
-    // Connect client socket
+  // GETs answered on the threads are counted by HOTKEYS
+  ASSERT_EQ(request(socks[1], {"hotkeys", "reset"}), k_ok);
+  for (int i = 0; i < 50; ++i) {
+    request(socks[1], {"get", "k7"});
+  }
+  std::string body = request(socks[1], {"hotkeys", "1"});
+  // [arr tag, 1][arr tag, 2][str tag, 2, k7][int tag, count]
+  ASSERT_EQ(body.size(), 5u + 5 + 7 + 9);
+  ASSERT_EQ(body.substr(15, 2), "k7");
+  int64_t count = 0;
+  memcpy(&count, &body[18], 8);
+  ASSERT_GE(count, 50);
 
-    accept_connection(server_sock);
+  for (int fd : socks) {
+    close(fd);
+  }
+  stop_server(pid);
+}
 
-    // Disconnect client socket
+static const char *k_snapshot = "server_test.snap";
 
-    exit(0);
-  } else {
-    // Parent process
-    wait(NULL);
-    close(server_sock);
+static int64_t reply_int(const std::string &body) {
+  int64_t v = -1;
+  EXPECT_EQ(body[0], SER_INT);
+  memcpy(&v, &body[1], 8);
+  return v;
+}
+
+TEST(ServerTest, Snapshot) {
+  unlink(k_snapshot);
+  uint16_t port = 0;
+  pid_t pid = start_server(&port, [] { set_snapshot_path(k_snapshot); });
+  int client_sock = connect_client(port);
+
+  // enough strings for several chunks, and a key of every type
+  for (int i = 0; i < 3000; ++i) {
+    request(client_sock, {"set", "s" + std::to_string(i), std::string(1000, 'a' + i % 26)});
+  }
+  request(client_sock, {"set", "n", "-42"});
+  request(client_sock, {"zadd", "z", "1.5", "a"});
+  request(client_sock, {"zadd", "z", "-3", "b"});
+  request(client_sock, {"rpush", "l", "x", "y", "z"});
+  request(client_sock, {"bf.reserve", "bf", "0.01", "100"});
+  request(client_sock, {"bf.add", "bf", "member"});
+  for (int i = 0; i < 500; ++i) {
+    request(client_sock, {"pfadd", "hll", std::to_string(i)});
+  }
+  int64_t estimate = reply_int(request(client_sock, {"pfcount", "hll"}));
+  ASSERT_EQ(request(client_sock, {"save"}), k_ok);
+  close(client_sock);
+  stop_server(pid);
+
+  // a second server loads it on several threads
+  pid = start_server(&port, [] {
+    if (!snapshot_load(k_snapshot, 4)) {
+      exit(1);
+    }
+  });
+  client_sock = connect_client(port);
+  for (int i = 0; i < 3000; i += 7) {
+    std::string body = request(client_sock, {"get", "s" + std::to_string(i)});
+    ASSERT_EQ(body.substr(5), std::string(1000, 'a' + i % 26));
   }
+  ASSERT_EQ(reply_int(request(client_sock, {"incr", "n"})), -41);
+  std::string body = request(client_sock, {"zscore", "z", "b"});
+  ASSERT_EQ(body[0], SER_DBL);
+  double score = 0;
+  memcpy(&score, &body[1], 8);
+  ASSERT_EQ(score, -3);
+  // [arr tag, 3][str tag, 1, x][str tag, 1, y][str tag, 1, z]
+  body = request(client_sock, {"lrange", "l", "0", "-1"});
+  ASSERT_EQ(body.size(), 5u + 3 * 6);
+  ASSERT_EQ(std::string() + body[10] + body[16] + body[22], "xyz");
+  ASSERT_EQ(reply_int(request(client_sock, {"bf.exists", "bf", "member"})), 1);
+  ASSERT_EQ(reply_int(request(client_sock, {"pfcount", "hll"})), estimate);
+
+  close(client_sock);
+  stop_server(pid);
+  unlink(k_snapshot);
 }
 
-TEST(ServerTest, InvalidRequest) {
-  int server_sock = socket(AF_INET, SOCK_STREAM, 0);
+// [cursor, [key...]] from RANGE and PREFIXSCAN
+static std::vector<std::string> scan_reply(const std::string &body, std::string &cursor) {
+  std::vector<std::string> keys;
+  size_t at = 5;
+  uint32_t len = 0;
+  memcpy(&len, &body[at + 1], 4);
+  cursor = body.substr(at + 5, len);
+  at += 5 + len;
+  uint32_t n = 0;
+  memcpy(&n, &body[at + 1], 4);
+  at += 5;
+  for (uint32_t i = 0; i < n; ++i) {
+    memcpy(&len, &body[at + 1], 4);
+    keys.push_back(body.substr(at + 5, len));
+    at += 5 + len;
+  }
+  EXPECT_EQ(at, body.size());
+  return keys;
+}
 
-  // Bind and listen on server socket
+TEST(ServerTest, KeyScans) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
 
-  pid_t pid = fork();
-  if (pid == 0) {
-    // Child process  
-    int client_sock = socket(AF_INET, SOCK_STREAM, 0);
-    
-    // Connect client socket
-    // Send invalid request
+  for (int i = 0; i < 50; ++i) {
+    request(client_sock, {"set", "user:1:" + std::to_string(i), "v"});
+    request(client_sock, {"set", "user:2:" + std::to_string(i), "v"});
+  }
+  request(client_sock, {"zadd", "user:1:z", "1", "m"});
 
-    accept_connection(server_sock);
+  // the same pages with and without the ordered index
+  for (const char *index : {"0", "1", "0"}) {
+    ASSERT_EQ(request(client_sock, {"config", "set", "ordered-index", index}), k_ok);
+    std::vector<std::string> all;
+    std::string cursor;
+    int pages = 0;
+    do {
+      std::vector<std::string> keys = scan_reply(
+          request(client_sock, {"prefixscan", "user:1:", cursor, "count", "7"}), cursor);
+      all.insert(all.end(), keys.begin(), keys.end());
+      pages++;
+    } while (!cursor.empty());
+    ASSERT_EQ(all.size(), 51u);
+    ASSERT_EQ(pages, 8);
+    ASSERT_TRUE(std::is_sorted(all.begin(), all.end()));
+    ASSERT_EQ(all.back(), "user:1:z");
 
-    // Validate invalid request handling
+    std::vector<std::string> keys = scan_reply(
+        request(client_sock, {"range", "user:1:8", "user:2:1"}), cursor);
+    ASSERT_EQ(keys, (std::vector<std::string>{"user:1:8", "user:1:9", "user:1:z", "user:2:0"}));
+    ASSERT_EQ(cursor, "");
 
-    close(client_sock);
-    exit(0);
-  } else {
-    // Parent process
-    wait(NULL);
-    close(server_sock);
+    // keys deleted between pages are just not seen
+    request(client_sock, {"del", "user:2:10"});
+    keys = scan_reply(request(client_sock, {"prefixscan", "user:2:1", "", "count", "2"}), cursor);
+    ASSERT_EQ(keys, (std::vector<std::string>{"user:2:1", "user:2:11"}));
+    ASSERT_EQ(cursor, "user:2:12");
+    request(client_sock, {"set", "user:2:10", "v"});
+  }
+  ASSERT_EQ(request(client_sock, {"range", "a", "b", "count", "0"})[0], SER_ERR);
+
+  close(client_sock);
+  stop_server(pid);
+}
+
+// a tracking client that never reads, while another one writes
+static bool tracking_client_dropped(int writer, uint16_t port, useconds_t idle_us) {
+  int sock = create_client_socket();
+  int rcvbuf = 4096;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  connect(sock, INADDR_LOOPBACK, port);
+  EXPECT_EQ(request(sock, {"client", "tracking", "on", "bcast"}), k_ok);
+
+  std::string body;
+  for (int batch = 0; batch < 30; ++batch) {
+    for (int i = 0; i < 1000; ++i) {
+      std::vector<std::string> cmd = {"set", std::string(1000, 'k') + std::to_string(i), "v"};
+      send_req(writer, cmd);
+    }
+    for (int i = 0; i < 1000; ++i) {
+      EXPECT_TRUE(read_reply(writer, body));
+    }
+  }
+
+  // what was sent before the close can still be read, then EOF
+  usleep(idle_us);
+  struct timeval tv = {5, 0};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  char buf[65536];
+  ssize_t rv;
+  size_t total = 0;
+  while ((rv = read(sock, buf, sizeof(buf))) > 0) {
+    total += (size_t)rv;
+  }
+  close(sock);
+  return rv == 0 && total < 30000 * 1000;
+}
+
+TEST(ServerTest, OutputLimits) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+
+  // past the hard limit, at once
+  ASSERT_EQ(request(client_sock, {"config", "set", "client-output-hard-limit", "1000000"}), k_ok);
+  ASSERT_TRUE(tracking_client_dropped(client_sock, port, 0));
+
+  // over the soft limit for a second
+  request(client_sock, {"config", "set", "client-output-hard-limit", "0"});
+  request(client_sock, {"config", "set", "client-output-soft-limit", "100000"});
+  request(client_sock, {"config", "set", "client-output-soft-seconds", "1"});
+  ASSERT_TRUE(tracking_client_dropped(client_sock, port, 2500000));
+
+  // the writer was not affected
+  ASSERT_EQ(request(client_sock, {"get", std::string(1000, 'k') + "7"}).substr(5), "v");
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, PipeMode) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+
+  std::string input;
+  for (int i = 0; i < 20000; ++i) {
+    input += "set k" + std::to_string(i) + " v" + std::to_string(i) + "\n";
   }
+  input += "incr k1\n";                             // fails
+  input += "\n  \n";                                // skipped
+  input += "set \"a key\" \"q\\\"\\x41\\n\"\r\n";  // quoted
+  input += "set \"unterminated\n";                 // not sent
+  input += "get k7\n";
+  FILE *in = fmemopen(&input[0], input.size(), "r");
+  PipeStats stats;
+  ASSERT_EQ(pipe_mode(client_sock, in, stats), 0);
+  fclose(in);
+  ASSERT_EQ(stats.sent, 20003u);
+  ASSERT_EQ(stats.errors, 1u);
+  ASSERT_EQ(stats.bad_lines, 1u);
+
+  // the connection is back to normal replies
+  ASSERT_EQ(request(client_sock, {"get", "k19999"}).substr(5), "v19999");
+  ASSERT_EQ(request(client_sock, {"get", "a key"}).substr(5), "q\"A\n");
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, Capture) {
+  static const char *k_capture = "server_test.capt";
+  unlink(k_capture);
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+  int other_sock = connect_client(port);
+
+  ASSERT_EQ(request(client_sock, {"capture", "stop"})[0], SER_ERR);
+  // only plain names, in the capture directory
+  for (const char *name : {"/tmp/x.capt", "../x.capt", "..", "sub/x.capt", ""}) {
+    ASSERT_EQ(request(client_sock, {"capture", "start", name})[0], SER_ERR) << name;
+  }
+  ASSERT_EQ(request(client_sock, {"capture", "start", k_capture}), k_ok);
+  ASSERT_EQ(request(client_sock, {"capture", "start", k_capture})[0], SER_ERR);
+  for (int i = 0; i < 100; ++i) {
+    request(i % 2 ? other_sock : client_sock, {"set", "k" + std::to_string(i), "v"});
+  }
+  request(other_sock, {"get", "k1"});
+  // [arr tag, 3][int tag, records][int tag, dropped][int tag, bytes]
+  std::string body = request(client_sock, {"capture", "stop"});
+  ASSERT_EQ(body.size(), 5u + 3 * 9);
+  ASSERT_EQ(reply_int(body.substr(5)), 101);
+  ASSERT_EQ(reply_int(body.substr(14)), 0);
+  close(other_sock);
+  close(client_sock);
+  stop_server(pid);
+
+  // in order, on two connections, and without CAPTURE itself
+  FILE *f = capture_reader_open(k_capture);
+  ASSERT_NE(f, nullptr);
+  CaptureRec rec;
+  std::vector<uint32_t> conns;
+  uint64_t last_us = 0;
+  for (int i = 0; i < 101; ++i) {
+    ASSERT_TRUE(capture_read(f, rec));
+    ASSERT_GE(rec.ts_us, last_us);
+    last_us = rec.ts_us;
+    std::vector<std::string> cmd;
+    ASSERT_EQ(parse_req((const uint8_t *)rec.body.data(), rec.body.size(), cmd), 0);
+    if (i < 100) {
+      ASSERT_EQ(cmd[1], "k" + std::to_string(i));
+      conns.push_back(rec.conn);
+    } else {
+      ASSERT_EQ(cmd[0], "get");
+    }
+    ASSERT_EQ(rec.conn, conns[i < 100 ? i % 2 : 1]);
+  }
+  ASSERT_NE(conns[0], conns[1]);
+  ASSERT_FALSE(capture_read(f, rec));
+  fclose(f);
+  unlink(k_capture);
+}
+
+TEST(ServerTest, Latency) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+
+  ASSERT_EQ(request(client_sock, {"latency", "reset"}), k_ok);
+  for (int i = 0; i < 50; ++i) {
+    request(client_sock, {"set", "k" + std::to_string(i), "v"});
+  }
+  // an iteration reads until the socket is empty, which can take several
+  // requests; let the loop go back to poll() so they are counted
+  usleep(10000);
+  // [arr tag, 2][int tag, iterations][arr tag, rows] then per row
+  // [arr tag, 5][str tag, len, name][int tag, value] x 4
+  std::string body = request(client_sock, {"latency", "loop"});
+  ASSERT_EQ(body[0], SER_ARR);
+  ASSERT_GE(reply_int(body.substr(5)), 1);
+  size_t at = 5 + 9 + 5;
+  std::map<std::string, int64_t> sums;
+  for (int i = 0; i < 11; ++i) {
+    uint32_t len = 0;
+    memcpy(&len, &body[at + 6], 4);
+    std::string name = body.substr(at + 10, len);
+    at += 10 + len;
+    sums[name] = reply_int(body.substr(at));
+    at += 4 * 9;
+  }
+  ASSERT_EQ(at, body.size());
+  ASSERT_GE(sums["requests"], 50);
+  ASSERT_GT(sums["exec"], 0);
+  ASSERT_GT(sums["read"], 0);
+  ASSERT_GT(sums["write"], 0);
+  ASSERT_GE(sums["busy"], sums["exec"] + sums["read"]);
+
+  body = request(client_sock, {"latency", "doctor"});
+  ASSERT_EQ(body[0], SER_STR);
+  ASSERT_NE(body.find("Longest iterations"), std::string::npos);
+
+  // nothing is profiled while it is off
+  request(client_sock, {"config", "set", "loop-profiler", "0"});
+  request(client_sock, {"latency", "reset"});
+  request(client_sock, {"get", "k1"});
+  body = request(client_sock, {"latency", "loop"});
+  ASSERT_EQ(reply_int(body.substr(5)), 0);
+  ASSERT_EQ(request(client_sock, {"latency", "nope"})[0], SER_ERR);
+
+  close(client_sock);
+  stop_server(pid);
+}
+
+static double seconds_since(const std::chrono::steady_clock::time_point &start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(ServerTest, Blpop) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int waiter = connect_client(port);
+  int pusher = connect_client(port);
+
+  // an element is there already
+  request(pusher, {"rpush", "q", "a"});
+  // [arr tag, 2][str tag, 1, q][str tag, 1, a]
+  std::string body = request(waiter, {"blpop", "q", "1"});
+  ASSERT_EQ(body.size(), 5u + 2 * 6);
+  ASSERT_EQ(body[10], 'q');
+  ASSERT_EQ(body[16], 'a');
+
+  // times out with nil
+  auto start = std::chrono::steady_clock::now();
+  ASSERT_EQ(request(waiter, {"blpop", "q", "0.2"}), std::string(1, SER_NIL));
+  ASSERT_GE(seconds_since(start), 0.15);
+
+  // woken up by a push from another connection, on any of its keys; huge
+  // timeouts block like 0
+  for (const char *timeout : {"5", "0", "1e300", "inf"}) {
+    std::vector<std::string> cmd = {"blpop", "none", "q", timeout};
+    ASSERT_EQ(send_req(waiter, cmd), 0);
+    usleep(50000);
+    ASSERT_EQ(reply_int(request(pusher, {"lpush", "q", "b"})), 1);
+    ASSERT_TRUE(read_reply(waiter, body));
+    ASSERT_EQ(body.size(), 5u + 2 * 6);
+    ASSERT_EQ(body[16], 'b');
+  }
+
+  ASSERT_EQ(request(waiter, {"blpop", "q", "-1"})[0], SER_ERR);
+  ASSERT_EQ(request(waiter, {"blpop", "q", "nan"})[0], SER_ERR);
+
+  // a request pipelined behind a blocked one runs after it is woken up
+  std::string pipelined;
+  ASSERT_EQ(append_req(pipelined, {"blpop", "q", "0"}), 0);
+  ASSERT_EQ(append_req(pipelined, {"llen", "q"}), 0);
+  ASSERT_EQ(write_all(waiter, pipelined.data(), pipelined.size()), 0);
+  usleep(50000);
+  ASSERT_EQ(reply_int(request(pusher, {"rpush", "q", "c", "d"})), 2);
+  ASSERT_TRUE(read_reply(waiter, body));
+  ASSERT_EQ(body[16], 'c');
+  ASSERT_TRUE(read_reply(waiter, body));
+  ASSERT_EQ(reply_int(body), 1);
+  request(pusher, {"lpop", "q"});
+
+  // a waiter that went away gets nothing, whether or not the server has
+  // noticed before the push
+  for (useconds_t idle_us : {50000, 0}) {
+    std::vector<std::string> cmd = {"blpop", "q", "0"};
+    ASSERT_EQ(send_req(waiter, cmd), 0);
+    usleep(50000);
+    close(waiter);
+    usleep(idle_us);
+    ASSERT_EQ(reply_int(request(pusher, {"rpush", "q", "e"})), 1);
+    ASSERT_EQ(request(pusher, {"lpop", "q"}).substr(5), "e");
+    waiter = connect_client(port);
+  }
+  close(pusher);
+  close(waiter);
+  stop_server(pid);
+}
+
+// replies bigger than the write buffer arrive whole
+TEST(ServerTest, BigReplies) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+  std::string big(3 * k_max_msg, 'b');
+  // [arr tag, n] then [str tag, len, bytes] per element
+  std::string two = std::string(1, SER_ARR) + std::string("\x02\0\0\0", 4);
+  auto str = [](const std::string &s) {
+    uint32_t len = (uint32_t)s.size();
+    return std::string(1, SER_STR) + std::string((char *)&len, 4) + s;
+  };
+
+  request(client_sock, {"rpush", "l", big, big});
+  ASSERT_EQ(request(client_sock, {"lrange", "l", "0", "-1"}), two + str(big) + str(big));
+  ASSERT_EQ(request(client_sock, {"lpop", "l"}), str(big));
+  ASSERT_EQ(request(client_sock, {"blpop", "l", "1"}), two + str("l") + str(big));
+  ASSERT_EQ(reply_int(request(client_sock, {"llen", "l"})), 0);
+
+  request(client_sock, {"zadd", "z", "1", big + "1", "2", big + "2"});
+  ASSERT_EQ(request(client_sock, {"zrange", "z", "0", "-1"}), two + str(big + "1") + str(big + "2"));
+
+  // the writes of a transaction and all of its replies
+  request(client_sock, {"set", "k", big});
+  ASSERT_EQ(request(client_sock, {"multi"}), k_ok);
+  request(client_sock, {"incr", "c"});
+  request(client_sock, {"get", "k"});
+  std::string body = request(client_sock, {"exec"});
+  ASSERT_EQ(body.size(), 5u + 9 + 5 + big.size());
+  ASSERT_EQ(body.substr(5 + 9), str(big));
+  ASSERT_EQ(request(client_sock, {"get", "c"}), str("1"));
+
+  // and in RESP
+  request(client_sock, {"rpush", "r", big, big});
+  int resp_sock = connect_client(port);
+  std::string lrange = "*4\r\n$6\r\nLRANGE\r\n$1\r\nr\r\n$1\r\n0\r\n$2\r\n-1\r\n";
+  ASSERT_EQ(write_all(resp_sock, lrange.data(), lrange.size()), 0);
+  std::string bulk = "$" + std::to_string(big.size()) + "\r\n" + big + "\r\n";
+  std::string want = "*2\r\n" + bulk + bulk;
+  std::string got(want.size(), '\0');
+  ASSERT_EQ(read_full(resp_sock, &got[0], got.size()), 0);
+  ASSERT_EQ(got, want);
+  close(resp_sock);
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, Counters) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+
+  // a missing key counts as 0
+  ASSERT_EQ(reply_int(request(client_sock, {"incr", "c"})), 1);
+  ASSERT_EQ(reply_int(request(client_sock, {"incrby", "c", "41"})), 42);
+  ASSERT_EQ(reply_int(request(client_sock, {"decr", "c"})), 41);
+  ASSERT_EQ(reply_int(request(client_sock, {"decrby", "c", "-9"})), 50);
+  ASSERT_EQ(request(client_sock, {"get", "c"}).substr(5), "50");
+
+  // a string that is a canonical integer, and GET gives back the same bytes
+  request(client_sock, {"set", "n", "-9223372036854775807"});
+  ASSERT_EQ(reply_int(request(client_sock, {"decr", "n"})), INT64_MIN);
+  ASSERT_EQ(request(client_sock, {"get", "n"}).substr(5), "-9223372036854775808");
+  ASSERT_EQ(request(client_sock, {"decr", "n"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"get", "n"}).substr(5), "-9223372036854775808");
+  request(client_sock, {"set", "m", "9223372036854775807"});
+  ASSERT_EQ(request(client_sock, {"incr", "m"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"decrby", "c", "-9223372036854775808"})[0], SER_ERR);
+
+  // not integers
+  for (const char *val : {"007", "-0", "1.5", "abc", ""}) {
+    request(client_sock, {"set", "s", val});
+    ASSERT_EQ(request(client_sock, {"incr", "s"})[0], SER_ERR) << val;
+    ASSERT_EQ(request(client_sock, {"get", "s"}).substr(5), val);
+  }
+  ASSERT_EQ(request(client_sock, {"incrby", "c", "x"})[0], SER_ERR);
+  request(client_sock, {"rpush", "l", "a"});
+  ASSERT_EQ(request(client_sock, {"incr", "l"})[0], SER_ERR);
+
+  // a counter turns back into a string
+  request(client_sock, {"set", "c", "hello"});
+  ASSERT_EQ(request(client_sock, {"get", "c"}).substr(5), "hello");
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, Resp) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+  auto expect = [&](const std::string &want) {
+    std::string got(want.size(), '\0');
+    ASSERT_EQ(read_full(client_sock, &got[0], got.size()), 0);
+    ASSERT_EQ(got, want);
+  };
+
+  // a status, not a bulk string or a nil
+  std::string ping = "PING\r\n";
+  ASSERT_EQ(write_all(client_sock, ping.data(), ping.size()), 0);
+  expect("+PONG\r\n");
+
+  // a value of many reads, parsed once it is complete
+  std::string val(1 << 20, 'v');
+  std::string set = "*3\r\n$3\r\nSET\r\n$1\r\nk\r\n$" + std::to_string(val.size()) + "\r\n" + val + "\r\n";
+  for (size_t at = 0; at < set.size(); at += 1000) {
+    size_t n = std::min<size_t>(1000, set.size() - at);
+    ASSERT_EQ(write_all(client_sock, &set[at], n), 0);
+  }
+  expect("+OK\r\n");
+  std::string get = "*2\r\n$3\r\nGET\r\n$1\r\nk\r\n";
+  ASSERT_EQ(write_all(client_sock, get.data(), get.size()), 0);
+  expect("$" + std::to_string(val.size()) + "\r\n" + val + "\r\n");
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, Transactions) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+  int other = connect_client(port);
+  const std::string queued = std::string(1, SER_STATUS) + std::string("\x06\0\0\0", 4) + "QUEUED";
+  auto exec_count = [](const std::string &body) {
+    uint32_t n = 0;
+    EXPECT_EQ(body[0], SER_ARR);
+    memcpy(&n, &body[1], 4);
+    return n;
+  };
+
+  ASSERT_EQ(request(client_sock, {"exec"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"discard"})[0], SER_ERR);
+
+  // commands run at EXEC, and one failing does not stop the others
+  request(client_sock, {"set", "s", "x"});
+  ASSERT_EQ(request(client_sock, {"multi"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"multi"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"set", "a", "1"}), queued);
+  ASSERT_EQ(request(client_sock, {"incr", "s"}), queued);
+  ASSERT_EQ(request(client_sock, {"nosuchcommand"}), queued);
+  ASSERT_EQ(request(client_sock, {"get", "a"}), queued);
+  ASSERT_EQ(request(other, {"get", "a"}), std::string(1, SER_NIL));
+  std::string body = request(client_sock, {"exec"});
+  ASSERT_EQ(exec_count(body), 4u);
+  ASSERT_EQ(body.substr(5, k_ok.size()), k_ok);
+  ASSERT_EQ(body[5 + k_ok.size()], SER_ERR);
+  ASSERT_EQ(body.substr(body.size() - 6), std::string(1, SER_STR) + std::string("\x01\0\0\0", 4) + "1");
+  ASSERT_EQ(request(client_sock, {"exec"})[0], SER_ERR);
+
+  // DISCARD drops the queue
+  ASSERT_EQ(request(client_sock, {"multi"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"set", "a", "2"}), queued);
+  ASSERT_EQ(request(client_sock, {"discard"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"get", "a"}).substr(5), "1");
+
+  // a write from another connection aborts the transaction
+  ASSERT_EQ(request(client_sock, {"watch", "a"}), k_ok);
+  request(other, {"set", "a", "3"});
+  ASSERT_EQ(request(client_sock, {"multi"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"watch", "a"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"set", "a", "4"}), queued);
+  ASSERT_EQ(request(client_sock, {"exec"}), std::string(1, SER_NIL));
+  ASSERT_EQ(request(client_sock, {"get", "a"}).substr(5), "3");
+
+  // without that write it runs, and EXEC unwatches
+  ASSERT_EQ(request(client_sock, {"watch", "a"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"multi"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"set", "a", "5"}), queued);
+  ASSERT_EQ(exec_count(request(client_sock, {"exec"})), 1u);
+  request(other, {"set", "a", "6"});
+  ASSERT_EQ(request(client_sock, {"multi"}), k_ok);
+  ASSERT_EQ(exec_count(request(client_sock, {"exec"})), 0u);
+
+  // a missing key that was created and deleted again changed too
+  ASSERT_EQ(request(client_sock, {"watch", "new"}), k_ok);
+  request(other, {"set", "new", "1"});
+  ASSERT_EQ(reply_int(request(other, {"del", "new"})), 1);
+  ASSERT_EQ(request(client_sock, {"multi"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"set", "new", "2"}), queued);
+  ASSERT_EQ(request(client_sock, {"exec"}), std::string(1, SER_NIL));
+  ASSERT_EQ(request(client_sock, {"get", "new"}), std::string(1, SER_NIL));
+
+  // and so did a missing key that was created
+  ASSERT_EQ(request(client_sock, {"watch", "new"}), k_ok);
+  request(other, {"set", "new", "1"});
+  ASSERT_EQ(request(client_sock, {"multi"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"exec"}), std::string(1, SER_NIL));
+  close(other);
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, Slowlog) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+  auto str = [](const std::string &s) {
+    uint32_t len = (uint32_t)s.size();
+    return std::string(1, SER_STR) + std::string((char *)&len, 4) + s;
+  };
+
+  // log every command
+  ASSERT_EQ(request(client_sock, {"config", "set", "slowlog-log-slower-than", "0"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"slowlog", "reset"}), k_ok);
+  ASSERT_EQ(reply_int(request(client_sock, {"slowlog", "len"})), 1);  // the RESET
+
+  // SET takes its value, the log still has it as sent
+  ASSERT_EQ(request(client_sock, {"set", "k", "hello"}), k_ok);
+  std::string body = request(client_sock, {"slowlog", "get", "1"});
+  ASSERT_EQ(body.substr(0, 10), std::string(1, SER_ARR) + std::string("\x01\0\0\0", 4)
+                                    + std::string(1, SER_ARR) + std::string("\x05\0\0\0", 4));
+  ASSERT_NE(body.find(std::string(1, SER_ARR) + std::string("\x03\0\0\0", 4) + str("set") + str("k")
+                      + str("hello")), std::string::npos);
+
+  // long values are cut
+  ASSERT_EQ(request(client_sock, {"set", "k", std::string(1000, 'x')}), k_ok);
+  body = request(client_sock, {"slowlog", "get", "1"});
+  ASSERT_NE(body.find(str(std::string(k_slowlog_max_arglen, 'x') + "... (872 more bytes)")), std::string::npos);
+
+  // the newest first, all of them for a negative count
+  int64_t len = reply_int(request(client_sock, {"slowlog", "len"}));
+  ASSERT_EQ(len, 6);
+  body = request(client_sock, {"slowlog", "get", "-1"});
+  uint32_t n = 0;
+  memcpy(&n, &body[1], 4);
+  ASSERT_EQ(n, (uint32_t)len + 1);
+  ASSERT_EQ(request(client_sock, {"slowlog", "get", "x"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"slowlog", "nope"})[0], SER_ERR);
+
+  // off
+  ASSERT_EQ(request(client_sock, {"config", "set", "slowlog-log-slower-than", "-1"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"slowlog", "reset"}), k_ok);
+  request(client_sock, {"set", "k", "v"});
+  ASSERT_EQ(reply_int(request(client_sock, {"slowlog", "len"})), 0);
+  close(client_sock);
+  stop_server(pid);
+}
+
+TEST(ServerTest, BloomReserve) {
+  uint16_t port = 0;
+  pid_t pid = start_server(&port);
+  int client_sock = connect_client(port);
+
+  ASSERT_EQ(request(client_sock, {"bf.reserve", "b", "0.001", "1000"}), k_ok);
+  ASSERT_EQ(request(client_sock, {"bf.reserve", "b", "0.001", "1000"})[0], SER_ERR);
+  ASSERT_EQ(reply_int(request(client_sock, {"bf.add", "b", "x"})), 1);
+  ASSERT_EQ(reply_int(request(client_sock, {"bf.exists", "b", "x"})), 1);
+
+  // too precise, too many items, or too large together
+  ASSERT_EQ(request(client_sock, {"bf.reserve", "c", "1e-300", "1000"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"bf.reserve", "c", "0.01", "9223372036854775807"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"bf.reserve", "c", "1e-9", "4294967296"})[0], SER_ERR);
+  ASSERT_EQ(request(client_sock, {"get", "c"}), std::string(1, SER_NIL));
+  close(client_sock);
+  stop_server(pid);
 }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "gtest/gtest.h"
+#include "../src/server_client.h"
+#include "../src/parser.h"
+#include <signal.h>
+#include <sys/wait.h>
+
+/*
+ * A server in a child process and native protocol clients of it, for the
+ * tests that talk to one over a socket.
+ */
+
+// Starts a server on an ephemeral port in a child process, which calls
+// `setup` first if given
+inline pid_t start_server(uint16_t *port, void (*setup)() = NULL) {
+  int server_sock = create_server_socket();
+
+  // Bind and listen on server socket
+  bind_socket(server_sock, 0);
+  struct sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  getsockname(server_sock, (struct sockaddr *)&addr, &len);
+  *port = ntohs(addr.sin_port);
+  listen_socket(server_sock);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    // Child process
+    if (setup) {
+      setup();
+    }
+    accept_connection(server_sock);
+    exit(0);
+  }
+  close(server_sock);
+  return pid;
+}
+
+inline void stop_server(pid_t pid) {
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+}
+
+inline int connect_client(uint16_t port) {
+  int client_sock = create_client_socket();
+  connect(client_sock, INADDR_LOOPBACK, port);
+  return client_sock;
+}
+
+// Reads one response body; returns false on EOF or error
+inline bool read_reply(int fd, std::string &body) {
+  uint32_t len = 0;
+  if (read_full(fd, (char *)&len, 4) || len > 5 + k_max_req) {
+    return false;
+  }
+  body.resize(len);
+  return len == 0 || read_full(fd, &body[0], len) == 0;
+}
+
+inline std::string request(int fd, std::vector<std::string> cmd) {
+  std::string body;
+  EXPECT_EQ(send_req(fd, cmd), 0);
+  EXPECT_TRUE(read_reply(fd, body));
+  return body;
+}
+
+// the reply of SET and the other commands that only succeed
+const std::string k_ok = std::string(1, SER_STATUS) + std::string("\x02\0\0\0", 4) + "OK";
@@ -0,0 +1,105 @@
+#include "../src/vlog.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+static std::string value(int i) {
+  return std::string(100 + i % 50, 'a' + i % 26);
+}
+
+TEST(VLogTest, AppendRead) {
+  VLog *log = vlog_new(".", 1 << 20);
+  ASSERT_NE(log, nullptr);
+  std::vector<VLoc> locs;
+  for (int i = 0; i < 1000; ++i) {
+    std::string key = "k" + std::to_string(i);
+    std::string val = value(i);
+    locs.push_back(vlog_append(log, key.data(), key.size(), val.data(), val.size()));
+    ASSERT_NE(locs.back(), k_vloc_none);
+    ASSERT_EQ(vloc_len(locs.back()), val.size());
+  }
+  std::string out;
+  for (int i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(vlog_read(log, locs[i], out));
+    ASSERT_EQ(out, value(i));
+  }
+  ASSERT_EQ(vlog_segments(log), 1u);
+
+  // values bigger than a VLoc can address are refused
+  std::string big(k_vlog_max_value + 1, 'x');
+  ASSERT_EQ(vlog_append(log, "b", 1, big.data(), big.size()), k_vloc_none);
+  vlog_free(log);
+}
+
+// moving the live values out of a segment, as the server does
+TEST(VLogTest, Compaction) {
+  VLog *log = vlog_new(".", 4096);
+  std::vector<VLoc> locs;
+  for (int i = 0; i < 200; ++i) {
+    std::string key = std::to_string(i);
+    std::string val = value(i);
+    locs.push_back(vlog_append(log, key.data(), key.size(), val.data(), val.size()));
+  }
+  size_t nsegs = vlog_segments(log);
+  ASSERT_GT(nsegs, 2u);
+  // no sealed segment is mostly dead yet
+  ASSERT_EQ(vlog_pick(log, 0.5), -1);
+
+  // drop two thirds of the values
+  for (int i = 0; i < 200; ++i) {
+    if (i % 3) {
+      vlog_release(log, locs[i]);
+      locs[i] = k_vloc_none;
+    }
+  }
+  uint64_t live = vlog_live_bytes(log);
+
+  int seg;
+  std::string key, val;
+  while ((seg = vlog_pick(log, 0.5)) >= 0) {
+    uint64_t pos = 0;
+    VLoc loc;
+    while (vlog_scan(log, (uint32_t)seg, &pos, key, val, &loc)) {
+      int i = atoi(key.c_str());
+      ASSERT_EQ(val, value(i));
+      if (locs[i] == loc) {
+        locs[i] = vlog_append(log, key.data(), key.size(), val.data(), val.size());
+        vlog_release(log, loc);
+      }
+    }
+    ASSERT_TRUE(vlog_drop(log, (uint32_t)seg));
+  }
+  ASSERT_LT(vlog_segments(log), nsegs);
+  ASSERT_EQ(vlog_live_bytes(log), live);
+  ASSERT_LT(vlog_file_bytes(log), live * 2);
+
+  for (int i = 0; i < 200; i += 3) {
+    ASSERT_TRUE(vlog_read(log, locs[i], val));
+    ASSERT_EQ(val, value(i));
+  }
+  vlog_free(log);
+}
+
+// a segment that failed to compact is not picked again while it is in use
+TEST(VLogTest, SkipFailedSegment) {
+  VLog *log = vlog_new(".", 4096);
+  std::vector<VLoc> locs;
+  for (int i = 0; i < 100; ++i) {
+    std::string key = std::to_string(i);
+    std::string val = value(i);
+    locs.push_back(vlog_append(log, key.data(), key.size(), val.data(), val.size()));
+  }
+  uint32_t seg = vloc_seg(locs[0]);
+  for (size_t i = 1; i < locs.size() && vloc_seg(locs[i]) == seg; ++i) {
+    vlog_release(log, locs[i]);
+  }
+  ASSERT_EQ(vlog_pick(log, 0.5), (int)seg);
+
+  vlog_skip(log, seg);
+  ASSERT_NE(vlog_pick(log, 0.5), (int)seg);
+  ASSERT_FALSE(vlog_drop(log, seg));
+  vlog_release(log, locs[0]);
+  ASSERT_EQ(vlog_pick(log, 0.5), (int)seg);
+  ASSERT_TRUE(vlog_drop(log, seg));
+  vlog_free(log);
+}
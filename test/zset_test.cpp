@@ -0,0 +1,112 @@
+#include "../src/zset.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <map>
+
+struct Visited {
+  std::vector<std::string> names;
+  std::vector<double> scores;
+};
+
+static void collect(const char *name, size_t len, double score, void *arg) {
+  Visited *v = (Visited *)arg;
+  v->names.push_back(std::string(name, len));
+  v->scores.push_back(score);
+}
+
+static bool add(ZSet *zset, const std::string &name, double score) {
+  return zset_add(zset, name.data(), name.size(), score);
+}
+
+TEST(ZSetTest, PackedBasics) {
+  ZSet *zset = zset_new();
+  ASSERT_TRUE(add(zset, "b", 2));
+  ASSERT_TRUE(add(zset, "a", 1));
+  ASSERT_TRUE(add(zset, "c", 1));
+  ASSERT_FALSE(add(zset, "c", 3));
+  ASSERT_EQ(zset_encoding(zset), (uint32_t)ZSET_PACKED);
+  ASSERT_EQ(zset_len(zset), 3u);
+
+  double score = 0;
+  ASSERT_TRUE(zset_score(zset, "c", 1, &score));
+  ASSERT_EQ(score, 3);
+  ASSERT_FALSE(zset_score(zset, "x", 1, &score));
+
+  ASSERT_EQ(zset_rank(zset, "a", 1), 0);
+  ASSERT_EQ(zset_rank(zset, "b", 1), 1);
+  ASSERT_EQ(zset_rank(zset, "c", 1), 2);
+  ASSERT_EQ(zset_rank(zset, "x", 1), -1);
+
+  ASSERT_TRUE(zset_rem(zset, "b", 1));
+  ASSERT_FALSE(zset_rem(zset, "b", 1));
+  ASSERT_EQ(zset_len(zset), 2u);
+  zset_free(zset);
+}
+
+TEST(ZSetTest, ConvertsOnLongMember) {
+  ZSet *zset = zset_new();
+  add(zset, "a", 1);
+  add(zset, std::string(zset_max_packed_value + 1, 'x'), 2);
+  ASSERT_EQ(zset_encoding(zset), (uint32_t)ZSET_SKIPLIST);
+  ASSERT_EQ(zset_len(zset), 2u);
+  ASSERT_EQ(zset_rank(zset, "a", 1), 0);
+  zset_free(zset);
+}
+
+// both encodings must agree with a std::map model
+TEST(ZSetTest, MatchesModel) {
+  for (size_t n : {(size_t)50, (size_t)5000}) {
+    ZSet *zset = zset_new();
+    std::map<std::string, double> model;
+    srand(42);
+    for (size_t i = 0; i < n * 3; ++i) {
+      std::string name = "k" + std::to_string(rand() % n);
+      double score = rand() % 100;
+      if (rand() % 4 == 0) {
+        ASSERT_EQ(zset_rem(zset, name.data(), name.size()), model.erase(name) == 1);
+      } else {
+        ASSERT_EQ(add(zset, name, score), model.count(name) == 0);
+        model[name] = score;
+      }
+    }
+    ASSERT_EQ(zset_len(zset), model.size());
+
+    std::vector<std::pair<double, std::string>> order;
+    for (auto &kv : model) {
+      order.push_back({kv.second, kv.first});
+    }
+    std::sort(order.begin(), order.end());
+
+    for (size_t i = 0; i < order.size(); ++i) {
+      const std::string &name = order[i].second;
+      ASSERT_EQ(zset_rank(zset, name.data(), name.size()), (int64_t)i);
+    }
+
+    Visited all;
+    zset_range_by_rank(zset, 0, order.size() - 1, collect, &all);
+    ASSERT_EQ(all.names.size(), order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      ASSERT_EQ(all.names[i], order[i].second);
+    }
+
+    ZRangeSpec range;
+    range.min = 10;
+    range.max = 20;
+    range.minex = true;
+    Visited some;
+    zset_range_by_score(zset, range, 1, 5, collect, &some);
+    std::vector<std::string> expect;
+    for (auto &p : order) {
+      if (p.first > 10 && p.first <= 20) {
+        expect.push_back(p.second);
+      }
+    }
+    expect.erase(expect.begin(), expect.begin() + std::min<size_t>(1, expect.size()));
+    if (expect.size() > 5) {
+      expect.resize(5);
+    }
+    ASSERT_EQ(some.names, expect);
+    zset_free(zset);
+  }
+}